@@ -0,0 +1,470 @@
+#pragma once
+
+#include "shared.h"
+#include "asset.h"
+#include "renderer.h"
+#include "atlas.cpp"
+#include "profiler.h"
+
+void A_DecodeTexture(asset_job *Job)
+{
+    PF_SCOPE("A_DecodeTexture");
+    texture *Texture = Job->Texture;
+
+    // Prefer the cooked texture, already flipped and with every mip level, see cooker.h
+    char CookedFilename[256];
+    CK_GetCookedFilename(CookedFilename, sizeof(CookedFilename), Job->Filename);
+    cooked_texture *Cooked = CK_ReadCookedTexture(CookedFilename);
+    if(Cooked)
+    {
+        Texture->Width = Cooked->Width;
+        Texture->Height = Cooked->Height;
+        Texture->ChannelCount = Cooked->ChannelCount;
+        Texture->IsPremultiplied = (Cooked->Flags & COOKED_TEXTURE_PREMULTIPLIED) != 0;
+        R_SetTextureFormat(Texture);
+
+        Job->CookedTexture = Cooked;
+        Job->PixelsSize = Cooked->PixelsSize;
+        SDL_AtomicSet(&Job->State, AssetJob_Decoded);
+        return;
+    }
+
+    // NOTE: stbi_set_flip_vertically_on_load is global, it is set once in A_CreateAssetLoader
+    i32 RequestedChannelCount = 0;
+    Job->Pixels = R_LoadImage(Job->Filename, &Texture->Width, &Texture->Height, &Texture->ChannelCount, RequestedChannelCount);
+    if(Job->Pixels == NULL)
+    {
+        printf("Could not load image file: %s\n", Job->Filename);
+        SDL_AtomicSet(&Job->State, AssetJob_Failed);
+        return;
+    }
+
+    if(!R_SetTextureFormat(Texture))
+    {
+        fprintf(stderr, "%s Texture format is not GL_RGB or GL_RGBA\n", Job->Filename);
+        stbi_image_free(Job->Pixels);
+        Job->Pixels = NULL;
+        SDL_AtomicSet(&Job->State, AssetJob_Failed);
+        return;
+    }
+
+    Job->PixelsSize = (size_t)Texture->Width * (size_t)Texture->Height * (size_t)Texture->ChannelCount;
+    SDL_AtomicSet(&Job->State, AssetJob_Decoded);
+}
+
+void A_DecodeFont(asset_job *Job)
+{
+    PF_SCOPE("A_DecodeFont");
+    // Glyphs are rasterized and packed into the font atlas here, the main
+    // thread uploads the atlas with a single PBO fill.
+    font *Font = Job->Font;
+    Job->Pixels = R_RasterizeFont(Font);
+    if(!Job->Pixels)
+    {
+        SDL_AtomicSet(&Job->State, AssetJob_Failed);
+        return;
+    }
+
+    Job->PixelsSize = (size_t)Font->AtlasWidth * (size_t)Font->AtlasHeight;
+    SDL_AtomicSet(&Job->State, AssetJob_Decoded);
+}
+
+void A_DecodeAtlas(asset_job *Job)
+{
+    PF_SCOPE("A_DecodeAtlas");
+    // Prefer the offline atlas, build a new one if it is missing or does not have all our textures
+    atlas *Atlas = AT_ReadAtlas(Job->Filename);
+    for(u32 i = 0; Atlas && i < Job->AtlasTextureCount; i++)
+    {
+        if(AT_FindSprite(Atlas, Job->AtlasFilenames[i]) == NULL)
+        {
+            printf("%s is out of date, missing %s. Building the atlas at load time\n", Job->Filename, Job->AtlasFilenames[i]);
+            AT_FreeAtlas(Atlas);
+            Atlas = NULL;
+        }
+    }
+
+    if(Atlas == NULL)
+    {
+        atlas_image Images[ATLAS_MAX_SPRITES] = {};
+        u32 ImageCount = 0;
+        for(u32 i = 0; i < Job->AtlasTextureCount; i++)
+        {
+            atlas_image *Image = &Images[ImageCount];
+            Image->Name = Job->AtlasFilenames[i];
+            Image->Pixels = R_LoadImage(Image->Name, &Image->Width, &Image->Height, &Image->ChannelCount, 0);
+            if(Image->Pixels == NULL || (Image->ChannelCount != 3 && Image->ChannelCount != 4))
+            {
+                // The texture never becomes ready, same as a failed A_LoadTexture
+                printf("Could not load image file: %s\n", Image->Name);
+                stbi_image_free(Image->Pixels);
+                continue;
+            }
+            ImageCount++;
+        }
+
+        Atlas = AT_BuildAtlas(Images, ImageCount, ATLAS_DEFAULT_PAGE_SIZE, ATLAS_DEFAULT_PADDING);
+
+        for(u32 i = 0; i < ImageCount; i++)
+        {
+            stbi_image_free(Images[i].Pixels);
+        }
+    }
+
+    if(Atlas == NULL)
+    {
+        SDL_AtomicSet(&Job->State, AssetJob_Failed);
+        return;
+    }
+
+    Job->Atlas = Atlas;
+    Job->PixelsSize = AT_GetPageSize(Atlas) * Atlas->PageCount;
+    SDL_AtomicSet(&Job->State, AssetJob_Decoded);
+}
+
+i32 SDLCALL A_WorkerThread(void *Data)
+{
+    asset_loader *Loader = (asset_loader*)Data;
+    PF_SetThreadName("AssetWorker");
+
+    for(;;)
+    {
+        // Every A_QueueJob posts the semaphore once, so there is a job waiting for us
+        SDL_SemWait(Loader->JobSemaphore);
+        if(!SDL_AtomicGet(&Loader->IsRunning))
+        {
+            break;
+        }
+
+        // SDL_AtomicAdd returns the previous value
+        i32 JobIndex = SDL_AtomicAdd(&Loader->NextJobToDecode, 1);
+        Assert(JobIndex < ASSET_MAX_JOBS);
+        asset_job *Job = &Loader->Jobs[JobIndex];
+
+        switch(Job->Type)
+        {
+            case AssetJob_Texture:
+            {
+                A_DecodeTexture(Job);
+                break;
+            }
+            case AssetJob_Font:
+            {
+                A_DecodeFont(Job);
+                break;
+            }
+            case AssetJob_Atlas:
+            {
+                A_DecodeAtlas(Job);
+                break;
+            }
+            default:
+            {
+                InvalidCodePath;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+asset_loader *A_CreateAssetLoader(size_t UploadBudgetBytes)
+{
+    PF_SCOPE("A_CreateAssetLoader");
+    asset_loader *Result = (asset_loader*)Malloc(sizeof(asset_loader)); Assert(Result);
+    Result->UploadBudgetBytes = UploadBudgetBytes;
+    Result->JobSemaphore = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&Result->NextJobToDecode, 0);
+    SDL_AtomicSet(&Result->IsRunning, 1);
+
+    // All images are flipped, set it once here instead of on every worker thread
+    i32 FlipVertically = 1;
+    stbi_set_flip_vertically_on_load(FlipVertically);
+
+    glGenBuffers(1, &Result->PixelUnpackBuffer);
+
+    // Leave one core to the main thread, it keeps rendering while we load
+    i32 WorkerCount = SDL_GetCPUCount() - 1;
+    if(WorkerCount < 1) WorkerCount = 1;
+    if(WorkerCount > ASSET_MAX_WORKERS) WorkerCount = ASSET_MAX_WORKERS;
+    Result->WorkerCount = (u32)WorkerCount;
+
+    for(u32 i = 0; i < Result->WorkerCount; i++)
+    {
+        Result->Workers[i] = SDL_CreateThread(A_WorkerThread, "AssetWorker", Result);
+        Assert(Result->Workers[i]);
+    }
+
+    return Result;
+}
+
+void A_DestroyAssetLoader(asset_loader *Loader)
+{
+    Assert(Loader);
+
+    SDL_AtomicSet(&Loader->IsRunning, 0);
+    for(u32 i = 0; i < Loader->WorkerCount; i++)
+    {
+        SDL_SemPost(Loader->JobSemaphore);
+    }
+    for(u32 i = 0; i < Loader->WorkerCount; i++)
+    {
+        SDL_WaitThread(Loader->Workers[i], NULL);
+    }
+
+    SDL_DestroySemaphore(Loader->JobSemaphore);
+    R_DeleteBuffer(&Loader->PixelUnpackBuffer);
+    Free(Loader);
+}
+
+asset_job *A_QueueJob(asset_loader *Loader, asset_job_type Type, char *Filename)
+{
+    Assert(Loader);
+    Assert(Filename);
+    Assert(Loader->JobCount < ASSET_MAX_JOBS);
+
+    asset_job *Result = &Loader->Jobs[Loader->JobCount++];
+    Result->Type = Type;
+    Result->Filename = Filename;
+    SDL_AtomicSet(&Result->State, AssetJob_Queued);
+
+    return Result;
+}
+
+texture *A_LoadTexture(asset_loader *Loader, char *Filename)
+{
+    // Returns right away, the texture IsReady a few frames later
+    texture *Result = (texture*)Malloc(sizeof(texture)); Assert(Result);
+    Result->IsReady = false;
+
+    if(Loader->OpenAtlasJob)
+    {
+        // Between A_BeginAtlas and A_EndAtlas, the texture will be a part of an atlas page
+        asset_job *AtlasJob = Loader->OpenAtlasJob;
+        Assert(AtlasJob->AtlasTextureCount < ATLAS_MAX_SPRITES);
+        AtlasJob->AtlasFilenames[AtlasJob->AtlasTextureCount] = Filename;
+        AtlasJob->AtlasTextures[AtlasJob->AtlasTextureCount] = Result;
+        AtlasJob->AtlasTextureCount++;
+        return Result;
+    }
+
+    asset_job *Job = A_QueueJob(Loader, AssetJob_Texture, Filename);
+    Job->Texture = Result;
+    SDL_SemPost(Loader->JobSemaphore);
+
+    return Result;
+}
+
+font *A_LoadFont(asset_loader *Loader, char *Filename, i32 Width, i32 Height, b32 DistanceField = false)
+{
+    // Returns right away, the font IsReady a few frames later
+    Assert(Width >= 0);
+    Assert(Height >= 0);
+
+    // Jobs are decoded in queue order, nothing can be queued while the atlas job is open
+    Assert(Loader->OpenAtlasJob == NULL);
+
+    font *Result = (font*)Malloc(sizeof(font)); Assert(Result);
+    Result->Filename = Filename;
+    Result->Width = Width;
+    Result->Height = Height;
+    Result->IsDistanceField = DistanceField;
+    Result->IsReady = false;
+
+    asset_job *Job = A_QueueJob(Loader, AssetJob_Font, Filename);
+    Job->Font = Result;
+    SDL_SemPost(Loader->JobSemaphore);
+
+    return Result;
+}
+
+void A_BeginAtlas(asset_loader *Loader, char *AtlasFilename)
+{
+    // Every A_LoadTexture until A_EndAtlas goes into the same atlas, so
+    // the renderer can draw all of them from a single bound texture.
+    Assert(Loader);
+    Assert(Loader->OpenAtlasJob == NULL);
+
+    Loader->OpenAtlasJob = A_QueueJob(Loader, AssetJob_Atlas, AtlasFilename);
+}
+
+void A_EndAtlas(asset_loader *Loader)
+{
+    Assert(Loader);
+    Assert(Loader->OpenAtlasJob);
+
+    Loader->OpenAtlasJob = NULL;
+    SDL_SemPost(Loader->JobSemaphore);
+}
+
+u8 *A_FillPixelUnpackBuffer(asset_loader *Loader, u8 *Pixels, size_t Size)
+{
+    // Copy the pixels into the pixel unpack buffer and let the driver do
+    // the transfer. Returns what glTexImage2D should read from: an
+    // offset inside the bound PBO, or Pixels if mapping failed.
+    R_BindBuffer(GL_PIXEL_UNPACK_BUFFER, Loader->PixelUnpackBuffer);
+    // Orphan the previous storage, we never wait for an upload still in flight
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, Size, NULL, GL_STREAM_DRAW);
+    void *Mapped = NULL;
+    if(Size > 0)
+    {
+        Mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, Size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    if(Mapped)
+    {
+        memcpy(Mapped, Pixels, Size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        return NULL; // From now on pointers are offsets inside the PBO
+    }
+
+    // Mapping failed, upload straight from system memory
+    R_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return Pixels;
+}
+
+void A_UploadJob(asset_loader *Loader, asset_job *Job)
+{
+    switch(Job->Type)
+    {
+        case AssetJob_Texture:
+        {
+            if(Job->CookedTexture)
+            {
+                cooked_texture *Cooked = Job->CookedTexture;
+                u8 *Source = A_FillPixelUnpackBuffer(Loader, Cooked->Pixels, Cooked->PixelsSize);
+                R_UploadCookedTexture(Job->Texture, Cooked->LevelCount, Source);
+                CK_FreeCookedTexture(Cooked);
+                Job->CookedTexture = NULL;
+                break;
+            }
+
+            u8 *Source = A_FillPixelUnpackBuffer(Loader, Job->Pixels, Job->PixelsSize);
+            R_UploadTexture(Job->Texture, Source);
+            stbi_image_free(Job->Pixels);
+            break;
+        }
+        case AssetJob_Font:
+        {
+            u8 *Source = A_FillPixelUnpackBuffer(Loader, Job->Pixels, Job->PixelsSize);
+            R_UploadFontAtlas(Job->Font, Source);
+            free(Job->Pixels);
+            break;
+        }
+        case AssetJob_Atlas:
+        {
+            atlas *Atlas = Job->Atlas;
+            u32 PageHandles[ATLAS_MAX_PAGES];
+            for(u32 Page = 0; Page < Atlas->PageCount; Page++)
+            {
+                u8 *Source = A_FillPixelUnpackBuffer(Loader, Atlas->Pages[Page], AT_GetPageSize(Atlas));
+                PageHandles[Page] = R_UploadAtlasPage(Atlas->PageWidth, Atlas->PageHeight, Atlas->MaxMipLevel, Source);
+                R_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            // Every texture becomes a rectangle of its page
+            for(u32 i = 0; i < Job->AtlasTextureCount; i++)
+            {
+                atlas_sprite *Sprite = AT_FindSprite(Atlas, Job->AtlasFilenames[i]);
+                if(Sprite)
+                {
+                    texture *Texture = Job->AtlasTextures[i];
+                    Texture->Handle = PageHandles[Sprite->Page];
+                    Texture->Width = Sprite->Width;
+                    Texture->Height = Sprite->Height;
+                    Texture->ChannelCount = 4;
+                    Texture->Format = GL_RGBA;
+                    Texture->InternalFormat = GL_SRGB_ALPHA;
+                    Texture->UVRect = glm::vec4((f32)Sprite->X / (f32)Atlas->PageWidth,
+                                                (f32)Sprite->Y / (f32)Atlas->PageHeight,
+                                                (f32)Sprite->Width / (f32)Atlas->PageWidth,
+                                                (f32)Sprite->Height / (f32)Atlas->PageHeight);
+                    Texture->IsReady = true;
+                }
+            }
+
+            AT_FreeAtlas(Atlas);
+            Job->Atlas = NULL;
+            break;
+        }
+        default:
+        {
+            InvalidCodePath;
+            break;
+        }
+    }
+
+    R_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    Loader->BytesUploadedTotal += Job->PixelsSize;
+    Job->Pixels = NULL;
+    SDL_AtomicSet(&Job->State, AssetJob_Uploaded);
+}
+
+void A_ProcessUploads(asset_loader *Loader)
+{
+    PF_SCOPE("A_ProcessUploads");
+    // NOTE: Call once per frame from the main thread, it owns the GL context.
+    Assert(Loader);
+
+    size_t BytesThisFrame = 0;
+    for(u32 i = 0; i < Loader->JobCount; i++)
+    {
+        asset_job *Job = &Loader->Jobs[i];
+        if(Job->IsFinished)
+        {
+            continue;
+        }
+
+        i32 State = SDL_AtomicGet(&Job->State);
+        if(State == AssetJob_Failed)
+        {
+            Job->IsFinished = true;
+            Loader->FinishedJobCount++;
+        }
+        else if(State == AssetJob_Decoded)
+        {
+            // Always upload at least one job per frame, even if it is bigger than the budget
+            if(BytesThisFrame > 0 && BytesThisFrame + Job->PixelsSize > Loader->UploadBudgetBytes)
+            {
+                break;
+            }
+
+            BytesThisFrame += Job->PixelsSize;
+            A_UploadJob(Loader, Job);
+            Job->IsFinished = true;
+            Loader->FinishedJobCount++;
+        }
+    }
+}
+
+b32 A_IsLoading(asset_loader *Loader)
+{
+    return Loader->FinishedJobCount < Loader->JobCount;
+}
+
+f32 A_GetProgress(asset_loader *Loader)
+{
+    if(Loader->JobCount == 0)
+    {
+        return 1.0f;
+    }
+
+    return (f32)Loader->FinishedJobCount / (f32)Loader->JobCount;
+}
+
+void A_FinishLoading(asset_loader *Loader)
+{
+    // Blocks until every queued asset is uploaded, ignores the upload budget.
+    size_t UploadBudgetBytes = Loader->UploadBudgetBytes;
+    Loader->UploadBudgetBytes = (size_t)-1;
+    while(A_IsLoading(Loader))
+    {
+        A_ProcessUploads(Loader);
+        if(A_IsLoading(Loader))
+        {
+            SDL_Delay(1);
+        }
+    }
+    Loader->UploadBudgetBytes = UploadBudgetBytes;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "shared.h"
+#include "renderer.h"
+#include "atlas.h"
+#include "cooker.h"
+
+/*
+  Asynchronous asset loading
+
+  1- The main thread queues a job and gets a texture/font handle back right away, the handle is not ready yet.
+  2- Worker threads decode images (stb_image) and rasterize glyphs (freetype) into font atlases in system memory.
+  3- The main thread uploads decoded jobs through a pixel buffer object, a few per frame (UploadBudgetBytes).
+  4- Once uploaded the handle IsReady, the renderer skips handles that are not ready.
+*/
+
+#define ASSET_MAX_JOBS 64
+#define ASSET_MAX_WORKERS 4
+
+enum asset_job_type
+{
+    AssetJob_Texture,
+    AssetJob_Font,
+    AssetJob_Atlas, // Many textures packed into atlas pages, see A_BeginAtlas
+};
+
+enum asset_job_state
+{
+    AssetJob_Queued = 0,
+    AssetJob_Decoded,  // Pixels are in system memory, waiting for the main thread to upload them
+    AssetJob_Uploaded,
+    AssetJob_Failed,
+};
+
+struct asset_job
+{
+    asset_job_type Type;
+    SDL_atomic_t State; // asset_job_state, written by the workers and read by the main thread
+
+    char *Filename;
+    texture *Texture;
+    font *Font;
+
+    // Output of the worker thread. NOTE: Allocated with malloc, Malloc's counter is not thread safe.
+    u8 *Pixels;
+    size_t PixelsSize;
+    cooked_texture *CookedTexture; // Texture jobs with a .tex file, every mip level is in there instead of Pixels
+
+    // Atlas jobs, Filename is the offline .atlas file, it is built from AtlasFilenames when missing or out of date
+    char *AtlasFilenames[ATLAS_MAX_SPRITES];
+    texture *AtlasTextures[ATLAS_MAX_SPRITES];
+    u32 AtlasTextureCount;
+    atlas *Atlas;
+
+    b32 IsFinished; // Uploaded or failed, only touched by the main thread
+};
+
+struct asset_loader
+{
+    SDL_Thread *Workers[ASSET_MAX_WORKERS];
+    u32 WorkerCount;
+    SDL_sem *JobSemaphore;
+    SDL_atomic_t NextJobToDecode;
+    SDL_atomic_t IsRunning;
+
+    asset_job Jobs[ASSET_MAX_JOBS];
+    u32 JobCount;
+    u32 FinishedJobCount;
+    asset_job *OpenAtlasJob; // A_LoadTexture adds to this job between A_BeginAtlas and A_EndAtlas
+
+    // Upload
+    u32 PixelUnpackBuffer;
+    size_t UploadBudgetBytes; // How many bytes we upload per frame, at least one job is uploaded every frame
+    size_t BytesUploadedTotal;
+};
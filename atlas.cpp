@@ -0,0 +1,410 @@
+#pragma once
+
+#include "shared.h"
+#include "atlas.h"
+#include "cooker.cpp"
+#include "pack.cpp"
+
+// NOTE: Atlases are built on the asset worker threads, this file uses
+// malloc/free directly since Malloc's counter is not thread safe.
+
+void AT_InitPacker(atlas_packer *Packer, i32 Width, i32 Height)
+{
+    Assert(Packer);
+
+    Packer->Width = Width;
+    Packer->Height = Height;
+    Packer->NodeCount = 1;
+    Packer->Nodes[0].X = 0;
+    Packer->Nodes[0].Y = 0;
+    Packer->Nodes[0].Width = Width;
+}
+
+i32 AT_SkylineFit(atlas_packer *Packer, u32 Index, i32 Width, i32 Height)
+{
+    // Returns the lowest Y where a Width x Height rectangle fits with its
+    // left side on Node[Index], or -1 if it does not fit.
+    i32 X = Packer->Nodes[Index].X;
+    if(X + Width > Packer->Width)
+    {
+        return -1;
+    }
+
+    i32 Y = Packer->Nodes[Index].Y;
+    i32 WidthLeft = Width;
+    for(u32 i = Index; WidthLeft > 0; i++)
+    {
+        if(i >= Packer->NodeCount)
+        {
+            return -1;
+        }
+
+        if(Packer->Nodes[i].Y > Y)
+        {
+            Y = Packer->Nodes[i].Y;
+        }
+        if(Y + Height > Packer->Height)
+        {
+            return -1;
+        }
+        WidthLeft -= Packer->Nodes[i].Width;
+    }
+
+    return Y;
+}
+
+void AT_RemoveSkylineNode(atlas_packer *Packer, u32 Index)
+{
+    for(u32 i = Index; i + 1 < Packer->NodeCount; i++)
+    {
+        Packer->Nodes[i] = Packer->Nodes[i + 1];
+    }
+    Packer->NodeCount--;
+}
+
+b32 AT_PackRectangle(atlas_packer *Packer, i32 Width, i32 Height, i32 *X, i32 *Y)
+{
+    // Skyline bottom-left: place the rectangle where its top is the
+    // lowest, on ties prefer the narrowest node to waste less space.
+    i32 BestTop = INT32_MAX;
+    i32 BestWidth = INT32_MAX;
+    i32 BestIndex = -1;
+    i32 BestY = 0;
+    for(u32 i = 0; i < Packer->NodeCount; i++)
+    {
+        i32 FitY = AT_SkylineFit(Packer, i, Width, Height);
+        if(FitY >= 0)
+        {
+            i32 Top = FitY + Height;
+            if(Top < BestTop || (Top == BestTop && Packer->Nodes[i].Width < BestWidth))
+            {
+                BestTop = Top;
+                BestWidth = Packer->Nodes[i].Width;
+                BestIndex = (i32)i;
+                BestY = FitY;
+            }
+        }
+    }
+
+    if(BestIndex < 0 || Packer->NodeCount == ATLAS_MAX_SKYLINE_NODES)
+    {
+        return false;
+    }
+
+    *X = Packer->Nodes[BestIndex].X;
+    *Y = BestY;
+
+    // Insert the new skyline segment on top of the rectangle
+    for(u32 i = Packer->NodeCount; i > (u32)BestIndex; i--)
+    {
+        Packer->Nodes[i] = Packer->Nodes[i - 1];
+    }
+    Packer->NodeCount++;
+    Packer->Nodes[BestIndex].X = *X;
+    Packer->Nodes[BestIndex].Y = BestTop;
+    Packer->Nodes[BestIndex].Width = Width;
+
+    // Shrink or remove the segments now covered by the new one
+    for(u32 i = (u32)BestIndex + 1; i < Packer->NodeCount;)
+    {
+        atlas_skyline_node *Previous = &Packer->Nodes[i - 1];
+        atlas_skyline_node *Node = &Packer->Nodes[i];
+        i32 Overlap = (Previous->X + Previous->Width) - Node->X;
+        if(Overlap <= 0)
+        {
+            break;
+        }
+
+        Node->X += Overlap;
+        Node->Width -= Overlap;
+        if(Node->Width > 0)
+        {
+            break;
+        }
+        AT_RemoveSkylineNode(Packer, i);
+    }
+
+    // Merge neighbours at the same height
+    for(u32 i = 0; i + 1 < Packer->NodeCount;)
+    {
+        if(Packer->Nodes[i].Y == Packer->Nodes[i + 1].Y)
+        {
+            Packer->Nodes[i].Width += Packer->Nodes[i + 1].Width;
+            AT_RemoveSkylineNode(Packer, i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+void AT_BlitExtruded(atlas *Atlas, u8 *Page, atlas_image *Image, i32 X, i32 Y)
+{
+    // Copies the image to (X, Y) and repeats its border texels into the padding
+    i32 Padding = Atlas->Padding;
+    for(i32 PageY = Y - Padding; PageY < Y + Image->Height + Padding; PageY++)
+    {
+        i32 SourceY = glm::clamp(PageY - Y, 0, Image->Height - 1);
+        for(i32 PageX = X - Padding; PageX < X + Image->Width + Padding; PageX++)
+        {
+            i32 SourceX = glm::clamp(PageX - X, 0, Image->Width - 1);
+            u8 *Source = Image->Pixels + (SourceY * Image->Width + SourceX) * Image->ChannelCount;
+            u8 *Destination = Page + (PageY * Atlas->PageWidth + PageX) * 4;
+            Destination[0] = Source[0];
+            Destination[1] = Source[1];
+            Destination[2] = Source[2];
+            Destination[3] = (Image->ChannelCount == 4) ? Source[3] : 255;
+        }
+    }
+}
+
+void AT_FreeAtlas(atlas *Atlas)
+{
+    if(Atlas)
+    {
+        if(Atlas->IsPacked)
+        {
+            // Pages point inside the asset pack
+        }
+        else if(Atlas->FileMemory)
+        {
+            // Pages point inside the file, see AT_ReadAtlas
+            free(Atlas->FileMemory);
+        }
+        else
+        {
+            for(u32 i = 0; i < Atlas->PageCount; i++)
+            {
+                free(Atlas->Pages[i]);
+            }
+        }
+        free(Atlas);
+    }
+}
+
+size_t AT_GetPageSize(atlas *Atlas)
+{
+    // Every mip level of the page
+    return CK_GetLevelOffset(Atlas->PageWidth, Atlas->PageHeight, 4, (u32)Atlas->MaxMipLevel + 1);
+}
+
+atlas *AT_BuildAtlas(atlas_image *Images, u32 ImageCount, i32 PageSize, i32 Padding)
+{
+    Assert(Images);
+    Assert(ImageCount <= ATLAS_MAX_SPRITES);
+    Assert(Padding >= 1);
+
+    atlas *Result = (atlas*)calloc(1, sizeof(atlas)); Assert(Result);
+    Result->PageWidth = PageSize;
+    Result->PageHeight = PageSize;
+    Result->Padding = Padding;
+
+    // A mip level L texel covers 2^L texels of level 0, with Padding
+    // texels around every sprite the levels up to log2(Padding) never
+    // filter two sprites together.
+    Result->MaxMipLevel = 0;
+    while((2 << Result->MaxMipLevel) <= Padding)
+    {
+        Result->MaxMipLevel++;
+    }
+    i32 Alignment = 1 << Result->MaxMipLevel;
+
+    // Pack the tallest images first, the skyline packer wastes less space that way
+    u32 Order[ATLAS_MAX_SPRITES];
+    for(u32 i = 0; i < ImageCount; i++)
+    {
+        Order[i] = i;
+        for(u32 j = i; j > 0 && Images[Order[j]].Height > Images[Order[j - 1]].Height; j--)
+        {
+            u32 Temp = Order[j];
+            Order[j] = Order[j - 1];
+            Order[j - 1] = Temp;
+        }
+    }
+
+    atlas_packer *Packers = (atlas_packer*)calloc(ATLAS_MAX_PAGES, sizeof(atlas_packer)); Assert(Packers);
+    for(u32 i = 0; i < ImageCount; i++)
+    {
+        atlas_image *Image = &Images[Order[i]];
+
+        // Round the padded size up, so every sprite starts aligned to the last mip level
+        i32 PaddedWidth = (Image->Width + Padding * 2 + Alignment - 1) & ~(Alignment - 1);
+        i32 PaddedHeight = (Image->Height + Padding * 2 + Alignment - 1) & ~(Alignment - 1);
+
+        i32 X = 0, Y = 0;
+        u32 Page = 0;
+        while(Page < Result->PageCount && !AT_PackRectangle(&Packers[Page], PaddedWidth, PaddedHeight, &X, &Y))
+        {
+            Page++;
+        }
+
+        if(Page == Result->PageCount)
+        {
+            // Does not fit in any page, open a new one
+            if(Result->PageCount == ATLAS_MAX_PAGES)
+            {
+                printf("AT_BuildAtlas: Out of pages while packing %s\n", Image->Name);
+                free(Packers);
+                AT_FreeAtlas(Result);
+                return NULL;
+            }
+
+            AT_InitPacker(&Packers[Page], Result->PageWidth, Result->PageHeight);
+            if(!AT_PackRectangle(&Packers[Page], PaddedWidth, PaddedHeight, &X, &Y))
+            {
+                printf("AT_BuildAtlas: %s (%dx%d) is bigger than a page\n", Image->Name, Image->Width, Image->Height);
+                free(Packers);
+                AT_FreeAtlas(Result);
+                return NULL;
+            }
+            Result->Pages[Page] = (u8*)calloc(AT_GetPageSize(Result), 1); Assert(Result->Pages[Page]);
+            Result->PageCount++;
+        }
+
+        atlas_sprite *Sprite = &Result->Sprites[Result->SpriteCount++];
+        SDL_strlcpy(Sprite->Name, Image->Name, ATLAS_NAME_LENGTH);
+        Sprite->Page = (i32)Page;
+        Sprite->X = X + Padding;
+        Sprite->Y = Y + Padding;
+        Sprite->Width = Image->Width;
+        Sprite->Height = Image->Height;
+
+        AT_BlitExtruded(Result, Result->Pages[Page], Image, Sprite->X, Sprite->Y);
+    }
+    free(Packers);
+
+    cooker_tables *Tables = (cooker_tables*)malloc(sizeof(cooker_tables)); Assert(Tables);
+    CK_InitializeTables(Tables);
+    for(u32 Page = 0; Page < Result->PageCount; Page++)
+    {
+        CK_BuildMipChain(Tables, Result->Pages[Page], Result->PageWidth, Result->PageHeight, 4, (u32)Result->MaxMipLevel + 1, false);
+    }
+    free(Tables);
+
+    return Result;
+}
+
+atlas_sprite *AT_FindSprite(atlas *Atlas, char *Name)
+{
+    Assert(Atlas);
+    Assert(Name);
+
+    for(u32 i = 0; i < Atlas->SpriteCount; i++)
+    {
+        if(strncmp(Atlas->Sprites[i].Name, Name, ATLAS_NAME_LENGTH) == 0)
+        {
+            return &Atlas->Sprites[i];
+        }
+    }
+
+    return NULL;
+}
+
+b32 AT_WriteAtlas(atlas *Atlas, char *Filename)
+{
+    Assert(Atlas);
+    Assert(Filename);
+
+    SDL_RWops *RWops = SDL_RWFromFile(Filename, "wb");
+    if(RWops == NULL)
+    {
+        printf("AT_WriteAtlas: Could not open %s\n", Filename);
+        return false;
+    }
+
+    atlas_file_header Header = {};
+    Header.Magic = ATLAS_FILE_MAGIC;
+    Header.Version = ATLAS_FILE_VERSION;
+    Header.PageWidth = Atlas->PageWidth;
+    Header.PageHeight = Atlas->PageHeight;
+    Header.Padding = Atlas->Padding;
+    Header.MaxMipLevel = Atlas->MaxMipLevel;
+    Header.PageCount = Atlas->PageCount;
+    Header.SpriteCount = Atlas->SpriteCount;
+
+    b32 Result = SDL_RWwrite(RWops, &Header, sizeof(Header), 1) == 1;
+    Result = Result && SDL_RWwrite(RWops, Atlas->Sprites, sizeof(atlas_sprite), Atlas->SpriteCount) == Atlas->SpriteCount;
+    for(u32 i = 0; i < Atlas->PageCount; i++)
+    {
+        Result = Result && SDL_RWwrite(RWops, Atlas->Pages[i], AT_GetPageSize(Atlas), 1) == 1;
+    }
+    SDL_RWclose(RWops);
+
+    return Result;
+}
+
+atlas *AT_ReadAtlas(char *Filename)
+{
+    // Reads the whole file with a single read, the pages point inside that memory.
+    // When the atlas is in the asset pack it is used in place, nothing is read.
+    Assert(Filename);
+
+    size_t FileSize = 0;
+    u8 *FileMemory = PK_FindFile(Filename, &FileSize);
+    b32 IsPacked = FileMemory != NULL;
+    if(IsPacked)
+    {
+        if(FileSize < sizeof(atlas_file_header))
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        SDL_RWops *RWops = SDL_RWFromFile(Filename, "rb");
+        if(RWops == NULL)
+        {
+            return NULL;
+        }
+
+        FileSize = (size_t)SDL_RWsize(RWops);
+        FileMemory = (u8*)malloc(FileSize);
+        if(FileMemory == NULL || FileSize < sizeof(atlas_file_header) || SDL_RWread(RWops, FileMemory, FileSize, 1) != 1)
+        {
+            SDL_RWclose(RWops);
+            free(FileMemory);
+            return NULL;
+        }
+        SDL_RWclose(RWops);
+    }
+
+    atlas_file_header *Header = (atlas_file_header*)FileMemory;
+    atlas *Result = (atlas*)calloc(1, sizeof(atlas)); Assert(Result);
+    Result->PageWidth = Header->PageWidth;
+    Result->PageHeight = Header->PageHeight;
+    Result->Padding = Header->Padding;
+    Result->MaxMipLevel = Header->MaxMipLevel;
+    Result->PageCount = Header->PageCount;
+    Result->SpriteCount = Header->SpriteCount;
+    Result->FileMemory = FileMemory;
+    Result->IsPacked = IsPacked;
+
+    // NOTE: Version 1 files have no mip levels, they are rejected and built again at load time
+    b32 IsMipLevelValid = Result->MaxMipLevel >= 0 && Result->MaxMipLevel < COOKED_TEXTURE_MAX_LEVELS;
+    size_t ExpectedSize = sizeof(atlas_file_header) + sizeof(atlas_sprite) * Result->SpriteCount + (IsMipLevelValid ? AT_GetPageSize(Result) : 0) * Result->PageCount;
+    if(Header->Magic != ATLAS_FILE_MAGIC ||
+       Header->Version != ATLAS_FILE_VERSION ||
+       !IsMipLevelValid ||
+       Result->PageCount > ATLAS_MAX_PAGES ||
+       Result->SpriteCount > ATLAS_MAX_SPRITES ||
+       FileSize != ExpectedSize)
+    {
+        printf("AT_ReadAtlas: %s is not a valid atlas file\n", Filename);
+        AT_FreeAtlas(Result);
+        return NULL;
+    }
+
+    u8 *At = FileMemory + sizeof(atlas_file_header);
+    memcpy(Result->Sprites, At, sizeof(atlas_sprite) * Result->SpriteCount);
+    At += sizeof(atlas_sprite) * Result->SpriteCount;
+    for(u32 i = 0; i < Result->PageCount; i++)
+    {
+        Result->Pages[i] = At;
+        At += AT_GetPageSize(Result);
+    }
+
+    return Result;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Texture atlas
+
+  Packs many small images into a few big RGBA pages with a skyline
+  packer. Every sprite is surrounded by Padding texels that repeat its
+  border (extrusion) and starts on a multiple of 2^MaxMipLevel, so the
+  first MaxMipLevel mip levels never mix texels of two sprites. Those
+  levels are built with the texture cooker's sRGB-correct downsample
+  (see cooker.h) and stored after level 0 of every page, the GPU does
+  not generate them.
+
+  The atlas can be built at load time (see A_BeginAtlas in asset.cpp) or
+  offline with tools/atlas_builder.cpp, which writes a .atlas file that
+  is loaded with a single read.
+*/
+
+#define ATLAS_MAX_PAGES 4
+#define ATLAS_MAX_SPRITES 64
+#define ATLAS_MAX_SKYLINE_NODES 256
+#define ATLAS_NAME_LENGTH 64
+#define ATLAS_FILE_MAGIC 0x534c5441 // "ATLS"
+#define ATLAS_FILE_VERSION 2 // 2: Pages store mip levels 0-MaxMipLevel
+#define ATLAS_DEFAULT_PAGE_SIZE 2048
+#define ATLAS_DEFAULT_PADDING 8 // Texels around every sprite, allows mip levels 0-3
+
+struct atlas_image
+{
+    char *Name;
+    u8 *Pixels;
+    i32 Width;
+    i32 Height;
+    i32 ChannelCount; // 3 or 4, pages are always RGBA
+};
+
+struct atlas_sprite
+{
+    char Name[ATLAS_NAME_LENGTH];
+    i32 Page;
+
+    // Rectangle in texels, without the padding
+    i32 X;
+    i32 Y;
+    i32 Width;
+    i32 Height;
+};
+
+struct atlas_skyline_node
+{
+    i32 X;
+    i32 Y;
+    i32 Width;
+};
+
+struct atlas_packer
+{
+    i32 Width;
+    i32 Height;
+    atlas_skyline_node Nodes[ATLAS_MAX_SKYLINE_NODES];
+    u32 NodeCount;
+};
+
+struct atlas
+{
+    i32 PageWidth;
+    i32 PageHeight;
+    i32 Padding;
+    i32 MaxMipLevel;
+
+    u32 PageCount;
+    u8 *Pages[ATLAS_MAX_PAGES]; // RGBA8 mip levels 0-MaxMipLevel, AT_GetPageSize bytes each
+    u8 *FileMemory; // Set when read from a .atlas file, the pages point inside it
+    b32 IsPacked; // FileMemory is inside the asset pack, it is not freed
+
+    u32 SpriteCount;
+    atlas_sprite Sprites[ATLAS_MAX_SPRITES];
+};
+
+// On disk layout: atlas_file_header, atlas_sprite[SpriteCount], Pages[PageCount]
+struct atlas_file_header
+{
+    u32 Magic;
+    u32 Version;
+    i32 PageWidth;
+    i32 PageHeight;
+    i32 Padding;
+    i32 MaxMipLevel;
+    u32 PageCount;
+    u32 SpriteCount;
+};
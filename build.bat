@@ -21,4 +21,9 @@ set LinkerFlags=-nologo -DEBUG %LibDirectories%
 
 cl ..\main.cpp %CompilerFlags% /link %LinkerFlags% -SUBSYSTEM:CONSOLE SDL2.lib SDL2main.lib SDL2_mixer.lib freetype.lib
 
+REM Offline tools
+cl ..\tools\atlas_builder.cpp %CompilerFlags% /link %LinkerFlags% -SUBSYSTEM:CONSOLE SDL2.lib SDL2main.lib
+cl ..\tools\texture_cooker.cpp %CompilerFlags% /link %LinkerFlags% -SUBSYSTEM:CONSOLE SDL2.lib SDL2main.lib
+cl ..\tools\asset_packer.cpp %CompilerFlags% /link %LinkerFlags% -SUBSYSTEM:CONSOLE SDL2.lib SDL2main.lib setargv.obj
+
 popd
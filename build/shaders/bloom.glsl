@@ -20,12 +20,73 @@ uniform sampler2D Scene;
 uniform sampler2D BloomBlur;
 uniform bool Bloom;
 uniform float Exposure;
+uniform bool FXAA;
+uniform vec2 SceneScale; // Part of Scene drawn this frame, see dynamic resolution
+uniform vec2 BloomScale; // Part of BloomBlur drawn this frame
+
+vec3 SampleScene(vec2 UV)
+{
+    // Never read outside the part of Scene drawn this frame
+    vec2 HalfTexel = 0.5 / textureSize(Scene, 0);
+    return texture(Scene, min(UV, SceneScale - HalfTexel)).rgb;
+}
+
+// FXAA works on the perceived luminance of the tonemapped color
+float Luma(vec3 HDRColor)
+{
+    vec3 Color = vec3(1.0) - exp(-HDRColor * Exposure);
+    return dot(Color, vec3(0.299, 0.587, 0.114));
+}
+
+// FXAA fused into the composite, the edge direction comes from the luma
+// of the 4 diagonal neighbours, the blur is done along that direction
+vec3 SampleSceneFXAA(vec2 UV)
+{
+    const float ReduceMin = 1.0 / 128.0;
+    const float ReduceMul = 1.0 / 8.0;
+    const float SpanMax = 8.0;
+
+    vec2 Texel = 1.0 / textureSize(Scene, 0);
+    vec3 ColorM = SampleScene(UV);
+    float LumaNW = Luma(SampleScene(UV + vec2(-Texel.x,  Texel.y)));
+    float LumaNE = Luma(SampleScene(UV + vec2( Texel.x,  Texel.y)));
+    float LumaSW = Luma(SampleScene(UV + vec2(-Texel.x, -Texel.y)));
+    float LumaSE = Luma(SampleScene(UV + vec2( Texel.x, -Texel.y)));
+    float LumaM = Luma(ColorM);
+
+    float LumaMin = min(LumaM, min(min(LumaNW, LumaNE), min(LumaSW, LumaSE)));
+    float LumaMax = max(LumaM, max(max(LumaNW, LumaNE), max(LumaSW, LumaSE)));
+    if(LumaMax - LumaMin < max(0.0312, LumaMax * 0.125))
+    {
+        return ColorM; // Not an edge, most pixels stop here
+    }
+
+    vec2 Direction = vec2(-((LumaNW + LumaNE) - (LumaSW + LumaSE)),
+                           ((LumaNW + LumaSW) - (LumaNE + LumaSE)));
+    float DirectionReduce = max((LumaNW + LumaNE + LumaSW + LumaSE) * (0.25 * ReduceMul), ReduceMin);
+    float InverseDirectionMin = 1.0 / (min(abs(Direction.x), abs(Direction.y)) + DirectionReduce);
+    Direction = clamp(Direction * InverseDirectionMin, vec2(-SpanMax), vec2(SpanMax)) * Texel;
+
+    vec3 ColorA = 0.5 * (SampleScene(UV + Direction * (1.0 / 3.0 - 0.5)) +
+                         SampleScene(UV + Direction * (2.0 / 3.0 - 0.5)));
+    vec3 ColorB = ColorA * 0.5 + 0.25 * (SampleScene(UV - Direction * 0.5) +
+                                         SampleScene(UV + Direction * 0.5));
+    float LumaB = Luma(ColorB);
+    if(LumaB < LumaMin || LumaB > LumaMax)
+    {
+        return ColorA; // The wide blur crossed another edge
+    }
+    return ColorB;
+}
 
 void main()
 {
     const float Gamma = 2.2;
-    vec3 HDRColor = texture(Scene, TexCoords).rgb;
-    vec3 BloomColor = texture(BloomBlur, TexCoords).rgb;
+    // The scene is upscaled to the window with bilinear filtering
+    vec2 SceneUV = TexCoords * SceneScale;
+    vec3 HDRColor = FXAA ? SampleSceneFXAA(SceneUV) : SampleScene(SceneUV);
+    vec2 BloomHalfTexel = 0.5 / textureSize(BloomBlur, 0);
+    vec3 BloomColor = texture(BloomBlur, min(TexCoords * BloomScale, BloomScale - BloomHalfTexel)).rgb;
 
     if(Bloom)
     {
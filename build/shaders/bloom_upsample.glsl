@@ -0,0 +1,45 @@
+#ifdef VERTEX_SHADER
+
+layout (location = 0) in vec3 Position;
+layout (location = 1) in vec2 UV;
+
+out vec2 TexCoords;
+
+void main()
+{
+    TexCoords = UV;
+    gl_Position = vec4(Position, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT_SHADER
+out vec4 FragmentColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D Image; // One mip level below the target, half its size
+uniform vec2 SourceScale; // Part of Image drawn this frame, see dynamic resolution
+
+vec3 Sample(vec2 UV, vec2 HalfTexel)
+{
+    // Never read outside the part of Image drawn this frame
+    return texture(Image, min(UV, SourceScale - HalfTexel)).rgb;
+}
+
+// Dual filter upsample, 8 bilinear taps in a diamond around the
+// fragment, the diagonal taps weigh twice as much as the axis ones.
+void main()
+{
+    vec2 HalfTexel = 0.5 / textureSize(Image, 0);
+    vec2 UV = TexCoords * SourceScale;
+    vec3 Result = Sample(UV + vec2(-HalfTexel.x * 2.0, 0.0), HalfTexel);
+    Result += Sample(UV + vec2(HalfTexel.x * 2.0, 0.0), HalfTexel);
+    Result += Sample(UV + vec2(0.0, -HalfTexel.y * 2.0), HalfTexel);
+    Result += Sample(UV + vec2(0.0, HalfTexel.y * 2.0), HalfTexel);
+    Result += Sample(UV + vec2(-HalfTexel.x, HalfTexel.y), HalfTexel) * 2.0;
+    Result += Sample(UV + vec2(HalfTexel.x, HalfTexel.y), HalfTexel) * 2.0;
+    Result += Sample(UV + vec2(HalfTexel.x, -HalfTexel.y), HalfTexel) * 2.0;
+    Result += Sample(UV + vec2(-HalfTexel.x, -HalfTexel.y), HalfTexel) * 2.0;
+    FragmentColor = vec4(Result * (1.0 / 12.0), 1.0);
+}
+#endif
@@ -0,0 +1,54 @@
+#ifdef VERTEX_SHADER
+
+layout (location = 0) in vec3 Vertices;
+layout (location = 1) in vec2 TexCoords;
+
+// Per instance attributes, read straight from the particle_pool arrays, see R_DrawParticles
+layout (location = 3) in float InstancePositionX;
+layout (location = 4) in float InstancePositionY;
+layout (location = 5) in float InstanceSize;
+layout (location = 6) in vec4 InstanceColor; // RGBA8, normalized
+
+layout (std140) uniform CameraMatrices
+{
+    mat4 Projection;
+    mat4 Orthographic;
+    mat4 View;
+};
+
+uniform vec4 UVRect; // xy = Offset, zw = Scale inside the (atlas) texture
+uniform float Intensity; // HDR multiplier of the colors
+
+out vec2 TextureCoordinates;
+out vec4 Color;
+
+void main()
+{
+    TextureCoordinates = UVRect.xy + TexCoords * UVRect.zw;
+
+    // Premultiplied, particles are blended with glBlendFunc(GL_ONE, GL_ONE)
+    Color = vec4(InstanceColor.rgb * InstanceColor.a * Intensity, InstanceColor.a);
+    gl_Position = Projection * View * vec4(Vertices.xy * InstanceSize + vec2(InstancePositionX, InstancePositionY), 0.0, 1.0);
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+layout (location = 0) out vec4 FragmentColor;
+layout (location = 1) out vec4 BrightnessColor;
+
+in vec2 TextureCoordinates;
+in vec4 Color;
+uniform sampler2D Image;
+
+void main()
+{
+    vec4 Texel = texture(Image, TextureCoordinates);
+    FragmentColor = vec4(Texel.rgb * Texel.a, Texel.a) * Color;
+
+    // Every particle feeds the bloom, the additive blend adds them up in
+    // the brightness buffer too
+    BrightnessColor = FragmentColor;
+}
+#endif
@@ -0,0 +1,71 @@
+#ifdef VERTEX_SHADER
+
+layout (location = 0) in vec3 Vertices;
+layout (location = 1) in vec2 TexCoords;
+
+// Per instance attributes, see sprite_instance in renderer.h
+layout (location = 3) in vec4 InstancePositionAngle; // xyz = Position, w = Rotation angle in degrees
+layout (location = 4) in vec4 InstanceSizeThreshold; // xy = Size, z = BrightnessThreshold
+layout (location = 5) in vec4 InstanceTint;
+layout (location = 6) in vec4 InstanceUVRect; // xy = Offset, zw = Scale inside the (atlas) texture
+
+//  Variables in a uniform block can be directly accessed without the
+//  block name as a prefix.
+layout (std140) uniform CameraMatrices
+{
+    mat4 Projection;
+    mat4 Orthographic;
+    mat4 View;
+};
+
+out vec2 TextureCoordinates;
+out vec4 Tint;
+out float BrightnessThreshold;
+
+void main()
+{
+    // Same as Translate * Rotate(Z) * Scale, without building a matrix per sprite on the CPU
+    float Angle = radians(InstancePositionAngle.w);
+    float C = cos(Angle);
+    float S = sin(Angle);
+    vec2 Scaled = Vertices.xy * InstanceSizeThreshold.xy;
+    vec2 Rotated = vec2(Scaled.x * C - Scaled.y * S, Scaled.x * S + Scaled.y * C);
+
+    TextureCoordinates = InstanceUVRect.xy + TexCoords * InstanceUVRect.zw;
+    Tint = InstanceTint;
+    BrightnessThreshold = InstanceSizeThreshold.z;
+    gl_Position = Projection * View * vec4(Rotated + InstancePositionAngle.xy, InstancePositionAngle.z, 1.0);
+}
+
+#endif
+
+#ifdef FRAGMENT_SHADER
+
+layout (location = 0) out vec4 FragmentColor;
+layout (location = 1) out vec4 BrightnessColor;
+
+in vec2 TextureCoordinates;
+in vec4 Tint;
+in float BrightnessThreshold;
+uniform sampler2D Image;
+
+// IMPORTANT: The shaders _needs_ to write to Brightness color in
+// order to show anything on the screen. Wasted a lot of time on this.
+
+void main()
+{
+    FragmentColor = texture(Image, TextureCoordinates) * Tint;
+
+    // check whether fragment output is higher than threshold, if so output as brightness color
+    float Brightness = dot(FragmentColor.rgb, vec3(0.2126, 0.7152, 0.0722));
+
+    if(Brightness > BrightnessThreshold)
+    {
+        BrightnessColor = vec4(FragmentColor.rgb, 1.0);
+    }
+    else
+    {
+        BrightnessColor = vec4(0.0, 0.0, 0.0, 1.0);
+    }
+}
+#endif
@@ -1,7 +1,8 @@
 #ifdef VERTEX_SHADER
 
-layout(location = 0) in vec3 Vertices;
+layout(location = 0) in vec2 Position;
 layout(location = 1) in vec2 TexCoords;
+layout(location = 2) in vec3 Color;
 
 //  Variables in a uniform block can be directly accessed without the
 //  block name as a prefix.
@@ -11,14 +12,16 @@ layout (std140) uniform CameraMatrices
     mat4 CameraOrthographic;
     mat4 CameraView;
 };
-uniform mat4 Model;
 
 out vec2 UV;
+out vec3 TextColor;
 
 void main()
 {
-    gl_Position = CameraOrthographic * Model * vec4(Vertices, 1.0);
+    // Glyph quads are already laid out in screen space, see R_PushText
+    gl_Position = CameraOrthographic * vec4(Position, 0.0, 1.0);
     UV = TexCoords;
+    TextColor = Color;
 }
 
 #endif
@@ -29,8 +32,9 @@ layout (location = 0) out vec4 FragmentColor;
 layout (location = 1) out vec4 BrightnessColor;
 
 in vec2 UV;
+in vec3 TextColor;
 uniform sampler2D Text;
-uniform vec3 TextColor;
+uniform bool DistanceField; // The atlas stores distances to the outline (0.5) instead of coverage
 uniform float BrightnessThreshold;
 
 // IMPORTANT: The shaders _needs_ to write to Brightness color in
@@ -38,7 +42,14 @@ uniform float BrightnessThreshold;
 
 void main()
 {
-    vec4 Sampled = vec4(1.0, 1.0, 1.0, texture(Text, UV).r);
+    float Alpha = texture(Text, UV).r;
+    if(DistanceField)
+    {
+        // Antialias over about one screen pixel, whatever the scale
+        float Smoothing = fwidth(Alpha);
+        Alpha = smoothstep(0.5 - Smoothing, 0.5 + Smoothing, Alpha);
+    }
+    vec4 Sampled = vec4(1.0, 1.0, 1.0, Alpha);
     FragmentColor = vec4(TextColor, 1.0) * Sampled;
 
     float Brightness = dot(FragmentColor.rgb, vec3(0.2126, 0.7152, 0.0722));
@@ -0,0 +1,369 @@
+#pragma once
+
+#include "shared.h"
+#include "capture.h"
+#include "renderer.h"
+#include "profiler.h"
+#include "image.cpp"
+
+global char *CaptureFormatNames__[CaptureFormat_Count] = { "y4m", "png" };
+
+b32 CP_SetFormat(capture_system *Capture, char *Name)
+{
+    for(u32 i = 0; i < CaptureFormat_Count; i++)
+    {
+        if(strcmp(Name, CaptureFormatNames__[i]) == 0)
+        {
+            Capture->Format = (capture_format)i;
+            return true;
+        }
+    }
+
+    printf("Unknown capture format %s, use y4m or png\n", Name);
+    return false;
+}
+
+u8 CP_ClampU8(i32 Value)
+{
+    return (u8)(Value < 0 ? 0 : Value > 255 ? 255 : Value);
+}
+
+b32 CP_WriteY4MFrame(capture_system *Capture, capture_frame *Frame)
+{
+    // BT.601 studio range, every chroma sample is the average of 2x2 pixels
+    u32 Width = Frame->Width;
+    u32 Height = Frame->Height;
+    u32 ChromaWidth = (Width + 1) / 2;
+    u32 ChromaHeight = (Height + 1) / 2;
+    size_t LumaSize = (size_t)Width * (size_t)Height;
+    size_t ChromaSize = (size_t)ChromaWidth * (size_t)ChromaHeight;
+    size_t Size = LumaSize + ChromaSize * 2;
+    if(Size > Capture->YUVSize)
+    {
+        free(Capture->YUV);
+        Capture->YUV = (u8*)malloc(Size);
+        Capture->YUVSize = Capture->YUV ? Size : 0;
+        if(Capture->YUV == NULL)
+        {
+            return false;
+        }
+    }
+
+    u8 *Y = Capture->YUV;
+    u8 *U = Y + LumaSize;
+    u8 *V = U + ChromaSize;
+    for(u32 Row = 0; Row < Height; Row++)
+    {
+        u8 *Pixel = Frame->Pixels + (size_t)Row * Width * 4;
+        u8 *Luma = Y + (size_t)Row * Width;
+        for(u32 Column = 0; Column < Width; Column++, Pixel += 4)
+        {
+            Luma[Column] = (u8)(((66 * Pixel[0] + 129 * Pixel[1] + 25 * Pixel[2] + 128) >> 8) + 16);
+        }
+    }
+    for(u32 Row = 0; Row < ChromaHeight; Row++)
+    {
+        // The last row and column repeat when the size is odd
+        u8 *Top = Frame->Pixels + (size_t)(Row * 2) * Width * 4;
+        u8 *Bottom = Frame->Pixels + (size_t)SDL_min(Row * 2 + 1, Height - 1) * Width * 4;
+        for(u32 Column = 0; Column < ChromaWidth; Column++)
+        {
+            size_t Left = (size_t)(Column * 2) * 4;
+            size_t Right = (size_t)SDL_min(Column * 2 + 1, Width - 1) * 4;
+            i32 R = (Top[Left + 0] + Top[Right + 0] + Bottom[Left + 0] + Bottom[Right + 0] + 2) / 4;
+            i32 G = (Top[Left + 1] + Top[Right + 1] + Bottom[Left + 1] + Bottom[Right + 1] + 2) / 4;
+            i32 B = (Top[Left + 2] + Top[Right + 2] + Bottom[Left + 2] + Bottom[Right + 2] + 2) / 4;
+            U[(size_t)Row * ChromaWidth + Column] = CP_ClampU8(((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128);
+            V[(size_t)Row * ChromaWidth + Column] = CP_ClampU8(((112 * R - 94 * G - 18 * B + 128) >> 8) + 128);
+        }
+    }
+
+    char FrameHeader[] = "FRAME\n";
+    return SDL_RWwrite(Capture->Video, FrameHeader, sizeof(FrameHeader) - 1, 1) == 1 &&
+           SDL_RWwrite(Capture->Video, Capture->YUV, Size, 1) == 1;
+}
+
+void CP_WriteFrame(capture_system *Capture, capture_frame *Frame)
+{
+    switch(Frame->Type)
+    {
+        case CaptureFrame_PNG:
+        {
+            if(IM_WritePNG(Frame->Filename, Frame->Pixels, (i32)Frame->Width, (i32)Frame->Height))
+            {
+                SDL_AtomicIncRef(&Capture->WrittenFrames);
+            }
+            else
+            {
+                printf("Could not write %s\n", Frame->Filename);
+            }
+        } break;
+
+        case CaptureFrame_Y4M:
+        {
+            if(Frame->Filename[0])
+            {
+                Capture->Video = SDL_RWFromFile(Frame->Filename, "wb");
+                if(Capture->Video == NULL)
+                {
+                    printf("Could not create %s\n", Frame->Filename);
+                    break;
+                }
+
+                // C420jpeg is 4:2:0 with the chroma centered between the 2x2 pixels it averages
+                char Header[128];
+                i32 Length = snprintf(Header, sizeof(Header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+                                      Frame->Width, Frame->Height, Capture->FrameRate);
+                SDL_RWwrite(Capture->Video, Header, (size_t)Length, 1);
+            }
+
+            if(Capture->Video)
+            {
+                if(CP_WriteY4MFrame(Capture, Frame))
+                {
+                    SDL_AtomicIncRef(&Capture->WrittenFrames);
+                }
+            }
+        } break;
+
+        case CaptureFrame_EndY4M:
+        {
+            if(Capture->Video)
+            {
+                SDL_RWclose(Capture->Video);
+                Capture->Video = NULL;
+            }
+        } break;
+    }
+}
+
+i32 SDLCALL CP_WriterThread(void *Data)
+{
+    // NOTE: Only malloc/free here, Malloc's counter is not thread safe
+    capture_system *Capture = (capture_system*)Data;
+    PF_SetThreadName("CaptureWriter");
+
+    for(;;)
+    {
+        SDL_SemWait(Capture->QueuedSemaphore);
+        if(!SDL_AtomicGet(&Capture->IsRunning) && SDL_AtomicGet(&Capture->QueuedCount) == 0)
+        {
+            break;
+        }
+
+        capture_frame *Frame = &Capture->Frames[Capture->ReadIndex];
+        u64 Begin = SDL_GetPerformanceCounter();
+        {
+            PF_SCOPE("CP_WriteFrame");
+            CP_WriteFrame(Capture, Frame);
+        }
+        f64 Seconds = P_GetSecondsElapsed(Begin, SDL_GetPerformanceCounter());
+        SDL_AtomicSet(&Capture->WriteMicroseconds, (i32)(Seconds * 1000000.0));
+
+        // The slot belongs to the main thread again
+        Capture->ReadIndex = (Capture->ReadIndex + 1) % CAPTURE_QUEUE_FRAMES;
+        SDL_AtomicAdd(&Capture->QueuedCount, -1);
+    }
+
+    if(Capture->Video)
+    {
+        SDL_RWclose(Capture->Video);
+    }
+    free(Capture->YUV);
+    return 0;
+}
+
+capture_frame *CP_BeginFrame(capture_system *Capture, capture_frame_type Type, u32 Width, u32 Height)
+{
+    // Next free slot of the queue, NULL when the writer is behind
+    if(SDL_AtomicGet(&Capture->QueuedCount) == CAPTURE_QUEUE_FRAMES)
+    {
+        return NULL;
+    }
+
+    capture_frame *Frame = &Capture->Frames[Capture->WriteIndex];
+    size_t Size = (size_t)Width * (size_t)Height * 4;
+    if(Size > Frame->PixelsSize)
+    {
+        if(Frame->Pixels)
+        {
+            Free(Frame->Pixels);
+        }
+        Frame->Pixels = (u8*)Malloc(Size);
+        Frame->PixelsSize = Size;
+    }
+    Frame->Type = Type;
+    Frame->Filename[0] = 0;
+    Frame->Width = Width;
+    Frame->Height = Height;
+
+    return Frame;
+}
+
+void CP_QueueFrame(capture_system *Capture)
+{
+    Capture->WriteIndex = (Capture->WriteIndex + 1) % CAPTURE_QUEUE_FRAMES;
+    SDL_AtomicIncRef(&Capture->QueuedCount);
+    SDL_SemPost(Capture->QueuedSemaphore);
+}
+
+void CP_CopyPixels(capture_frame *Frame, u8 *Pixels)
+{
+    // The readback starts at the bottom row
+    size_t RowSize = (size_t)Frame->Width * 4;
+    for(u32 Row = 0; Row < Frame->Height; Row++)
+    {
+        memcpy(Frame->Pixels + RowSize * Row, Pixels + RowSize * (Frame->Height - 1 - Row), RowSize);
+    }
+}
+
+b32 CP_EndVideo(capture_system *Capture)
+{
+    if(Capture->Format == CaptureFormat_PNG)
+    {
+        return true;
+    }
+
+    capture_frame *Frame = CP_BeginFrame(Capture, CaptureFrame_EndY4M, 0, 0);
+    if(Frame == NULL)
+    {
+        return false;
+    }
+    CP_QueueFrame(Capture);
+    return true;
+}
+
+void CP_TakeScreenshot(capture_system *Capture, renderer *Renderer)
+{
+    // The frame being built is the one saved
+    Capture->ScreenshotRequested = true;
+    R_EnableReadback(Renderer, true);
+}
+
+void CP_ToggleRecording(capture_system *Capture, renderer *Renderer)
+{
+    if(Capture->IsRecording)
+    {
+        // NOTE: The last frames still in the readback ring are not part of the video
+        Capture->IsRecording = false;
+        Capture->IsEndPending = !CP_EndVideo(Capture);
+        printf("Recorded %u frames, %u dropped\n", Capture->VideoFrame, Capture->DroppedFrames);
+        return;
+    }
+
+    if(Capture->IsEndPending)
+    {
+        return;
+    }
+
+    Capture->IsRecording = true;
+    Capture->VideoCount++;
+    Capture->VideoFrame = 0;
+    Capture->DroppedFrames = 0;
+    SDL_AtomicSet(&Capture->WrittenFrames, 0);
+    R_EnableReadback(Renderer, true);
+}
+
+void CP_UpdateCapture(capture_system *Capture, renderer *Renderer)
+{
+    // Called after R_EndFrame, hands the frames the GPU is done with to the writer
+    PF_SCOPE("CP_UpdateCapture");
+    if(Capture->IsEndPending)
+    {
+        Capture->IsEndPending = !CP_EndVideo(Capture);
+    }
+
+    u32 Width;
+    u32 Height;
+    u8 *Pixels;
+    while((Pixels = R_MapReadback(Renderer, &Width, &Height)) != NULL)
+    {
+        if(Capture->ScreenshotRequested)
+        {
+            capture_frame *Frame = CP_BeginFrame(Capture, CaptureFrame_PNG, Width, Height);
+            if(Frame)
+            {
+                snprintf(Frame->Filename, sizeof(Frame->Filename), "screenshot_%04u.png", ++Capture->ScreenshotCount);
+                CP_CopyPixels(Frame, Pixels);
+                CP_QueueFrame(Capture);
+                printf("Saving %s\n", Frame->Filename);
+                Capture->ScreenshotRequested = false;
+            }
+        }
+
+        if(Capture->IsRecording)
+        {
+            if(Capture->VideoFrame == 0)
+            {
+                Capture->VideoWidth = Width;
+                Capture->VideoHeight = Height;
+            }
+
+            capture_frame *Frame = NULL;
+            if(Width == Capture->VideoWidth && Height == Capture->VideoHeight)
+            {
+                Frame = CP_BeginFrame(Capture, Capture->Format == CaptureFormat_PNG ? CaptureFrame_PNG : CaptureFrame_Y4M, Width, Height);
+            }
+
+            if(Frame)
+            {
+                if(Capture->Format == CaptureFormat_PNG)
+                {
+                    snprintf(Frame->Filename, sizeof(Frame->Filename), "capture_%02u_%06u.png", Capture->VideoCount, Capture->VideoFrame);
+                }
+                else if(Capture->VideoFrame == 0)
+                {
+                    snprintf(Frame->Filename, sizeof(Frame->Filename), "capture_%02u.y4m", Capture->VideoCount);
+                    printf("Recording %s, %ux%u at %u fps\n", Frame->Filename, Width, Height, Capture->FrameRate);
+                }
+                CP_CopyPixels(Frame, Pixels);
+                CP_QueueFrame(Capture);
+                Capture->VideoFrame++;
+            }
+            else
+            {
+                Capture->DroppedFrames++;
+            }
+        }
+
+        R_UnmapReadback(Renderer);
+    }
+
+    // No reads while there is nothing to save
+    if(!Capture->ScreenshotRequested && !Capture->IsRecording)
+    {
+        R_EnableReadback(Renderer, false);
+    }
+}
+
+capture_system *CP_CreateCaptureSystem(u32 FrameRate)
+{
+    PF_SCOPE("CP_CreateCaptureSystem");
+    capture_system *Result = (capture_system*)Malloc(sizeof(capture_system)); Assert(Result);
+    Result->FrameRate = FrameRate ? FrameRate : CAPTURE_DEFAULT_FRAME_RATE;
+    Result->QueuedSemaphore = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&Result->IsRunning, 1);
+    Result->Writer = SDL_CreateThread(CP_WriterThread, "CaptureWriter", Result);
+    Assert(Result->Writer);
+
+    return Result;
+}
+
+void CP_DestroyCaptureSystem(capture_system *Capture)
+{
+    // Waits for the queued frames to be written, the writer closes an open video
+    Assert(Capture);
+    SDL_AtomicSet(&Capture->IsRunning, 0);
+    SDL_SemPost(Capture->QueuedSemaphore);
+    SDL_WaitThread(Capture->Writer, NULL);
+
+    SDL_DestroySemaphore(Capture->QueuedSemaphore);
+    for(u32 i = 0; i < CAPTURE_QUEUE_FRAMES; i++)
+    {
+        if(Capture->Frames[i].Pixels)
+        {
+            Free(Capture->Frames[i].Pixels);
+        }
+    }
+    Free(Capture);
+}
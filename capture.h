@@ -0,0 +1,85 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Capture
+
+  Screenshots (F7) and video (F8 starts and stops the recording) of the
+  composited frame, without stalling the game loop:
+
+  1- R_EndFrame queues an asynchronous copy of the frame into a pixel
+     buffer object (see frame_readback in renderer.h).
+  2- CP_UpdateCapture, after R_EndFrame, maps the frames the GPU is done
+     with, normally a frame or two old, and copies them top row first
+     into a free slot of the queue. When the writer is behind and every
+     slot is full the frame is dropped, the game never waits for the disk.
+  3- The writer thread encodes and writes the queued frames in order.
+
+  Screenshots are screenshot_NNNN.png. Videos are capture_NN.y4m, raw
+  YUV 4:2:0 (BT.601, studio range) at the display refresh rate, one video
+  frame per rendered frame, that ffmpeg or any player reads as is. With
+  --capture-format png a video is written as the image sequence
+  capture_NN_NNNNNN.png instead. Frames of another size than the first
+  one (the window was resized) are not written.
+*/
+
+#define CAPTURE_QUEUE_FRAMES 8 // Frames copied out of the GPU waiting for the writer
+#define CAPTURE_DEFAULT_FRAME_RATE 60 // When the display does not report its refresh rate
+
+enum capture_format
+{
+    CaptureFormat_Y4M,
+    CaptureFormat_PNG, // One PNG per frame
+
+    CaptureFormat_Count,
+};
+
+enum capture_frame_type
+{
+    CaptureFrame_PNG, // Screenshot or image of a sequence
+    CaptureFrame_Y4M, // Appended to the open video
+    CaptureFrame_EndY4M, // No pixels, closes the video
+};
+
+struct capture_frame
+{
+    capture_frame_type Type;
+    char Filename[64]; // Of the PNG, of the video on its first frame, empty otherwise
+    u8 *Pixels; // RGBA8, rows top to bottom
+    size_t PixelsSize; // Allocated, grows with the frames
+    u32 Width;
+    u32 Height;
+};
+
+struct capture_system
+{
+    // Ring of frames, written by the main thread and read by the writer
+    capture_frame Frames[CAPTURE_QUEUE_FRAMES];
+    u32 WriteIndex; // Main thread
+    u32 ReadIndex; // Writer thread
+    SDL_atomic_t QueuedCount;
+    SDL_sem *QueuedSemaphore;
+    SDL_atomic_t IsRunning;
+    SDL_Thread *Writer;
+
+    // Main thread
+    b32 ScreenshotRequested;
+    b32 IsRecording;
+    capture_format Format;
+    u32 FrameRate;
+    u32 ScreenshotCount;
+    u32 VideoCount;
+    u32 VideoFrame; // Frames of the current video sent to the writer
+    u32 VideoWidth; // Of the first frame
+    u32 VideoHeight;
+    u32 DroppedFrames; // The queue was full or the size changed, current video
+    b32 IsEndPending; // The queue was full when the recording stopped
+
+    // Writer thread
+    SDL_RWops *Video; // Open Y4M file
+    u8 *YUV; // One Y4M frame
+    size_t YUVSize;
+    SDL_atomic_t WrittenFrames; // Current video
+    SDL_atomic_t WriteMicroseconds; // Spent encoding and writing the last frame
+};
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <math.h>
+
+#include "shared.h"
+#include "cooker.h"
+#include "pack.cpp"
+
+// NOTE: Textures are cooked on the asset worker threads, this file uses
+// malloc/free directly since Malloc's counter is not thread safe.
+
+void CK_InitializeTables(cooker_tables *Tables)
+{
+    Assert(Tables);
+
+    for(u32 i = 0; i < 256; i++)
+    {
+        f32 Value = (f32)i / 255.0f;
+        Tables->ToLinear[i] = Value <= 0.04045f ? Value / 12.92f : powf((Value + 0.055f) / 1.055f, 2.4f);
+    }
+    for(u32 i = 0; i < COOKER_SRGB_TABLE_SIZE; i++)
+    {
+        f32 Value = (f32)i / (f32)(COOKER_SRGB_TABLE_SIZE - 1);
+        f32 Encoded = Value <= 0.0031308f ? Value * 12.92f : 1.055f * powf(Value, 1.0f / 2.4f) - 0.055f;
+        Tables->ToSRGB[i] = (u8)(Encoded * 255.0f + 0.5f);
+    }
+}
+
+u8 CK_ToSRGB(cooker_tables *Tables, f32 Linear)
+{
+    Linear = Linear < 0.0f ? 0.0f : (Linear > 1.0f ? 1.0f : Linear);
+    return Tables->ToSRGB[(u32)(Linear * (f32)(COOKER_SRGB_TABLE_SIZE - 1) + 0.5f)];
+}
+
+u32 CK_GetLevelCount(i32 Width, i32 Height)
+{
+    // Full chain, down to 1x1
+    u32 Result = 1;
+    while((Width > 1 || Height > 1) && Result < COOKED_TEXTURE_MAX_LEVELS)
+    {
+        Width = SDL_max(Width / 2, 1);
+        Height = SDL_max(Height / 2, 1);
+        Result++;
+    }
+
+    return Result;
+}
+
+size_t CK_GetLevelSize(i32 Width, i32 Height, i32 ChannelCount, u32 Level)
+{
+    i32 LevelWidth = SDL_max(Width >> Level, 1);
+    i32 LevelHeight = SDL_max(Height >> Level, 1);
+    return (size_t)LevelWidth * (size_t)LevelHeight * (size_t)ChannelCount;
+}
+
+size_t CK_GetLevelOffset(i32 Width, i32 Height, i32 ChannelCount, u32 Level)
+{
+    // Levels are stored one after the other, this is also the size of the first Level levels
+    size_t Result = 0;
+    for(u32 i = 0; i < Level; i++)
+    {
+        Result += CK_GetLevelSize(Width, Height, ChannelCount, i);
+    }
+
+    return Result;
+}
+
+void CK_Premultiply(cooker_tables *Tables, u8 *Pixels, i32 Width, i32 Height)
+{
+    // RGBA only, colors are multiplied in linear space and stored as sRGB again
+    size_t Count = (size_t)Width * (size_t)Height;
+    for(size_t i = 0; i < Count; i++)
+    {
+        u8 *Texel = Pixels + i * 4;
+        f32 Alpha = (f32)Texel[3] / 255.0f;
+        for(u32 Channel = 0; Channel < 3; Channel++)
+        {
+            Texel[Channel] = CK_ToSRGB(Tables, Tables->ToLinear[Texel[Channel]] * Alpha);
+        }
+    }
+}
+
+void CK_DownsampleLevel(cooker_tables *Tables, u8 *Source, i32 SourceWidth, i32 SourceHeight, u8 *Dest, i32 ChannelCount, b32 IsPremultiplied)
+{
+    // 2x2 box filter in linear space, odd sizes repeat the last row/column
+    i32 DestWidth = SDL_max(SourceWidth / 2, 1);
+    i32 DestHeight = SDL_max(SourceHeight / 2, 1);
+    b32 IsAlphaWeighted = ChannelCount == 4 && !IsPremultiplied;
+    for(i32 Y = 0; Y < DestHeight; Y++)
+    {
+        i32 Y0 = SDL_min(Y * 2, SourceHeight - 1);
+        i32 Y1 = SDL_min(Y * 2 + 1, SourceHeight - 1);
+        for(i32 X = 0; X < DestWidth; X++)
+        {
+            i32 X0 = SDL_min(X * 2, SourceWidth - 1);
+            i32 X1 = SDL_min(X * 2 + 1, SourceWidth - 1);
+            u8 *Texels[4] =
+            {
+                Source + ((size_t)Y0 * SourceWidth + X0) * ChannelCount,
+                Source + ((size_t)Y0 * SourceWidth + X1) * ChannelCount,
+                Source + ((size_t)Y1 * SourceWidth + X0) * ChannelCount,
+                Source + ((size_t)Y1 * SourceWidth + X1) * ChannelCount,
+            };
+
+            f32 Weights[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+            f32 TotalWeight = 4.0f;
+            if(IsAlphaWeighted)
+            {
+                TotalWeight = 0.0f;
+                for(u32 i = 0; i < 4; i++)
+                {
+                    Weights[i] = (f32)Texels[i][3] / 255.0f;
+                    TotalWeight += Weights[i];
+                }
+                if(TotalWeight == 0.0f)
+                {
+                    // Fully transparent, keep the plain average of the colors
+                    Weights[0] = Weights[1] = Weights[2] = Weights[3] = 1.0f;
+                    TotalWeight = 4.0f;
+                }
+            }
+
+            u8 *Texel = Dest + ((size_t)Y * DestWidth + X) * ChannelCount;
+            for(u32 Channel = 0; Channel < 3; Channel++)
+            {
+                f32 Linear = 0.0f;
+                for(u32 i = 0; i < 4; i++)
+                {
+                    Linear += Tables->ToLinear[Texels[i][Channel]] * Weights[i];
+                }
+                Texel[Channel] = CK_ToSRGB(Tables, Linear / TotalWeight);
+            }
+            if(ChannelCount == 4)
+            {
+                // Alpha is linear
+                u32 Alpha = (u32)Texels[0][3] + Texels[1][3] + Texels[2][3] + Texels[3][3];
+                Texel[3] = (u8)((Alpha + 2) / 4);
+            }
+        }
+    }
+}
+
+void CK_BuildMipChain(cooker_tables *Tables, u8 *Chain, i32 Width, i32 Height, i32 ChannelCount, u32 LevelCount, b32 IsPremultiplied)
+{
+    // Level 0 is already in Chain, every next level is downsampled from the previous one
+    for(u32 Level = 1; Level < LevelCount; Level++)
+    {
+        u8 *Source = Chain + CK_GetLevelOffset(Width, Height, ChannelCount, Level - 1);
+        u8 *Dest = Chain + CK_GetLevelOffset(Width, Height, ChannelCount, Level);
+        CK_DownsampleLevel(Tables, Source, SDL_max(Width >> (Level - 1), 1), SDL_max(Height >> (Level - 1), 1), Dest, ChannelCount, IsPremultiplied);
+    }
+}
+
+void CK_FreeCookedTexture(cooked_texture *Texture)
+{
+    if(Texture)
+    {
+        if(Texture->IsPacked)
+        {
+            // Pixels point inside the asset pack
+        }
+        else if(Texture->FileMemory)
+        {
+            // Pixels point inside the file, see CK_ReadCookedTexture
+            free(Texture->FileMemory);
+        }
+        else
+        {
+            free(Texture->Pixels);
+        }
+        free(Texture);
+    }
+}
+
+cooked_texture *CK_CookTexture(u8 *Pixels, i32 Width, i32 Height, i32 ChannelCount, b32 Premultiply)
+{
+    // Pixels are stb_image output, flipped on load
+    Assert(Pixels);
+    Assert(ChannelCount == 3 || ChannelCount == 4);
+
+    cooker_tables *Tables = (cooker_tables*)malloc(sizeof(cooker_tables)); Assert(Tables);
+    CK_InitializeTables(Tables);
+
+    cooked_texture *Result = (cooked_texture*)calloc(1, sizeof(cooked_texture)); Assert(Result);
+    Result->Width = Width;
+    Result->Height = Height;
+    Result->ChannelCount = ChannelCount;
+    Result->LevelCount = CK_GetLevelCount(Width, Height);
+    Result->PixelsSize = CK_GetLevelOffset(Width, Height, ChannelCount, Result->LevelCount);
+    Result->Pixels = (u8*)malloc(Result->PixelsSize); Assert(Result->Pixels);
+    memcpy(Result->Pixels, Pixels, CK_GetLevelSize(Width, Height, ChannelCount, 0));
+
+    b32 IsPremultiplied = Premultiply && ChannelCount == 4;
+    if(IsPremultiplied)
+    {
+        CK_Premultiply(Tables, Result->Pixels, Width, Height);
+        Result->Flags |= COOKED_TEXTURE_PREMULTIPLIED;
+    }
+    CK_BuildMipChain(Tables, Result->Pixels, Width, Height, ChannelCount, Result->LevelCount, IsPremultiplied);
+
+    free(Tables);
+    return Result;
+}
+
+b32 CK_WriteCookedTexture(cooked_texture *Texture, char *Filename)
+{
+    Assert(Texture);
+    Assert(Filename);
+
+    SDL_RWops *RWops = SDL_RWFromFile(Filename, "wb");
+    if(RWops == NULL)
+    {
+        printf("CK_WriteCookedTexture: Could not open %s\n", Filename);
+        return false;
+    }
+
+    cooked_texture_header Header = {};
+    Header.Magic = COOKED_TEXTURE_MAGIC;
+    Header.Version = COOKED_TEXTURE_VERSION;
+    Header.Width = Texture->Width;
+    Header.Height = Texture->Height;
+    Header.ChannelCount = Texture->ChannelCount;
+    Header.Flags = Texture->Flags;
+    Header.LevelCount = Texture->LevelCount;
+
+    b32 Result = SDL_RWwrite(RWops, &Header, sizeof(Header), 1) == 1;
+    Result = Result && SDL_RWwrite(RWops, Texture->Pixels, Texture->PixelsSize, 1) == 1;
+    SDL_RWclose(RWops);
+
+    return Result;
+}
+
+cooked_texture *CK_ReadCookedTexture(char *Filename)
+{
+    // Reads the whole file with a single read, Pixels point inside that memory.
+    // Returns NULL when the file does not exist or is not valid. When the
+    // texture is in the asset pack it is used in place, nothing is read.
+    Assert(Filename);
+
+    size_t FileSize = 0;
+    u8 *FileMemory = PK_FindFile(Filename, &FileSize);
+    b32 IsPacked = FileMemory != NULL;
+    if(IsPacked)
+    {
+        if(FileSize < sizeof(cooked_texture_header))
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        SDL_RWops *RWops = SDL_RWFromFile(Filename, "rb");
+        if(RWops == NULL)
+        {
+            return NULL;
+        }
+
+        FileSize = (size_t)SDL_RWsize(RWops);
+        FileMemory = (u8*)malloc(FileSize);
+        if(FileMemory == NULL || FileSize < sizeof(cooked_texture_header) || SDL_RWread(RWops, FileMemory, FileSize, 1) != 1)
+        {
+            SDL_RWclose(RWops);
+            free(FileMemory);
+            return NULL;
+        }
+        SDL_RWclose(RWops);
+    }
+
+    cooked_texture_header *Header = (cooked_texture_header*)FileMemory;
+    cooked_texture *Result = (cooked_texture*)calloc(1, sizeof(cooked_texture)); Assert(Result);
+    Result->Width = Header->Width;
+    Result->Height = Header->Height;
+    Result->ChannelCount = Header->ChannelCount;
+    Result->Flags = Header->Flags;
+    Result->LevelCount = Header->LevelCount;
+    Result->FileMemory = FileMemory;
+    Result->IsPacked = IsPacked;
+
+    b32 IsValid = Header->Magic == COOKED_TEXTURE_MAGIC &&
+                  Header->Version == COOKED_TEXTURE_VERSION &&
+                  Header->Width > 0 && Header->Height > 0 &&
+                  (Header->ChannelCount == 3 || Header->ChannelCount == 4) &&
+                  Header->LevelCount >= 1 && Header->LevelCount <= COOKED_TEXTURE_MAX_LEVELS;
+    if(IsValid)
+    {
+        Result->PixelsSize = CK_GetLevelOffset(Result->Width, Result->Height, Result->ChannelCount, Result->LevelCount);
+        IsValid = FileSize == sizeof(cooked_texture_header) + Result->PixelsSize;
+    }
+    if(!IsValid)
+    {
+        printf("CK_ReadCookedTexture: %s is not a valid cooked texture\n", Filename);
+        CK_FreeCookedTexture(Result);
+        return NULL;
+    }
+
+    Result->Pixels = FileMemory + sizeof(cooked_texture_header);
+    return Result;
+}
+
+void CK_GetCookedFilename(char *Dest, size_t DestSize, char *Filename)
+{
+    // textures/name.png -> textures/name.tex
+    SDL_strlcpy(Dest, Filename, DestSize);
+    char *Extension = SDL_strrchr(Dest, '.');
+    if(Extension && SDL_strchr(Extension, '/') == NULL)
+    {
+        *Extension = 0;
+    }
+    SDL_strlcat(Dest, ".tex", DestSize);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Cooked textures
+
+  tools/texture_cooker.cpp turns textures/name.png into textures/name.tex,
+  a header followed by the whole mip chain, ready for glTexImage2D:
+
+  - Rows are stored bottom row first, the flip stb_image does at load time is already done.
+  - Mip levels are averaged in linear space and stored as sRGB, like the
+    GL_SRGB textures they are uploaded to. Without premultiplied alpha the
+    colors are weighted by alpha, transparent texels do not darken the edges.
+  - Optionally the colors are premultiplied by alpha (COOKED_TEXTURE_PREMULTIPLIED),
+    those textures are drawn with glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+
+  A_LoadTexture prefers the .tex file next to the .png, it is read with a
+  single read and uploaded with one glTexImage2D per level. The atlas
+  pages store their mip levels the same way, see atlas.h.
+*/
+
+#define COOKED_TEXTURE_MAGIC 0x58455443 // "CTEX"
+#define COOKED_TEXTURE_VERSION 1
+#define COOKED_TEXTURE_MAX_LEVELS 16
+#define COOKED_TEXTURE_PREMULTIPLIED 0x1
+#define COOKER_SRGB_TABLE_SIZE 4096 // Linear values encoded back to sRGB, 12 bits are enough for 8 bit output
+
+struct cooked_texture_header
+{
+    u32 Magic;
+    u32 Version;
+    i32 Width;
+    i32 Height;
+    i32 ChannelCount; // 3 or 4
+    u32 Flags; // COOKED_TEXTURE_*
+    u32 LevelCount;
+};
+
+// On disk layout: cooked_texture_header, Levels[LevelCount] tightly packed from level 0
+
+struct cooked_texture
+{
+    i32 Width;
+    i32 Height;
+    i32 ChannelCount;
+    u32 Flags;
+    u32 LevelCount;
+
+    u8 *Pixels; // Every level, points inside FileMemory when read from a .tex file
+    size_t PixelsSize;
+    u8 *FileMemory; // Set by CK_ReadCookedTexture
+    b32 IsPacked; // FileMemory is inside the asset pack, it is not freed
+};
+
+// sRGB <-> linear lookup tables, see CK_InitializeTables
+struct cooker_tables
+{
+    f32 ToLinear[256];
+    u8 ToSRGB[COOKER_SRGB_TABLE_SIZE];
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "shared.h"
+#include "headless.h"
+#include "renderer.h"
+#include "image.cpp"
+
+global char *HeadlessSceneNames__[HeadlessScene_Count] = { "game", "sprites", "particles" };
+
+b32 HL_SetScene(headless_run *Run, char *Name)
+{
+    for(u32 i = 0; i < HeadlessScene_Count; i++)
+    {
+        if(strcmp(Name, HeadlessSceneNames__[i]) == 0)
+        {
+            Run->Scene = (headless_scene)i;
+            return true;
+        }
+    }
+
+    printf("Unknown scene %s, use game, sprites or particles\n", Name);
+    return false;
+}
+
+void HL_BeginRun(headless_run *Run, renderer *Renderer)
+{
+    Assert(Run->FrameCount > 0);
+    Run->Frame = 0;
+    Run->DumpedCount = 0;
+    Run->Frames = (headless_frame*)Malloc(sizeof(headless_frame) * Run->FrameCount);
+    Run->Pixels = (u8*)Malloc((size_t)Renderer->DrawableWidth * (size_t)Renderer->DrawableHeight * 4);
+    printf("Headless run: %s, %u frames of %ux%u\n", HeadlessSceneNames__[Run->Scene], Run->FrameCount,
+           Renderer->DrawableWidth, Renderer->DrawableHeight);
+}
+
+b32 HL_RecordFrame(headless_run *Run, renderer *Renderer, f64 SubmitSeconds)
+{
+    // Called after R_EndFrame, returns true once every frame is recorded
+    headless_frame *Frame = &Run->Frames[Run->Frame];
+    Frame->SubmitMs = (f32)(SubmitSeconds * 1000.0);
+    Frame->DrawCalls = Renderer->PreviousDrawCallsPerFrame;
+    Frame->StateChanges = Renderer->PreviousStateChangesPerFrame;
+    Run->Frame++;
+
+    // NOTE: The readback waits for the GPU, it is not part of the submit time
+    if(Run->DumpInterval && Run->Frame % Run->DumpInterval == 0)
+    {
+        char Filename[64];
+        snprintf(Filename, sizeof(Filename), "%s_%04u.png", HeadlessSceneNames__[Run->Scene], Run->Frame);
+        R_ReadPixels(Renderer, Run->Pixels);
+        if(IM_WritePNG(Filename, Run->Pixels, (i32)Renderer->DrawableWidth, (i32)Renderer->DrawableHeight))
+        {
+            Run->DumpedCount++;
+        }
+        else
+        {
+            printf("Could not write %s\n", Filename);
+        }
+    }
+
+    return Run->Frame == Run->FrameCount;
+}
+
+int HL_CompareF32(const void *A, const void *B)
+{
+    f32 First = *(const f32 *)A;
+    f32 Second = *(const f32 *)B;
+    return (First > Second) - (First < Second);
+}
+
+void HL_EndRun(headless_run *Run)
+{
+    // Writes scene_frames.csv and prints the summary of the recorded frames
+    u32 Count = Run->Frame;
+    if(Count == 0)
+    {
+        printf("Headless run ended before the first frame\n");
+        return;
+    }
+
+    char Filename[64];
+    snprintf(Filename, sizeof(Filename), "%s_frames.csv", HeadlessSceneNames__[Run->Scene]);
+    SDL_RWops *RWops = SDL_RWFromFile(Filename, "wb");
+    if(RWops)
+    {
+        char Line[128];
+        i32 Length = snprintf(Line, sizeof(Line), "frame,submit_ms,draw_calls,state_changes\n");
+        SDL_RWwrite(RWops, Line, (size_t)Length, 1);
+        for(u32 i = 0; i < Count; i++)
+        {
+            headless_frame *Frame = &Run->Frames[i];
+            Length = snprintf(Line, sizeof(Line), "%u,%.4f,%u,%u\n", i + 1, Frame->SubmitMs, Frame->DrawCalls, Frame->StateChanges);
+            SDL_RWwrite(RWops, Line, (size_t)Length, 1);
+        }
+        SDL_RWclose(RWops);
+    }
+    else
+    {
+        printf("Could not write %s\n", Filename);
+    }
+
+    // Percentiles, nearest rank
+    f32 *Sorted = (f32*)Malloc(sizeof(f32) * Count);
+    f32 TotalMs = 0.0f;
+    u64 TotalDrawCalls = 0;
+    u32 MaxDrawCalls = 0;
+    for(u32 i = 0; i < Count; i++)
+    {
+        Sorted[i] = Run->Frames[i].SubmitMs;
+        TotalMs += Run->Frames[i].SubmitMs;
+        TotalDrawCalls += Run->Frames[i].DrawCalls;
+        MaxDrawCalls = SDL_max(MaxDrawCalls, Run->Frames[i].DrawCalls);
+    }
+    qsort(Sorted, Count, sizeof(f32), HL_CompareF32);
+
+    printf("%s: %u frames, CPU submit avg %.3f ms, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+           HeadlessSceneNames__[Run->Scene], Count, TotalMs / (f32)Count,
+           Sorted[(Count * 50 + 99) / 100 - 1], Sorted[(Count * 95 + 99) / 100 - 1], Sorted[(Count * 99 + 99) / 100 - 1], Sorted[Count - 1]);
+    printf("%s: draw calls avg %.1f, max %u, %u frames saved, per frame stats in %s\n",
+           HeadlessSceneNames__[Run->Scene], (f64)TotalDrawCalls / (f64)Count, MaxDrawCalls, Run->DumpedCount, Filename);
+
+    Free(Sorted);
+    Free(Run->Pixels);
+    Free(Run->Frames);
+    Run->Pixels = NULL;
+    Run->Frames = NULL;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Headless runs
+
+  "main --headless --scene particles --frames 600 --dump-every 60"
+  renders a scripted scene with the real renderer on a surfaceless GL
+  context (see P_CreateHeadlessWindow), for render tests on machines
+  without a display or a GPU (Mesa llvmpipe/softpipe). Runs are
+  repeatable: no input, a fixed HEADLESS_TIME_STEP, a fixed random seed,
+  every asset loaded before the first frame and no dynamic resolution.
+
+  Every --dump-every frames the output is saved as scene_frame.png
+  (sprites_0060.png) for golden-image comparison. When the run ends
+  the CPU time spent submitting every frame (R_BeginFrame to R_EndFrame
+  returning), its draw calls and state changes are written to
+  scene_frames.csv and summarized on stdout.
+
+  Scenes:
+      game      The game, nobody playing.
+      sprites   The game with the sprite stress test (F2).
+      particles The game with the particle stress test (F5).
+
+  Only the Windows window path is built by build.bat, the headless path
+  needs -DHEADLESS and libEGL, e.g. on Linux from the build directory:
+      g++ -DHEADLESS -O2 ../main.cpp -I../external/glad/include -I../external/glm-0.9.9.6/glm-0.9.9.6
+          $(pkg-config --cflags --libs sdl2 SDL2_mixer freetype2 egl) -ldl -lpthread
+*/
+
+#define HEADLESS_DEFAULT_FRAMES 300
+#define HEADLESS_TIME_STEP (1.0 / 60.0)
+#define HEADLESS_RANDOM_SEED 1
+
+enum headless_scene
+{
+    HeadlessScene_Game,
+    HeadlessScene_Sprites,
+    HeadlessScene_Particles,
+
+    HeadlessScene_Count,
+};
+
+struct headless_frame
+{
+    f32 SubmitMs;
+    u32 DrawCalls;
+    u32 StateChanges;
+};
+
+struct headless_run
+{
+    b32 IsEnabled;
+    headless_scene Scene;
+    u32 FrameCount; // Frames of the game state, the loading frames are not recorded
+    u32 DumpInterval; // 0 = no PNG
+
+    u32 Frame; // Recorded so far
+    headless_frame *Frames;
+    u8 *Pixels; // Readback of one frame, RGBA8
+    u32 DumpedCount;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "shared.h"
+#include "image.h"
+
+struct png_writer
+{
+    SDL_RWops *RWops;
+    u32 Crc; // Of the chunk being written
+    b32 IsWritten;
+};
+
+global u32 Crc32Table__[256];
+global SDL_atomic_t Crc32TableReady__;
+
+void IM_BuildCrc32Table()
+{
+    // NOTE: Two threads building it at the same time write the same values
+    if(SDL_AtomicGet(&Crc32TableReady__))
+    {
+        return;
+    }
+
+    for(u32 i = 0; i < 256; i++)
+    {
+        u32 Crc = i;
+        for(u32 Bit = 0; Bit < 8; Bit++)
+        {
+            Crc = (Crc & 1) ? 0xEDB88320 ^ (Crc >> 1) : Crc >> 1;
+        }
+        Crc32Table__[i] = Crc;
+    }
+    SDL_AtomicSet(&Crc32TableReady__, 1);
+}
+
+void IM_Write(png_writer *Writer, void *Data, size_t Size)
+{
+    // Everything written is part of the current chunk's CRC
+    u8 *Bytes = (u8*)Data;
+    for(size_t i = 0; i < Size; i++)
+    {
+        Writer->Crc = Crc32Table__[(Writer->Crc ^ Bytes[i]) & 0xFF] ^ (Writer->Crc >> 8);
+    }
+    Writer->IsWritten = Writer->IsWritten && (Size == 0 || SDL_RWwrite(Writer->RWops, Data, Size, 1) == 1);
+}
+
+void IM_WriteU32(png_writer *Writer, u32 Value)
+{
+    // PNG integers are big endian
+    u8 Bytes[4] = { (u8)(Value >> 24), (u8)(Value >> 16), (u8)(Value >> 8), (u8)Value };
+    IM_Write(Writer, Bytes, sizeof(Bytes));
+}
+
+void IM_BeginChunk(png_writer *Writer, char *Type, u32 Size)
+{
+    IM_WriteU32(Writer, Size);
+    Writer->Crc = 0xFFFFFFFF; // The length is not part of the CRC
+    IM_Write(Writer, Type, 4);
+}
+
+void IM_EndChunk(png_writer *Writer)
+{
+    u32 Crc = Writer->Crc ^ 0xFFFFFFFF;
+    IM_WriteU32(Writer, Crc);
+}
+
+b32 IM_WritePNG(char *Filename, u8 *Pixels, i32 Width, i32 Height)
+{
+    // Pixels are RGBA8, rows top to bottom without padding
+    Assert(Pixels);
+    Assert(Width > 0 && Height > 0);
+    IM_BuildCrc32Table();
+
+    // Every row starts with its filter type, 0 = none
+    size_t RowSize = (size_t)Width * 4;
+    size_t RawSize = (RowSize + 1) * (size_t)Height;
+    u8 *Raw = (u8*)malloc(RawSize);
+    if(Raw == NULL)
+    {
+        return false;
+    }
+    u32 AdlerA = 1;
+    u32 AdlerB = 0;
+    for(i32 Y = 0; Y < Height; Y++)
+    {
+        u8 *Row = Raw + (RowSize + 1) * (size_t)Y;
+        Row[0] = 0;
+        memcpy(Row + 1, Pixels + RowSize * (size_t)Y, RowSize);
+    }
+    for(size_t i = 0; i < RawSize; i++)
+    {
+        AdlerA = (AdlerA + Raw[i]) % 65521;
+        AdlerB = (AdlerB + AdlerA) % 65521;
+    }
+
+    size_t BlockCount = (RawSize + PNG_STORED_BLOCK_SIZE - 1) / PNG_STORED_BLOCK_SIZE;
+    size_t ZlibSize = 2 + BlockCount * 5 + RawSize + 4;
+    if(ZlibSize > 0x7FFFFFFF)
+    {
+        free(Raw);
+        return false;
+    }
+
+    png_writer Writer = {};
+    Writer.RWops = SDL_RWFromFile(Filename, "wb");
+    Writer.IsWritten = Writer.RWops != NULL;
+    if(!Writer.IsWritten)
+    {
+        free(Raw);
+        return false;
+    }
+
+    u8 Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    IM_Write(&Writer, Signature, sizeof(Signature));
+
+    IM_BeginChunk(&Writer, "IHDR", 13);
+    IM_WriteU32(&Writer, (u32)Width);
+    IM_WriteU32(&Writer, (u32)Height);
+    u8 Header[5] = { 8, 6, 0, 0, 0 }; // 8 bits per channel, RGBA, deflate, no filter set, no interlace
+    IM_Write(&Writer, Header, sizeof(Header));
+    IM_EndChunk(&Writer);
+
+    // One zlib stream of stored blocks in a single IDAT
+    IM_BeginChunk(&Writer, "IDAT", (u32)ZlibSize);
+    u8 ZlibHeader[2] = { 0x78, 0x01 };
+    IM_Write(&Writer, ZlibHeader, sizeof(ZlibHeader));
+    for(size_t Offset = 0; Offset < RawSize; Offset += PNG_STORED_BLOCK_SIZE)
+    {
+        u16 Size = (u16)SDL_min(RawSize - Offset, (size_t)PNG_STORED_BLOCK_SIZE);
+        u16 InverseSize = (u16)~Size;
+        u8 BlockHeader[5] = { (u8)(Offset + Size == RawSize), (u8)Size, (u8)(Size >> 8), (u8)InverseSize, (u8)(InverseSize >> 8) };
+        IM_Write(&Writer, BlockHeader, sizeof(BlockHeader));
+        IM_Write(&Writer, Raw + Offset, Size);
+    }
+    IM_WriteU32(&Writer, (AdlerB << 16) | AdlerA);
+    IM_EndChunk(&Writer);
+
+    IM_BeginChunk(&Writer, "IEND", 0);
+    IM_EndChunk(&Writer);
+
+    SDL_RWclose(Writer.RWops);
+    free(Raw);
+
+    return Writer.IsWritten;
+}
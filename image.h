@@ -0,0 +1,15 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Image writer
+
+  Saves RGBA8 frames read back from the renderer (screenshots, golden
+  images of the headless runs, see headless.h) as PNG files. The deflate
+  stream is made of stored blocks, nothing is compressed: no zlib, any
+  decoder reads them, and a frame costs its 4 bytes per pixel on disk.
+  Thread safe, it only uses malloc/free and its own file.
+*/
+
+#define PNG_STORED_BLOCK_SIZE 65535 // Largest deflate stored block
@@ -6,6 +6,8 @@
 #include <SDL_mixer.h>
 
 #include "shared.h"
+#include "profiler.cpp"
+#include "pack.cpp"
 #include "platform.cpp"
 #include "input.cpp"
 #include "renderer.cpp"
@@ -13,6 +15,13 @@
 #include "collision.cpp"
 #include "entity.cpp"
 #include "random.cpp"
+#include "asset.cpp"
+#include "particle.cpp"
+#include "capture.cpp"
+#include "headless.cpp"
+
+// Every thread that writes profiler events needs its own ring buffer
+static_assert(PROFILER_MAX_THREADS >= 1 + ASSET_MAX_WORKERS + PARTICLE_MAX_WORKERS + 1, "Not enough profiler threads");
 
 // TODO(Jorge): Make sure all movement uses DeltaTime so movement is independent from framerate
 // TODO(Jorge): When the game starts, make sure the windows console does not start. (open the game in windows explorer)
@@ -24,6 +33,7 @@
 
 enum gamestate
 {
+    State_Loading,
     State_Initial,
     State_Game,
     State_Pause,
@@ -33,17 +43,23 @@ enum gamestate
 // Platform
 global u32 WindowWidth = 1366;
 global u32 WindowHeight = 768;
+global frame_pacing_mode FramePacingMode = FramePacing_AdaptiveVSync; // F9 cycles the modes, see platform.h
+global f64 TargetFPS = 0.0; // Of the limiter, 0 = display refresh rate. --fps N limits to N, --fps 0 is uncapped
 
 // Application Variables
 global b32 IsRunning = 1;
 global keyboard     *Keyboard;
 global mouse        *Mouse;
 global clock        *Clock;
+global frame_pacer  *FramePacer;
 global window       *Window;
 global renderer     *Renderer;
 global sound_system *SoundSystem;
 global camera       *Camera;
-global gamestate     CurrentState = State_Game;
+global asset_loader *AssetLoader;
+global particle_system *ParticleSystem;
+global capture_system *CaptureSystem;
+global gamestate     CurrentState = State_Loading;
 
 // Game Variables
 global f32 WorldBottom     = -11.0f;
@@ -57,6 +73,9 @@ global f32 WorldHeight = WorldTop * 2.0f;
 
 // Debug Variables, might want to turn these off on release
 global b32 DrawDebugInformation = 0;
+global b32 DrawSpriteStressTest = 0; // F2, draws 10k extra sprites to check the sprite batch
+global b32 ParticleStressTest = 0; // F5, keeps about 200k particles alive
+global b32 AsyncAssetLoading = 1; // Set to 0 to load every asset before the first frame, useful to compare startup times
 
 u32 PlayerScore = 0;
 
@@ -64,37 +83,163 @@ f32 AnimationTimer = 0.0f;
 
 i32 main(i32 Argc, char **Argv)
 {
-    // The following makes the compiler not throw a warning for unused
-    // variables. I don't really want to turn that warning off, so
-    // here it is, a single line of nonsense.
-    Argc; Argv;
+    // --trace-startup writes a trace from here until the assets are loaded,
+    // --trace-frames N one of the first N frames after that
+    b32 TraceStartup = false;
+    u32 TraceFrames = 0;
+    // --headless renders a scripted scene without a window, see headless.h
+    headless_run Headless = {};
+    Headless.FrameCount = HEADLESS_DEFAULT_FRAMES;
+    // --capture-format png records videos as image sequences, see capture.h
+    char *CaptureFormat = NULL;
+    for(i32 Arg = 1; Arg < Argc; Arg++)
+    {
+        if(strcmp(Argv[Arg], "--trace-startup") == 0)
+        {
+            TraceStartup = true;
+        }
+        else if(strcmp(Argv[Arg], "--trace-frames") == 0 && Arg + 1 < Argc)
+        {
+            TraceFrames = (u32)atoi(Argv[++Arg]);
+        }
+        else if(strcmp(Argv[Arg], "--headless") == 0)
+        {
+            Headless.IsEnabled = true;
+        }
+        else if(strcmp(Argv[Arg], "--scene") == 0 && Arg + 1 < Argc)
+        {
+            if(!HL_SetScene(&Headless, Argv[++Arg]))
+            {
+                return -1;
+            }
+        }
+        else if(strcmp(Argv[Arg], "--frames") == 0 && Arg + 1 < Argc)
+        {
+            // NOTE: SDL_max evaluates its arguments twice, never pass it Argv[++Arg]
+            i32 FrameCount = atoi(Argv[++Arg]);
+            Headless.FrameCount = (u32)SDL_max(FrameCount, 1);
+        }
+        else if(strcmp(Argv[Arg], "--dump-every") == 0 && Arg + 1 < Argc)
+        {
+            i32 DumpInterval = atoi(Argv[++Arg]);
+            Headless.DumpInterval = (u32)SDL_max(DumpInterval, 0);
+        }
+        else if(strcmp(Argv[Arg], "--fps") == 0 && Arg + 1 < Argc)
+        {
+            f64 FPS = atof(Argv[++Arg]);
+            TargetFPS = SDL_max(FPS, 0.0);
+            FramePacingMode = TargetFPS > 0.0 ? FramePacing_Limiter : FramePacing_Uncapped;
+        }
+        else if(strcmp(Argv[Arg], "--capture-format") == 0 && Arg + 1 < Argc)
+        {
+            CaptureFormat = Argv[++Arg];
+        }
+    }
+
+    u64 StartupCounter = SDL_GetPerformanceCounter();
+
+    PF_Initialize();
+    PF_SetThreadName("Main");
+    if(TraceStartup)
+    {
+        PF_BeginCapture(0, "trace_startup.json");
+    }
 
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
+    if(Headless.IsEnabled)
+    {
+        // No display and no sound card on the test machines, and the
+        // same frames every run
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+        AsyncAssetLoading = 0;
+        EnableDynamicResolution = 0;
+        FramePacingMode = FramePacing_Uncapped;
+    }
+
+    {
+        PF_SCOPE("SDL_Init");
+        SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS);
+    }
 
-    Window       = P_CreateOpenGLWindow("Glow", WindowWidth, WindowHeight);
+    // Every loader reads from assets.pack when it exists, from the loose files otherwise.
+    // NOTE: The pack stays mapped until the process exits, music streams from it.
+    if(PK_OpenPack("assets.pack"))
+    {
+        printf("Mapped assets.pack: %u files, %.1f MB\n", Pack__->Header->EntryCount, (f64)Pack__->Size / (1024.0 * 1024.0));
+    }
+    else
+    {
+        printf("No assets.pack, loading loose asset files\n");
+    }
+
+    if(Headless.IsEnabled)
+    {
+        Window = P_CreateHeadlessWindow(WindowWidth, WindowHeight);
+        if(Window == NULL)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        Window = P_CreateOpenGLWindow("Glow", WindowWidth, WindowHeight);
+    }
     Renderer     = R_CreateRenderer(Window);
     Keyboard     = I_CreateKeyboard();
     Mouse        = I_CreateMouse();
     Clock        = P_CreateClock();
+    FramePacer   = P_CreateFramePacer(Window, FramePacingMode, TargetFPS);
     SoundSystem  = S_CreateSoundSystem();
     Camera       = R_CreateCamera(Window->Width, Window->Height, glm::vec3(0.0f, 0.0f, 11.5f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
     // Seed the RNG, GetPerformanceCounter is not the best way, but the results look acceptable
-    RandomSeed((u32)SDL_GetPerformanceCounter());
-
-    font *DebugFont = R_CreateFont(Renderer, "fonts/LiberationMono-Regular.ttf", 14, 14);
-    font *GameFont  = R_CreateFont(Renderer, "fonts/NovaSquare-Regular.ttf", 100, 100);
-    font *UIFont    = R_CreateFont(Renderer, "fonts/NovaSquare-Regular.ttf", 30, 30);
-
-    texture *PlayerTexture      = R_CreateTexture("textures/Player.png");
-    texture *BackgroundTexture  = R_CreateTexture("textures/DeepBlue.png");
-    texture *WallTexture        = R_CreateTexture("textures/Yellow.png");
-    texture *WandererTexture    = R_CreateTexture("textures/Wanderer.png");
-    texture *BulletTexture      = R_CreateTexture("textures/Bullet.png");
-    texture *SeekerTexture      = R_CreateTexture("textures/Seeker.png");
-    texture *PointerTexture     = R_CreateTexture("textures/Pointer.png");
-    texture *BlackHoleTexture   = R_CreateTexture("textures/BlackHole.png");
-    texture *BouncerTexture     = R_CreateTexture("textures/Bouncer.png");
+    RandomSeed(Headless.IsEnabled ? HEADLESS_RANDOM_SEED : (u32)SDL_GetPerformanceCounter());
+
+    // Fonts and textures are decoded on worker threads and uploaded a
+    // few per frame, the handles are not ready until then.
+    AssetLoader  = A_CreateAssetLoader(Megabytes(1));
+
+    font *DebugFont = A_LoadFont(AssetLoader, "fonts/LiberationMono-Regular.ttf", 14, 14);
+    // One small distance field atlas serves NovaSquare at every size,
+    // the UI text is the same font drawn at 30px
+    font *GameFont  = A_LoadFont(AssetLoader, "fonts/NovaSquare-Regular.ttf", 100, 100, true);
+    f32 UIFontScale = 0.3f;
+
+    // HUD, pause menu and debug overlay labels. They are laid out again
+    // only when their string changes, see R_SetText.
+    text_object *ScoreText = R_CreateText(Renderer, GameFont, glm::vec2(UIFontScale));
+    u32 DisplayedScore = (u32)-1;
+    char ScoreString[80] = {};
+    text_object *PauseTitleText = R_CreateText(Renderer, GameFont, glm::vec2(1.5f, 1.5f));
+    text_object *PauseContinueText = R_CreateText(Renderer, GameFont, glm::vec2(0.7f, 0.7f));
+    text_object *PauseExitText = R_CreateText(Renderer, GameFont, glm::vec2(0.7f, 0.7f));
+    text_object *DebugText[38];
+    for(u32 i = 0; i < ArrayCount(DebugText); i++)
+    {
+        DebugText[i] = R_CreateText(Renderer, DebugFont);
+    }
+
+    // Sprites share atlas pages so a frame of mixed entities draws from
+    // one bound texture. textures/sprites.atlas is built offline with
+    // atlas_builder, without it the atlas is packed at load time.
+    A_BeginAtlas(AssetLoader, "textures/sprites.atlas");
+    texture *PlayerTexture      = A_LoadTexture(AssetLoader, "textures/Player.png");
+    texture *BackgroundTexture  = A_LoadTexture(AssetLoader, "textures/DeepBlue.png");
+    texture *WallTexture        = A_LoadTexture(AssetLoader, "textures/Yellow.png");
+    texture *WandererTexture    = A_LoadTexture(AssetLoader, "textures/Wanderer.png");
+    texture *BulletTexture      = A_LoadTexture(AssetLoader, "textures/Bullet.png");
+    texture *SeekerTexture      = A_LoadTexture(AssetLoader, "textures/Seeker.png");
+    texture *PointerTexture     = A_LoadTexture(AssetLoader, "textures/Pointer.png");
+    texture *BlackHoleTexture   = A_LoadTexture(AssetLoader, "textures/BlackHole.png");
+    texture *BouncerTexture     = A_LoadTexture(AssetLoader, "textures/Bouncer.png");
+    A_EndAtlas(AssetLoader);
+    // Particles draw the whole texture with every mip level, outside the atlas
+    texture *GlowTexture        = A_LoadTexture(AssetLoader, "textures/Glow.png");
+
+    if(!AsyncAssetLoading)
+    {
+        A_FinishLoading(AssetLoader);
+    }
 
     f32 BackgroundWidth = WorldWidth + 5.0f;
     f32 BackgroundHeight = WorldHeight + 5.0f;
@@ -135,15 +280,71 @@ i32 main(i32 Argc, char **Argv)
 
     E_PushEntity(Enemies, Pickup1);
 
+    // Particles, every texture is a pool drawn with one instanced draw, see particle.h
+    ParticleSystem = PT_CreateParticleSystem();
+
+    // Videos play back at the display refresh rate, one video frame per rendered frame
+    CaptureSystem = CP_CreateCaptureSystem((u32)FramePacer->RefreshRate);
+    if(CaptureFormat && !CP_SetFormat(CaptureSystem, CaptureFormat))
+    {
+        return -1;
+    }
+    u32 GlowParticles = PT_CreatePool(ParticleSystem, GlowTexture, PARTICLE_DEFAULT_CAPACITY, 4.0f);
+
+    particle_settings ExplosionParticles = {};
+    ExplosionParticles.BurstCount = 1000;
+    ExplosionParticles.Spread = 360.0f;
+    ExplosionParticles.MinSpeed = 2.0f;
+    ExplosionParticles.MaxSpeed = 14.0f;
+    ExplosionParticles.MinLifetime = 0.4f;
+    ExplosionParticles.MaxLifetime = 1.2f;
+    ExplosionParticles.Drag = 2.5f;
+    ExplosionParticles.StartSize = 0.3f;
+    ExplosionParticles.EndSize = 0.05f;
+    ExplosionParticles.StartColor = glm::vec4(1.0f, 0.75f, 0.3f, 1.0f);
+    ExplosionParticles.EndColor = glm::vec4(1.0f, 0.1f, 0.05f, 0.0f);
+
+    // 4 emitters of 40k particles per second living 1.25 seconds on average
+    particle_settings StressParticles = ExplosionParticles;
+    StressParticles.Rate = 40000.0f;
+    StressParticles.MinSpeed = 1.0f;
+    StressParticles.MaxSpeed = 8.0f;
+    StressParticles.MinLifetime = 1.0f;
+    StressParticles.MaxLifetime = 1.5f;
+    StressParticles.Drag = 0.5f;
+    StressParticles.StartSize = 0.15f;
+    StressParticles.EndSize = 0.02f;
+    StressParticles.StartColor = glm::vec4(0.3f, 0.6f, 1.0f, 1.0f);
+    StressParticles.EndColor = glm::vec4(0.6f, 0.2f, 1.0f, 0.0f);
+    particle_emitter *StressEmitters[4] = {};
+    b32 StressEmittersRunning = false;
+
+    if(Headless.IsEnabled)
+    {
+        DrawSpriteStressTest = Headless.Scene == HeadlessScene_Sprites;
+        ParticleStressTest = Headless.Scene == HeadlessScene_Particles;
+        HL_BeginRun(&Headless, Renderer);
+    }
+
     entity *AnimationTest = E_CreateEntity(BouncerTexture, glm::vec3(2.0f, -9.0f, 0.0f), glm::vec3(1.0f), 0.0f, 0.0f, 1.0f, Type_Bouncer, Collider_Rectangle);
 
     i32 i = 0;
+    b32 IsFirstFrame = true;
     while(IsRunning)
     {
+        P_WaitForNextFrame(FramePacer);
         P_UpdateClock(Clock);
+        if(Headless.IsEnabled)
+        {
+            // NOTE: SecondsElapsed drives gameplay too, keep it on the fixed step
+            Clock->SecondsElapsed += HEADLESS_TIME_STEP - Clock->DeltaTime;
+            Clock->DeltaTime = HEADLESS_TIME_STEP;
+        }
         R_CalculateFPS(Renderer, Clock);
+        A_ProcessUploads(AssetLoader);
 
         { // SECTION: Input Handling
+            PF_SCOPE("Input");
             SDL_Event Event;
             while (SDL_PollEvent(&Event))
             {
@@ -171,6 +372,11 @@ i32 main(i32 Argc, char **Argv)
 
             switch (CurrentState)
             {
+                case State_Loading:
+                {
+                    if (I_IsPressed(SDL_SCANCODE_ESCAPE)) { IsRunning = 0; }
+                    break;
+                }
                 case State_Initial:
                 {
                     if (I_IsPressed(SDL_SCANCODE_ESCAPE)) { IsRunning = 0; }
@@ -193,6 +399,32 @@ i32 main(i32 Argc, char **Argv)
 
                     // DrawDebugInformation
                     if(I_IsPressed(SDL_SCANCODE_F1) && I_WasNotPressed(SDL_SCANCODE_F1)) { DrawDebugInformation = !DrawDebugInformation; }
+                    if(I_IsPressed(SDL_SCANCODE_F2) && I_WasNotPressed(SDL_SCANCODE_F2)) { DrawSpriteStressTest = !DrawSpriteStressTest; }
+                    if(I_IsPressed(SDL_SCANCODE_F5) && I_WasNotPressed(SDL_SCANCODE_F5)) { ParticleStressTest = !ParticleStressTest; }
+                    if(I_IsPressed(SDL_SCANCODE_F3) && I_WasNotPressed(SDL_SCANCODE_F3))
+                    {
+                        R_SetAntiAliasing(Renderer, (anti_aliasing_mode)((Renderer->AntiAliasing + 1) % AntiAliasing_Count));
+                    }
+                    if(I_IsPressed(SDL_SCANCODE_F6) && I_WasNotPressed(SDL_SCANCODE_F6))
+                    {
+                        // The render graph is built again at the end of the frame, without the bloom chain
+                        EnableBloom = !EnableBloom;
+                    }
+                    if(I_IsPressed(SDL_SCANCODE_F9) && I_WasNotPressed(SDL_SCANCODE_F9))
+                    {
+                        P_SetFramePacing(FramePacer, (frame_pacing_mode)((FramePacer->Mode + 1) % FramePacing_Count));
+                    }
+                    if(I_IsPressed(SDL_SCANCODE_F7) && I_WasNotPressed(SDL_SCANCODE_F7)) { CP_TakeScreenshot(CaptureSystem, Renderer); }
+                    if(I_IsPressed(SDL_SCANCODE_F8) && I_WasNotPressed(SDL_SCANCODE_F8)) { CP_ToggleRecording(CaptureSystem, Renderer); }
+                    if(I_IsPressed(SDL_SCANCODE_F4) && I_WasNotPressed(SDL_SCANCODE_F4))
+                    {
+                        char TraceFilename[64];
+                        snprintf(TraceFilename, sizeof(TraceFilename), "trace_%u.json", SDL_GetTicks());
+                        if(PF_BeginCapture(TRACE_DEFAULT_FRAMES, TraceFilename))
+                        {
+                            printf("Capturing %d frames to %s\n", TRACE_DEFAULT_FRAMES, TraceFilename);
+                        }
+                    }
 
                     if (I_IsPressed(SDL_SCANCODE_LSHIFT))
                     {
@@ -332,8 +564,27 @@ i32 main(i32 Argc, char **Argv)
         } // SECTION END: Input Handling
 
         {  // SECTION: Update
+            PF_SCOPE("Update");
             switch(CurrentState)
             {
+                case State_Loading:
+                {
+                    if(!A_IsLoading(AssetLoader))
+                    {
+                        printf("Assets ready after: %.2fms\n", P_GetSecondsElapsed(StartupCounter, SDL_GetPerformanceCounter()) * 1000.0);
+                        CurrentState = State_Game;
+
+                        if(TraceStartup)
+                        {
+                            PF_EndCapture();
+                        }
+                        else if(TraceFrames)
+                        {
+                            PF_BeginCapture(TraceFrames, "trace_frames.json");
+                        }
+                    }
+                    break;
+                }
                 case State_Initial:
                 {
                     break;
@@ -409,6 +660,7 @@ i32 main(i32 Argc, char **Argv)
                     {
                         if(E_EntitiesCollide(Player, Node->Entity, &ResolutionDirection, &ResolutionOverlap))
                         {
+                            PT_Emit(ParticleSystem, GlowParticles, ParticleEmitter_Burst, glm::vec2(Node->Entity->Position), &ExplosionParticles);
                             E_ListFreeNode(Enemies, Node);
                         }
                     }
@@ -425,11 +677,34 @@ i32 main(i32 Argc, char **Argv)
                             if(E_EntitiesCollide(Enemy->Entity, Bullet->Entity, &ResolutionDirection, &ResolutionOverlap))
                             {
                                 PlayerScore += 1;
+                                PT_Emit(ParticleSystem, GlowParticles, ParticleEmitter_Burst, glm::vec2(Enemy->Entity->Position), &ExplosionParticles);
                                 E_ListFreeNode(Enemies, Enemy);
                                 E_ListFreeNode(Bullets, Bullet);
                             }
                         }
                     }
+
+                    // The stress emitters run while ParticleStressTest is set (F5)
+                    if(ParticleStressTest != StressEmittersRunning)
+                    {
+                        StressEmittersRunning = ParticleStressTest;
+                        for(u32 Emitter = 0; Emitter < ArrayCount(StressEmitters); Emitter++)
+                        {
+                            if(ParticleStressTest)
+                            {
+                                glm::vec2 Position = glm::vec2(Emitter % 2 ? HalfWorldWidth * 0.5f : -HalfWorldWidth * 0.5f,
+                                                               Emitter / 2 ? HalfWorldHeight * 0.5f : -HalfWorldHeight * 0.5f);
+                                StressEmitters[Emitter] = PT_Emit(ParticleSystem, GlowParticles, ParticleEmitter_Continuous, Position, &StressParticles);
+                            }
+                            else
+                            {
+                                PT_StopEmitter(StressEmitters[Emitter]);
+                                StressEmitters[Emitter] = NULL;
+                            }
+                        }
+                    }
+
+                    PT_UpdateParticles(ParticleSystem, (f32)Clock->DeltaTime);
                 }
                 case State_Pause:
                 {
@@ -449,10 +724,25 @@ i32 main(i32 Argc, char **Argv)
         } // SECTION END: Update
 
         { // SECTION: Render
+            PF_SCOPE("Render");
+            u64 SubmitCounter = SDL_GetPerformanceCounter();
             R_BeginFrame(Renderer);
 
             switch(CurrentState)
             {
+                case State_Loading:
+                {
+                    Renderer->BackgroundColor = MenuBackgroundColor;
+                    R_SetActiveShader(Renderer->Shaders.Texture);
+
+                    // Loading bar, grows from the left
+                    f32 Progress = A_GetProgress(AssetLoader);
+                    f32 BarWidth = 20.0f;
+                    glm::vec3 BarSize = glm::vec3(BarWidth * Progress, 0.25f, 0.0f);
+                    glm::vec3 BarPosition = glm::vec3((-BarWidth + BarSize.x) * 0.5f, 0.0f, 0.0f);
+                    R_DrawTexture(Renderer, Renderer->WhiteTexture, BarPosition, BarSize, 0.0f);
+                    break;
+                }
                 case State_Initial:
                 {
                     Renderer->BackgroundColor = MenuBackgroundColor;
@@ -471,6 +761,23 @@ i32 main(i32 Argc, char **Argv)
 
                     R_DrawEntityList(Renderer, Enemies);
                     R_DrawEntityList(Renderer, Bullets);
+                    PT_DrawParticles(Renderer, ParticleSystem);
+
+                    if(DrawSpriteStressTest)
+                    {
+                        // 100x100 grid of sprites, with the sprite batch it should only add a few draw calls
+                        for(u32 Y = 0; Y < 100; Y++)
+                        {
+                            for(u32 X = 0; X < 100; X++)
+                            {
+                                glm::vec3 Position = glm::vec3(Remap((f32)X, 0.0f, 99.0f, WorldLeft, WorldRight),
+                                                               Remap((f32)Y, 0.0f, 99.0f, WorldBottom, WorldTop),
+                                                               0.0f);
+                                R_DrawTexture(Renderer, SeekerTexture, Position, glm::vec3(0.2f), AnimationTimer);
+                            }
+                        }
+                        AnimationTimer += (f32)Clock->DeltaTime * 90.0f;
+                    }
 
                     // Draw Mouse Pointer. The Position needs
                     // adjustment since R_DrawTexture draws
@@ -480,12 +787,16 @@ i32 main(i32 Argc, char **Argv)
                     glm::vec3 CorrectedCursorPosition = glm::vec3(Mouse->WorldPosition.x - (CursorSize.x / 2.0f),
                                                                   Mouse->WorldPosition.y - (CursorSize.y / 2.0f),
                                                                   0.1f);
-                    R_DrawTexture(Renderer, PointerTexture, CorrectedCursorPosition, CursorSize, glm::vec3(0.0f), 0.0f);
+                    R_DrawTexture(Renderer, PointerTexture, CorrectedCursorPosition, CursorSize, 0.0f);
 
                     // Draw player score
-                    char PlayerScoreString[80];
-                    sprintf_s(PlayerScoreString, "Score: %d", PlayerScore);
-                    R_DrawText2D(Renderer, PlayerScoreString, UIFont, glm::vec2(Window->Width - UIFont->Width * 5 , Window->Height-UIFont->Height), glm::vec2(1.0f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                    glm::vec2 ScorePosition = glm::vec2((f32)Window->Width - (f32)GameFont->Width * UIFontScale * 5.0f, (f32)Window->Height - (f32)GameFont->Height * UIFontScale);
+                    if(PlayerScore != DisplayedScore)
+                    {
+                        snprintf(ScoreString, sizeof(ScoreString), "Score: %d", PlayerScore);
+                        DisplayedScore = PlayerScore;
+                    }
+                    R_DrawText(Renderer, ScoreText, ScoreString, ScorePosition);
 
                     if(DrawDebugInformation)
                     {
@@ -494,26 +805,111 @@ i32 main(i32 Argc, char **Argv)
 
                         // GPU and OpenGL stuff
                         f32 LeftMargin = 4.0f;
-                        R_DrawText2D(Renderer, "GPU:", DebugFont, glm::vec2(LeftMargin, Window->Height - DebugFont->Height), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-                        R_DrawText2D(Renderer, (char*)Renderer->HardwareVendor, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 2), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-                        R_DrawText2D(Renderer, (char*)Renderer->HardwareModel, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 3), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[0], "GPU:", glm::vec2(LeftMargin, Window->Height - DebugFont->Height));
+                        R_DrawText(Renderer, DebugText[1], (char*)Renderer->HardwareVendor, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 2));
+                        R_DrawText(Renderer, DebugText[2], (char*)Renderer->HardwareModel, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 3));
                         snprintf(String, sizeof(char) * 99,"OpenGL Version: %s", Renderer->OpenGLVersion);
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 4), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[3], String, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 4));
                         snprintf(String, sizeof(char) * 99,"GLSL Version: %s", Renderer->GLSLVersion);
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 5), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[4], String, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 5));
 
                         // CPU
-                        R_DrawText2D(Renderer, "CPU:", DebugFont, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 6), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[5], "CPU:", glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 6));
                         snprintf(String, sizeof(char) * 99,"Cache Line Size: %d", SDL_GetCPUCacheLineSize());
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 7), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[6], String, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 7));
                         snprintf(String, sizeof(char) * 99,"Core Count: %d", SDL_GetCPUCount());
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 8), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[7], String, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * 8));
 
                         // FPS Min Ms/Max Ms/ Avg Ms
                         snprintf(String, sizeof(char) * 99,"FPS: %.4f", Renderer->FPS);
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 9), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[8], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 9));
                         snprintf(String, sizeof(char) * 99,"Average Ms Per Frame: %.5f", Renderer->AverageMsPerFrame);
-                        R_DrawText2D(Renderer, String, DebugFont, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 10), glm::vec2(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+                        R_DrawText(Renderer, DebugText[9], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 10));
+                        stream_buffer *Stream = &Renderer->StreamBuffer;
+                        snprintf(String, sizeof(char) * 99,"Draw Calls: %d, Streamed: %.1f KB (%s, %d orphans)", Renderer->PreviousDrawCallsPerFrame, (f64)Stream->PreviousBytes / 1024.0,
+                                 Stream->Mode == StreamBuffer_Unsynchronized ? "unsynchronized" : "orphaning", Stream->PreviousOrphans);
+                        R_DrawText(Renderer, DebugText[10], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 11));
+                        snprintf(String, sizeof(char) * 99,"Uniform Uploads: %d (%d redundant skipped)", Renderer->PreviousUniformUploadsPerFrame, Renderer->PreviousUniformUploadsSkippedPerFrame);
+                        R_DrawText(Renderer, DebugText[11], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 12));
+                        snprintf(String, sizeof(char) * 99,"State Changes: %d (%d redundant skipped)", Renderer->PreviousStateChangesPerFrame, Renderer->PreviousStateChangesSkippedPerFrame);
+                        R_DrawText(Renderer, DebugText[12], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 13));
+                        snprintf(String, sizeof(char) * 99,"Anti-aliasing (F3): %s, %.1f MB, %d reads per pixel", R_GetAntiAliasingName(Renderer->AntiAliasing), (f64)Renderer->AntiAliasingBytes / (1024.0 * 1024.0), Renderer->AntiAliasingReadsPerPixel);
+                        R_DrawText(Renderer, DebugText[13], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 14));
+                        snprintf(String, sizeof(char) * 99,"Render Scale: %.2f (%dx%d), GPU %.2f ms of %.2f ms", Renderer->RenderScale, Renderer->RenderWidth, Renderer->RenderHeight, Renderer->GPUFrameMs, GPUFrameBudgetMs);
+                        R_DrawText(Renderer, DebugText[14], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 15));
+                        snprintf(String, sizeof(char) * 99,"Entities: %d drawn, %d culled, Particles: %u (%u threads)", Renderer->PreviousEntitiesDrawn, Renderer->PreviousEntitiesCulled,
+                                 ParticleSystem->LiveCount, ParticleSystem->ThreadCount);
+                        R_DrawText(Renderer, DebugText[15], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 16));
+                        render_graph *Graph = &Renderer->RenderGraph;
+                        snprintf(String, sizeof(char) * 99,"Render Targets (F6 bloom): %.1f MB of %.1f MB declared, %u passes culled, %u aliased", (f64)Graph->AllocatedBytes / (1024.0 * 1024.0),
+                                 (f64)Graph->DeclaredBytes / (1024.0 * 1024.0), Graph->CulledPassCount, Graph->AliasedResourceCount);
+                        R_DrawText(Renderer, DebugText[16], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 17));
+                        if(CaptureSystem->IsRecording)
+                        {
+                            snprintf(String, sizeof(char) * 99,"Capture (F8 stop): %u frames written, %u dropped, %.2f ms per frame, %u stalls", (u32)SDL_AtomicGet(&CaptureSystem->WrittenFrames),
+                                     CaptureSystem->DroppedFrames, (f64)SDL_AtomicGet(&CaptureSystem->WriteMicroseconds) / 1000.0, Renderer->Readback.StalledFrames);
+                        }
+                        else
+                        {
+                            snprintf(String, sizeof(char) * 99,"Capture (F7 screenshot, F8 record %s): %u screenshots, %u videos", CaptureFormatNames__[CaptureSystem->Format],
+                                     CaptureSystem->ScreenshotCount, CaptureSystem->VideoCount);
+                        }
+                        R_DrawText(Renderer, DebugText[17], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 18));
+
+                        // Frame pacing, the time between frame starts over the last FRAME_PACING_HISTORY frames
+                        snprintf(String, sizeof(char) * 99,"Pacing (F9): %s, %.2f ms (avg %.2f jitter %.2f worst %.2f), waited %.2f ms", P_GetFramePacingName(FramePacer->ActiveMode),
+                                 FramePacer->IntervalMs, FramePacer->AvgIntervalMs, FramePacer->JitterMs, FramePacer->WorstIntervalMs, FramePacer->WaitMs);
+                        R_DrawText(Renderer, DebugText[18], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 19));
+                        gpu_timer_stats *Latency = &Renderer->GPUProfiler.Latency;
+                        snprintf(String, sizeof(char) * 99,"Present Latency: %.2f ms (min %.2f avg %.2f max %.2f), swap %.2f ms", Latency->Ms, Latency->MinMs, Latency->AvgMs, Latency->MaxMs, Renderer->SwapMs);
+                        R_DrawText(Renderer, DebugText[19], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 20));
+
+                        // GPU time per pass, min/avg/max of the last GPU_TIMER_HISTORY frames
+                        gpu_timer_stats *FrameStats = &Renderer->GPUProfiler.Frame;
+                        snprintf(String, sizeof(char) * 99,"GPU Frame: %.2f ms (min %.2f avg %.2f max %.2f)", FrameStats->Ms, FrameStats->MinMs, FrameStats->AvgMs, FrameStats->MaxMs);
+                        R_DrawText(Renderer, DebugText[20], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 21));
+                        for(u32 Pass = 0; Pass < GPUPass_Count; Pass++)
+                        {
+                            gpu_timer_stats *Stats = R_GetGPUTimerStats(Renderer, (gpu_pass)Pass);
+                            snprintf(String, sizeof(char) * 99,"%s: %.2f ms (min %.2f avg %.2f max %.2f)", R_GetGPUPassName((gpu_pass)Pass), Stats->Ms, Stats->MinMs, Stats->AvgMs, Stats->MaxMs);
+                            R_DrawText(Renderer, DebugText[21 + Pass], String, glm::vec2(LeftMargin * 2, Window->Height - DebugFont->Height * (22 + Pass)));
+                        }
+
+#if PROFILER_ENABLED
+                        // CPU zones, p50/p95/p99 and worst of the last PROFILER_HISTORY frames
+                        profiler *Profiler = PF_GetProfiler();
+                        profiler_stats *FrameCPU = &Profiler->FrameStats;
+                        snprintf(String, sizeof(char) * 99,"CPU Frame: %.2f ms (p50 %.2f p95 %.2f p99 %.2f worst %.2f)", FrameCPU->LastMs, FrameCPU->P50Ms, FrameCPU->P95Ms, FrameCPU->P99Ms, FrameCPU->WorstMs);
+                        R_DrawText(Renderer, DebugText[27], String, glm::vec2(LeftMargin, Window->Height - DebugFont->Height * 28));
+                        u32 Line = 0;
+                        for(u32 Zone = 0; Zone < Profiler->ZoneCount && Line < ArrayCount(DebugText) - 28; Zone++)
+                        {
+                            profiler_zone *ProfilerZone = &Profiler->Zones[Zone];
+                            if(ProfilerZone->IsCounter)
+                            {
+                                continue;
+                            }
+                            profiler_stats *Stats = &ProfilerZone->Stats;
+                            snprintf(String, sizeof(char) * 99,"%s x%d: %.2f ms (p50 %.2f p95 %.2f p99 %.2f worst %.2f)", ProfilerZone->Name, ProfilerZone->Hits, Stats->LastMs, Stats->P50Ms, Stats->P95Ms, Stats->P99Ms, Stats->WorstMs);
+                            R_DrawText(Renderer, DebugText[28 + Line], String, glm::vec2(LeftMargin * (f32)(2 + ProfilerZone->Depth), Window->Height - DebugFont->Height * (i32)(29 + Line)));
+                            Line++;
+                        }
+
+                        // Frame-time graph, one bar per frame, newest on the right. The line is the 60 fps budget.
+                        f32 GraphMsToPixels = 3.0f;
+                        f32 GraphBarWidth = 2.0f;
+                        glm::vec2 GraphOrigin = glm::vec2((f32)Window->Width - GraphBarWidth * PROFILER_HISTORY - LeftMargin * 4, LeftMargin * 4);
+                        for(u32 Frame = 0; Frame < PROFILER_HISTORY; Frame++)
+                        {
+                            f32 FrameMs = PF_GetFrameMs(Frame);
+                            glm::vec4 BarColor = FrameMs <= 1000.0f / 60.0f ? glm::vec4(0.2f, 0.8f, 0.2f, 1.0f) :
+                                                 FrameMs <= 1000.0f / 30.0f ? glm::vec4(0.9f, 0.8f, 0.1f, 1.0f) :
+                                                 glm::vec4(0.9f, 0.1f, 0.1f, 1.0f);
+                            glm::vec2 BarPosition = GraphOrigin + glm::vec2(GraphBarWidth * (f32)(PROFILER_HISTORY - 1 - Frame), 0.0f);
+                            R_DrawRect2D(Renderer, BarPosition, glm::vec2(GraphBarWidth, FrameMs * GraphMsToPixels), BarColor, 0.1f);
+                        }
+                        R_DrawRect2D(Renderer, GraphOrigin + glm::vec2(0.0f, 1000.0f / 60.0f * GraphMsToPixels), glm::vec2(GraphBarWidth * PROFILER_HISTORY, 1.0f), glm::vec4(1.0f), 0.2f);
+#endif
 
                         // Mouse World Position
                     }
@@ -527,9 +923,9 @@ i32 main(i32 Argc, char **Argv)
 
                     f32 HardcodedFontWidth = 38.0f * 1.5f;
                     f32 XPos = (Window->Width / 2.0f) - HardcodedFontWidth * 2.5f;
-                    R_DrawText2D(Renderer, "Pause", GameFont, glm::vec2(XPos, Window->Height / 2.0f + 50.0f), glm::vec2(1.5f, 1.5f), glm::vec3(1.0f, 1.0f, 1.0f));
-                    R_DrawText2D(Renderer, "press space to continue", GameFont, glm::vec2(Window->Width / 2.0f - 38.0f * 11.5f * 0.7f, Window->Height / 2.0f - 100.0f), glm::vec2(0.7, 0.7), glm::vec3(1.0f, 1.0f, 1.0f));
-                    R_DrawText2D(Renderer, "press escape to exit", GameFont, glm::vec2(Window->Width / 2.0f - 38.0f * 10.0f * 0.7f, Window->Height / 2.0f - 200.0f), glm::vec2(0.7, 0.7), glm::vec3(1.0f, 1.0f, 1.0f));
+                    R_DrawText(Renderer, PauseTitleText, "Pause", glm::vec2(XPos, Window->Height / 2.0f + 50.0f));
+                    R_DrawText(Renderer, PauseContinueText, "press space to continue", glm::vec2(Window->Width / 2.0f - 38.0f * 11.5f * 0.7f, Window->Height / 2.0f - 100.0f));
+                    R_DrawText(Renderer, PauseExitText, "press escape to exit", glm::vec2(Window->Width / 2.0f - 38.0f * 10.0f * 0.7f, Window->Height / 2.0f - 200.0f));
 
                     break;
                 }
@@ -541,9 +937,40 @@ i32 main(i32 Argc, char **Argv)
             }
 
             R_EndFrame(Renderer);
+            f64 SubmitSeconds = P_GetSecondsElapsed(SubmitCounter, SDL_GetPerformanceCounter());
+            CP_UpdateCapture(CaptureSystem, Renderer);
+
+            if(Headless.IsEnabled && CurrentState == State_Game)
+            {
+                if(HL_RecordFrame(&Headless, Renderer, SubmitSeconds))
+                {
+                    IsRunning = 0;
+                }
+            }
+
+            if(IsFirstFrame)
+            {
+                printf("Time to first frame: %.2fms\n", P_GetSecondsElapsed(StartupCounter, SDL_GetPerformanceCounter()) * 1000.0);
+                IsFirstFrame = false;
+            }
         } // SECTION END: Render
+        PF_COUNTER("Entities", Enemies->Count + Bullets->Count);
+        PF_COUNTER("Particles", ParticleSystem->LiveCount);
+        PF_COUNTER("Draw Calls", Renderer->PreviousDrawCallsPerFrame);
+        PF_COUNTER("Streamed Bytes", Renderer->StreamBuffer.PreviousBytes);
+        PF_COUNTER("Allocations", AllocationCount);
+        PF_EndFrame();
         SDL_GL_DeleteContext(Window->Handle);
     }
 
+    CP_DestroyCaptureSystem(CaptureSystem);
+    PT_DestroyParticleSystem(ParticleSystem);
+    A_DestroyAssetLoader(AssetLoader);
+    if(Headless.IsEnabled)
+    {
+        HL_EndRun(&Headless);
+        P_DestroyHeadlessWindow(Window);
+    }
+
     return 0;
 }
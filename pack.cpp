@@ -0,0 +1,202 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "shared.h"
+#include "pack.h"
+
+// NOTE: Opened once by the main thread before the asset workers start,
+// read only after that, the workers look files up without locks.
+global pack *Pack__ = NULL;
+
+b32 PK_MapFile(pack *Pack, char *Filename)
+{
+#ifdef _WIN32
+    HANDLE File = CreateFileA(Filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if(File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize;
+    HANDLE Mapping = NULL;
+    void *Memory = NULL;
+    if(GetFileSizeEx(File, &FileSize) && FileSize.QuadPart > 0)
+    {
+        Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if(Mapping)
+    {
+        Memory = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if(Memory == NULL)
+    {
+        if(Mapping)
+        {
+            CloseHandle(Mapping);
+        }
+        CloseHandle(File);
+        return false;
+    }
+
+    Pack->Memory = (u8*)Memory;
+    Pack->Size = (size_t)FileSize.QuadPart;
+    Pack->FileHandle = File;
+    Pack->MappingHandle = Mapping;
+#else
+    i32 File = open(Filename, O_RDONLY);
+    if(File < 0)
+    {
+        return false;
+    }
+
+    struct stat FileStat;
+    void *Memory = MAP_FAILED;
+    if(fstat(File, &FileStat) == 0 && FileStat.st_size > 0)
+    {
+        Memory = mmap(NULL, (size_t)FileStat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(File);
+    if(Memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    Pack->Memory = (u8*)Memory;
+    Pack->Size = (size_t)FileStat.st_size;
+#endif
+
+    return true;
+}
+
+void PK_UnmapFile(pack *Pack)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(Pack->Memory);
+    CloseHandle((HANDLE)Pack->MappingHandle);
+    CloseHandle((HANDLE)Pack->FileHandle);
+#else
+    munmap(Pack->Memory, Pack->Size);
+#endif
+    Pack->Memory = NULL;
+    Pack->Size = 0;
+}
+
+b32 PK_OpenPack(char *Filename)
+{
+    // Returns false when there is no valid pack, assets are then read from their own files
+    Assert(Filename);
+    Assert(Pack__ == NULL);
+
+    pack *Result = (pack*)Malloc(sizeof(pack)); Assert(Result);
+    if(!PK_MapFile(Result, Filename))
+    {
+        Free(Result);
+        return false;
+    }
+
+    // Everything the lookups touch is checked once here, except the slot
+    // contents: PK_FindFile stops at an invalid entry index and after
+    // SlotCount probes, a corrupt table can not make it loop forever.
+    // Offsets are compared before they are added, they could wrap
+    pack_header *Header = (pack_header*)Result->Memory;
+    b32 IsValid = Result->Size >= sizeof(pack_header) &&
+                  Header->Magic == PACK_MAGIC &&
+                  Header->Version == PACK_VERSION &&
+                  Header->EntryCount <= PACK_MAX_ENTRIES &&
+                  Header->SlotCount > 0 && (Header->SlotCount & (Header->SlotCount - 1)) == 0 &&
+                  Header->SlotCount >= 2 * Header->EntryCount &&
+                  Header->EntriesOffset <= Result->Size &&
+                  sizeof(pack_entry) * Header->EntryCount <= Result->Size - Header->EntriesOffset &&
+                  Header->SlotsOffset <= Result->Size &&
+                  sizeof(u32) * Header->SlotCount <= Result->Size - Header->SlotsOffset;
+    for(u32 i = 0; IsValid && i < Header->EntryCount; i++)
+    {
+        pack_entry *Entry = (pack_entry*)(Result->Memory + Header->EntriesOffset) + i;
+        IsValid = Entry->Offset % PACK_ALIGNMENT == 0 &&
+                  Entry->Offset < Result->Size && Entry->Size < Result->Size - Entry->Offset &&
+                  Result->Memory[Entry->Offset + Entry->Size] == 0;
+    }
+    if(!IsValid)
+    {
+        printf("PK_OpenPack: %s is not a valid asset pack\n", Filename);
+        PK_UnmapFile(Result);
+        Free(Result);
+        return false;
+    }
+
+    Result->Header = Header;
+    Result->Entries = (pack_entry*)(Result->Memory + Header->EntriesOffset);
+    Result->Slots = (u32*)(Result->Memory + Header->SlotsOffset);
+    Pack__ = Result;
+
+    return true;
+}
+
+void PK_ClosePack()
+{
+    // NOTE: Nothing loaded from the pack can be used after this
+    if(Pack__)
+    {
+        PK_UnmapFile(Pack__);
+        Free(Pack__);
+        Pack__ = NULL;
+    }
+}
+
+u8 *PK_FindFile(char *Name, size_t *Size)
+{
+    // Returns the file inside the mapping, 0 terminated, or NULL when it
+    // is not packed. The memory is valid until PK_ClosePack.
+    Assert(Name);
+    if(Pack__ == NULL)
+    {
+        return NULL;
+    }
+
+    u32 NameHash = HashString(Name);
+    u32 SlotCount = Pack__->Header->SlotCount;
+    u32 Mask = SlotCount - 1;
+    u32 Slot = NameHash & Mask;
+    for(u32 Probe = 0; Probe < SlotCount && Pack__->Slots[Slot] != 0; Probe++, Slot = (Slot + 1) & Mask)
+    {
+        u32 EntryIndex = Pack__->Slots[Slot] - 1;
+        if(EntryIndex >= Pack__->Header->EntryCount)
+        {
+            break;
+        }
+
+        pack_entry *Entry = &Pack__->Entries[EntryIndex];
+        if(Entry->NameHash == NameHash && strncmp(Entry->Name, Name, PACK_NAME_LENGTH) == 0)
+        {
+            if(Size)
+            {
+                *Size = (size_t)Entry->Size;
+            }
+            return Pack__->Memory + Entry->Offset;
+        }
+    }
+
+    return NULL;
+}
+
+SDL_RWops *PK_OpenFile(char *Name)
+{
+    // Reads from the pack when the file is in it, from disk otherwise
+    size_t Size = 0;
+    u8 *Data = PK_FindFile(Name, &Size);
+    if(Data)
+    {
+        return SDL_RWFromConstMem(Data, (i32)Size);
+    }
+
+    return SDL_RWFromFile(Name, "rb");
+}
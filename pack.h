@@ -0,0 +1,60 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  Asset pack
+
+  tools/asset_packer.cpp puts every file of build/textures, build/fonts,
+  build/shaders and build/audio into one assets.pack. The game maps it
+  once at startup (PK_OpenPack) and the loaders read straight from the
+  mapping: stb_image from memory, FT_New_Memory_Face, SDL_RWFromConstMem
+  for the mixer, shaders, atlases and cooked textures in place. Nothing
+  is copied and no file is opened per asset.
+
+  Files are looked up by the same path the game uses ("textures/Player.png")
+  through an open addressing table of name hashes. Any file that is not
+  in the pack, or every file when there is no pack, is read from disk as
+  before.
+
+  On disk layout: pack_header, pack_entry[EntryCount], u32 Slots[SlotCount],
+  then the data of every file at a multiple of PACK_ALIGNMENT followed by
+  a 0 byte, so text files can be used as C strings.
+*/
+
+#define PACK_MAGIC 0x4B415047 // "GPAK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64 // File headers are read straight from the mapping
+#define PACK_NAME_LENGTH 64
+#define PACK_MAX_ENTRIES 1024
+
+struct pack_header
+{
+    u32 Magic;
+    u32 Version;
+    u32 EntryCount;
+    u32 SlotCount; // Power of two, at least twice EntryCount
+    u64 EntriesOffset;
+    u64 SlotsOffset;
+};
+
+struct pack_entry
+{
+    char Name[PACK_NAME_LENGTH];
+    u32 NameHash; // HashString of Name
+    u32 Reserved;
+    u64 Offset;
+    u64 Size; // Without the 0 byte after the data
+};
+
+struct pack
+{
+    u8 *Memory;
+    size_t Size;
+    void *FileHandle; // Windows only, the mapping keeps them open
+    void *MappingHandle;
+
+    pack_header *Header;
+    pack_entry *Entries;
+    u32 *Slots; // Entry index + 1, 0 is an empty slot
+};
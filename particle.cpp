@@ -0,0 +1,425 @@
+#pragma once
+
+#include <float.h>
+#include <emmintrin.h> // SSE2, the update kernel packs the colors with integer ops
+
+#include "shared.h"
+#include "particle.h"
+#include "renderer.h"
+#include "profiler.h"
+
+// Every pool array is Capacity entries of 4 bytes in one block, in this
+// order. Moving a particle copies the first PARTICLE_MOVED_ARRAY_COUNT.
+enum particle_array
+{
+    ParticleArray_PositionX,
+    ParticleArray_PositionY,
+    ParticleArray_VelocityX,
+    ParticleArray_VelocityY,
+    ParticleArray_Drag,
+    ParticleArray_Age,
+    ParticleArray_InverseLifetime,
+    ParticleArray_StartSize,
+    ParticleArray_EndSize,
+    ParticleArray_StartColor, // 4 arrays, RGBA
+    ParticleArray_EndColor = ParticleArray_StartColor + 4,
+    ParticleArray_Size = ParticleArray_EndColor + 4,
+    ParticleArray_Color,
+    ParticleArray_Dead, // Not moved, only valid during the update
+
+    ParticleArray_Count,
+};
+
+#define PARTICLE_MOVED_ARRAY_COUNT ParticleArray_Dead
+
+f32 PT_RandomBetween(f32 Min, f32 Max)
+{
+    // RandomBetween asserts Min < Max, settings often use the same value for both
+    f32 Unit = (f32)(RandomU32() >> 8) * (1.0f / 16777216.0f);
+    return Min + (Max - Min) * Unit;
+}
+
+u32 PT_CreatePool(particle_system *System, texture *Texture, u32 Capacity, f32 Intensity)
+{
+    // Returns the index emitters use to spawn into this pool
+    Assert(System);
+    Assert(System->PoolCount < PARTICLE_MAX_POOLS);
+
+    u32 Result = System->PoolCount++;
+    particle_pool *Pool = &System->Pools[Result];
+    Pool->Texture = Texture;
+    Pool->Intensity = Intensity;
+    Pool->Capacity = (Capacity + PARTICLE_SLICE_ALIGNMENT - 1) & ~(u32)(PARTICLE_SLICE_ALIGNMENT - 1);
+    Pool->Count = 0;
+
+    // NOTE: Malloc is calloc, 16 byte aligned, and every array starts at a
+    // multiple of 64 bytes from the block, the kernel uses aligned loads.
+    u32 *Memory = (u32*)Malloc(sizeof(u32) * Pool->Capacity * ParticleArray_Count); Assert(Memory);
+    Pool->PositionX = (f32*)(Memory + Pool->Capacity * ParticleArray_PositionX);
+    Pool->PositionY = (f32*)(Memory + Pool->Capacity * ParticleArray_PositionY);
+    Pool->VelocityX = (f32*)(Memory + Pool->Capacity * ParticleArray_VelocityX);
+    Pool->VelocityY = (f32*)(Memory + Pool->Capacity * ParticleArray_VelocityY);
+    Pool->Drag = (f32*)(Memory + Pool->Capacity * ParticleArray_Drag);
+    Pool->Age = (f32*)(Memory + Pool->Capacity * ParticleArray_Age);
+    Pool->InverseLifetime = (f32*)(Memory + Pool->Capacity * ParticleArray_InverseLifetime);
+    Pool->StartSize = (f32*)(Memory + Pool->Capacity * ParticleArray_StartSize);
+    Pool->EndSize = (f32*)(Memory + Pool->Capacity * ParticleArray_EndSize);
+    for(u32 Channel = 0; Channel < 4; Channel++)
+    {
+        Pool->StartColor[Channel] = (f32*)(Memory + Pool->Capacity * (ParticleArray_StartColor + Channel));
+        Pool->EndColor[Channel] = (f32*)(Memory + Pool->Capacity * (ParticleArray_EndColor + Channel));
+    }
+    Pool->Size = (f32*)(Memory + Pool->Capacity * ParticleArray_Size);
+    Pool->Color = Memory + Pool->Capacity * ParticleArray_Color;
+    Pool->Dead = Memory + Pool->Capacity * ParticleArray_Dead;
+
+    return Result;
+}
+
+particle_emitter *PT_Emit(particle_system *System, u32 Pool, particle_emitter_mode Mode, glm::vec2 Position, particle_settings *Settings)
+{
+    // Burst emitters are done after the next update, continuous ones run
+    // until PT_StopEmitter. Returns NULL when every emitter is in use.
+    Assert(System);
+    Assert(Settings);
+    Assert(Pool < System->PoolCount);
+
+    for(u32 i = 0; i < PARTICLE_MAX_EMITTERS; i++)
+    {
+        particle_emitter *Emitter = &System->Emitters[i];
+        if(!Emitter->IsActive)
+        {
+            *Emitter = {};
+            Emitter->IsActive = true;
+            Emitter->Mode = Mode;
+            Emitter->Pool = Pool;
+            Emitter->Position = Position;
+            Emitter->Settings = *Settings;
+            return Emitter;
+        }
+    }
+
+    return NULL;
+}
+
+void PT_StopEmitter(particle_emitter *Emitter)
+{
+    // The particles already spawned live on
+    if(Emitter)
+    {
+        Emitter->IsActive = false;
+    }
+}
+
+u32 PT_Spawn(particle_pool *Pool, particle_emitter *Emitter, u32 Count)
+{
+    // Returns how many particles fit in the pool
+    particle_settings *Settings = &Emitter->Settings;
+    Count = SDL_min(Count, Pool->Capacity - Pool->Count);
+    for(u32 n = 0; n < Count; n++)
+    {
+        u32 i = Pool->Count++;
+        f32 Angle = glm::radians(Settings->Direction + PT_RandomBetween(-0.5f, 0.5f) * Settings->Spread);
+        f32 Speed = PT_RandomBetween(Settings->MinSpeed, Settings->MaxSpeed);
+        f32 Lifetime = PT_RandomBetween(Settings->MinLifetime, Settings->MaxLifetime);
+
+        Pool->PositionX[i] = Emitter->Position.x;
+        Pool->PositionY[i] = Emitter->Position.y;
+        Pool->VelocityX[i] = cosf(Angle) * Speed;
+        Pool->VelocityY[i] = sinf(Angle) * Speed;
+        Pool->Drag[i] = Settings->Drag;
+        Pool->Age[i] = 0.0f;
+        Pool->InverseLifetime[i] = Lifetime > 0.0f ? 1.0f / Lifetime : FLT_MAX;
+        Pool->StartSize[i] = Settings->StartSize;
+        Pool->EndSize[i] = Settings->EndSize;
+        for(u32 Channel = 0; Channel < 4; Channel++)
+        {
+            Pool->StartColor[Channel][i] = Settings->StartColor[Channel];
+            Pool->EndColor[Channel][i] = Settings->EndColor[Channel];
+        }
+    }
+
+    return Count;
+}
+
+void PT_UpdateSlice(particle_pool *Pool, u32 Slice, f32 TimeStep)
+{
+    // Four particles at a time. Slices start on a multiple of
+    // PARTICLE_SLICE_ALIGNMENT, only the last one ends in the middle of a
+    // group of four, the lanes past Count are computed and ignored.
+    u32 Begin = Pool->SliceBegin[Slice];
+    u32 End = Pool->SliceBegin[Slice + 1];
+    u32 *Dead = Pool->Dead + Begin;
+    u32 DeadCount = 0;
+
+    __m128 Step = _mm_set1_ps(TimeStep);
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 ByteScale = _mm_set1_ps(255.0f);
+    __m128 Half = _mm_set1_ps(0.5f);
+    for(u32 i = Begin; i < End; i += 4)
+    {
+        // Lifetime, T goes from 0 to 1
+        __m128 Age = _mm_add_ps(_mm_load_ps(Pool->Age + i), Step);
+        __m128 T = _mm_min_ps(_mm_mul_ps(Age, _mm_load_ps(Pool->InverseLifetime + i)), One);
+        _mm_store_ps(Pool->Age + i, Age);
+
+        // Drag is per second, then explicit Euler
+        __m128 Damping = _mm_max_ps(_mm_sub_ps(One, _mm_mul_ps(_mm_load_ps(Pool->Drag + i), Step)), Zero);
+        __m128 VelocityX = _mm_mul_ps(_mm_load_ps(Pool->VelocityX + i), Damping);
+        __m128 VelocityY = _mm_mul_ps(_mm_load_ps(Pool->VelocityY + i), Damping);
+        _mm_store_ps(Pool->VelocityX + i, VelocityX);
+        _mm_store_ps(Pool->VelocityY + i, VelocityY);
+        _mm_store_ps(Pool->PositionX + i, _mm_add_ps(_mm_load_ps(Pool->PositionX + i), _mm_mul_ps(VelocityX, Step)));
+        _mm_store_ps(Pool->PositionY + i, _mm_add_ps(_mm_load_ps(Pool->PositionY + i), _mm_mul_ps(VelocityY, Step)));
+
+        // Size and color curves
+        __m128 StartSize = _mm_load_ps(Pool->StartSize + i);
+        _mm_store_ps(Pool->Size + i, _mm_add_ps(StartSize, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(Pool->EndSize + i), StartSize), T)));
+
+        __m128i Channels[4];
+        for(u32 Channel = 0; Channel < 4; Channel++)
+        {
+            __m128 Start = _mm_load_ps(Pool->StartColor[Channel] + i);
+            __m128 Value = _mm_add_ps(Start, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(Pool->EndColor[Channel] + i), Start), T));
+            Value = _mm_min_ps(_mm_max_ps(Value, Zero), One);
+            Channels[Channel] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(Value, ByteScale), Half));
+        }
+        __m128i Color = _mm_or_si128(_mm_or_si128(Channels[0], _mm_slli_epi32(Channels[1], 8)),
+                                     _mm_or_si128(_mm_slli_epi32(Channels[2], 16), _mm_slli_epi32(Channels[3], 24)));
+        _mm_store_si128((__m128i*)(Pool->Color + i), Color);
+
+        // Particles at the end of their curves are removed after the update
+        i32 DeadMask = _mm_movemask_ps(_mm_cmpge_ps(T, One));
+        for(u32 Lane = 0; DeadMask != 0 && Lane < 4; Lane++)
+        {
+            if((DeadMask & (1 << Lane)) && i + Lane < End)
+            {
+                Dead[DeadCount++] = i + Lane;
+            }
+        }
+    }
+
+    Pool->DeadCount[Slice] = DeadCount;
+}
+
+void PT_UpdateSlices(particle_system *System)
+{
+    // Called by the main thread and the woken workers, until every slice is taken
+    for(;;)
+    {
+        // SDL_AtomicAdd returns the previous value
+        u32 Slice = (u32)SDL_AtomicAdd(&System->NextSlice, 1);
+        if(Slice >= System->SliceCount)
+        {
+            break;
+        }
+
+        for(u32 i = 0; i < System->PoolCount; i++)
+        {
+            PT_UpdateSlice(&System->Pools[i], Slice, System->TimeStep);
+        }
+    }
+}
+
+i32 SDLCALL PT_WorkerThread(void *Data)
+{
+    particle_system *System = (particle_system*)Data;
+    PF_SetThreadName("ParticleWorker");
+
+    for(;;)
+    {
+        SDL_SemWait(System->StartSemaphore);
+        if(!SDL_AtomicGet(&System->IsRunning))
+        {
+            break;
+        }
+
+        {
+            PF_SCOPE("PT_UpdateSlices");
+            PT_UpdateSlices(System);
+        }
+        SDL_SemPost(System->DoneSemaphore);
+    }
+
+    return 0;
+}
+
+void PT_MoveParticle(particle_pool *Pool, u32 From, u32 To)
+{
+    u32 *Memory = (u32*)Pool->PositionX;
+    for(u32 Array = 0; Array < PARTICLE_MOVED_ARRAY_COUNT; Array++)
+    {
+        Memory[Array * Pool->Capacity + To] = Memory[Array * Pool->Capacity + From];
+    }
+}
+
+u32 PT_RemoveDeadParticles(particle_pool *Pool, u32 SliceCount)
+{
+    // The dead lists are visited from the highest index down, so the last
+    // particle is always alive when it moves into a hole. Returns how many died.
+    u32 Result = 0;
+    for(u32 Slice = SliceCount; Slice-- > 0;)
+    {
+        u32 *Dead = Pool->Dead + Pool->SliceBegin[Slice];
+        for(u32 i = Pool->DeadCount[Slice]; i-- > 0;)
+        {
+            u32 Last = --Pool->Count;
+            if(Dead[i] != Last)
+            {
+                PT_MoveParticle(Pool, Last, Dead[i]);
+            }
+        }
+        Result += Pool->DeadCount[Slice];
+    }
+
+    return Result;
+}
+
+void PT_UpdateParticles(particle_system *System, f32 TimeStep)
+{
+    PF_SCOPE("PT_UpdateParticles");
+    Assert(System);
+
+    // 1- Spawn
+    System->SpawnedCount = 0;
+    for(u32 i = 0; i < PARTICLE_MAX_EMITTERS; i++)
+    {
+        particle_emitter *Emitter = &System->Emitters[i];
+        if(!Emitter->IsActive)
+        {
+            continue;
+        }
+
+        particle_pool *Pool = &System->Pools[Emitter->Pool];
+        if(Emitter->Mode == ParticleEmitter_Burst)
+        {
+            System->SpawnedCount += PT_Spawn(Pool, Emitter, Emitter->Settings.BurstCount);
+            Emitter->IsActive = false;
+        }
+        else
+        {
+            Emitter->SpawnAccumulator += Emitter->Settings.Rate * TimeStep;
+            u32 Count = (u32)Emitter->SpawnAccumulator;
+            Emitter->SpawnAccumulator -= (f32)Count;
+            System->SpawnedCount += PT_Spawn(Pool, Emitter, Count);
+        }
+    }
+
+    // 2- Update, one slice per thread with enough particles to be worth it
+    u32 TotalCount = 0;
+    for(u32 i = 0; i < System->PoolCount; i++)
+    {
+        TotalCount += System->Pools[i].Count;
+    }
+    u32 SliceCount = SDL_min(SDL_max(TotalCount / PARTICLE_MIN_SLICE_SIZE, 1u), System->WorkerCount + 1);
+    for(u32 i = 0; i < System->PoolCount; i++)
+    {
+        particle_pool *Pool = &System->Pools[i];
+        for(u32 Slice = 0; Slice < SliceCount; Slice++)
+        {
+            Pool->SliceBegin[Slice] = (u32)((u64)Pool->Count * Slice / SliceCount) & ~(u32)(PARTICLE_SLICE_ALIGNMENT - 1);
+        }
+        Pool->SliceBegin[SliceCount] = Pool->Count;
+    }
+
+    System->SliceCount = SliceCount;
+    System->TimeStep = TimeStep;
+    SDL_AtomicSet(&System->NextSlice, 0);
+    for(u32 i = 1; i < SliceCount; i++)
+    {
+        SDL_SemPost(System->StartSemaphore);
+    }
+    PT_UpdateSlices(System);
+    for(u32 i = 1; i < SliceCount; i++)
+    {
+        SDL_SemWait(System->DoneSemaphore);
+    }
+
+    // 3- Remove the dead particles
+    System->DiedCount = 0;
+    System->LiveCount = 0;
+    for(u32 i = 0; i < System->PoolCount; i++)
+    {
+        System->DiedCount += PT_RemoveDeadParticles(&System->Pools[i], SliceCount);
+        System->LiveCount += System->Pools[i].Count;
+    }
+    System->ThreadCount = SliceCount;
+}
+
+void PT_DrawParticles(renderer *Renderer, particle_system *System)
+{
+    // One command per pool, see R_DrawParticles. The command points at the
+    // pool arrays, they must not be updated again before R_EndFrame.
+    Assert(Renderer);
+    Assert(System);
+
+    for(u32 i = 0; i < System->PoolCount; i++)
+    {
+        particle_pool *Pool = &System->Pools[i];
+        if(Pool->Count == 0 || !Pool->Texture || !Pool->Texture->IsReady)
+        {
+            continue;
+        }
+
+        u64 Key = R_MakeSortKey(RenderLayer_World, true, Renderer->Shaders.Particle, Pool->Texture->Handle, R_GetViewDepth(Renderer, glm::vec3(0.0f)));
+        render_command_particles *Particles = (render_command_particles*)R_PushCommand(Renderer, RenderCommand_Particles, Key, sizeof(render_command_particles));
+        if(Particles)
+        {
+            Particles->Shader = Renderer->Shaders.Particle;
+            Particles->Texture = Pool->Texture;
+            Particles->Intensity = Pool->Intensity;
+            Particles->Count = Pool->Count;
+            Particles->PositionX = Pool->PositionX;
+            Particles->PositionY = Pool->PositionY;
+            Particles->Size = Pool->Size;
+            Particles->Color = Pool->Color;
+        }
+    }
+}
+
+particle_system *PT_CreateParticleSystem()
+{
+    PF_SCOPE("PT_CreateParticleSystem");
+    particle_system *Result = (particle_system*)Malloc(sizeof(particle_system)); Assert(Result);
+    Result->StartSemaphore = SDL_CreateSemaphore(0);
+    Result->DoneSemaphore = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&Result->IsRunning, 1);
+
+    // The main thread updates a slice too
+    i32 WorkerCount = SDL_GetCPUCount() - 1;
+    if(WorkerCount < 0) WorkerCount = 0;
+    if(WorkerCount > PARTICLE_MAX_WORKERS) WorkerCount = PARTICLE_MAX_WORKERS;
+    Result->WorkerCount = (u32)WorkerCount;
+
+    for(u32 i = 0; i < Result->WorkerCount; i++)
+    {
+        Result->Workers[i] = SDL_CreateThread(PT_WorkerThread, "ParticleWorker", Result);
+        Assert(Result->Workers[i]);
+    }
+
+    return Result;
+}
+
+void PT_DestroyParticleSystem(particle_system *System)
+{
+    Assert(System);
+
+    SDL_AtomicSet(&System->IsRunning, 0);
+    for(u32 i = 0; i < System->WorkerCount; i++)
+    {
+        SDL_SemPost(System->StartSemaphore);
+    }
+    for(u32 i = 0; i < System->WorkerCount; i++)
+    {
+        SDL_WaitThread(System->Workers[i], NULL);
+    }
+
+    SDL_DestroySemaphore(System->StartSemaphore);
+    SDL_DestroySemaphore(System->DoneSemaphore);
+    for(u32 i = 0; i < System->PoolCount; i++)
+    {
+        Free(System->Pools[i].PositionX);
+    }
+    Free(System);
+}
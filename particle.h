@@ -0,0 +1,126 @@
+#pragma once
+
+#include "shared.h"
+#include "renderer.h"
+
+/*
+  Particles
+
+  Particles are not entities, there are far too many of them for an
+  allocation and a draw command each. Every texture has a particle_pool
+  that stores its particles SoA in fixed arrays, the live particles are
+  always the first Count entries. Every frame PT_UpdateParticles:
+
+  1- Spawns the particles of the emitters at the end of their pool. Burst
+     emitters spawn BurstCount particles once, continuous emitters Rate
+     particles per second until they are stopped.
+  2- Splits the pools in slices that the main thread and the particle
+     workers update with SSE, four particles at a time: drag, velocity,
+     position, age, and size and color along their curves (linear from
+     Start to End over the lifetime). Particles that die are listed per slice.
+  3- Removes the dead particles on the main thread, the last live particle
+     moves into each hole so the arrays stay dense.
+
+  PT_DrawParticles pushes one RenderCommand_Particles per pool, drawn with
+  a single instanced draw and additive blending into the HDR framebuffer.
+  Every particle also writes to the brightness buffer so bloom picks them
+  up. Positions, sizes and colors are uploaded straight from the pool
+  arrays, no instance data is built.
+*/
+
+#define PARTICLE_MAX_POOLS 4
+#define PARTICLE_MAX_EMITTERS 64
+#define PARTICLE_MAX_WORKERS 8
+#define PARTICLE_MAX_SLICES (PARTICLE_MAX_WORKERS + 1) // The main thread updates a slice too
+#define PARTICLE_SLICE_ALIGNMENT 16 // Particles, slices start on their own cache line of every array
+#define PARTICLE_MIN_SLICE_SIZE 8192 // Fewer particles are not worth waking a thread for
+#define PARTICLE_DEFAULT_CAPACITY (1 << 18) // 262144 particles, 4 MB of instance data per frame
+
+enum particle_emitter_mode
+{
+    ParticleEmitter_Burst,
+    ParticleEmitter_Continuous,
+};
+
+// What an emitter spawns, every range is picked uniformly per particle
+struct particle_settings
+{
+    u32 BurstCount; // ParticleEmitter_Burst
+    f32 Rate; // ParticleEmitter_Continuous, particles per second
+
+    f32 Direction; // Degrees, 0 = +X
+    f32 Spread; // Degrees around Direction, 360 = every direction
+    f32 MinSpeed;
+    f32 MaxSpeed;
+    f32 MinLifetime; // Seconds
+    f32 MaxLifetime;
+    f32 Drag; // Fraction of the velocity lost per second
+
+    f32 StartSize;
+    f32 EndSize;
+    glm::vec4 StartColor; // 0-1, the pool's Intensity scales them into HDR
+    glm::vec4 EndColor;
+};
+
+struct particle_emitter
+{
+    b32 IsActive;
+    particle_emitter_mode Mode;
+    u32 Pool;
+    glm::vec2 Position; // Can be moved every frame
+    particle_settings Settings;
+    f32 SpawnAccumulator; // Fraction of a particle carried to the next frame
+};
+
+struct particle_pool
+{
+    texture *Texture;
+    f32 Intensity; // HDR multiplier of the colors, above 1 the particles bloom
+    u32 Capacity; // Multiple of PARTICLE_SLICE_ALIGNMENT
+    u32 Count;
+
+    // Simulation, SoA
+    f32 *PositionX;
+    f32 *PositionY;
+    f32 *VelocityX;
+    f32 *VelocityY;
+    f32 *Drag;
+    f32 *Age;
+    f32 *InverseLifetime;
+    f32 *StartSize;
+    f32 *EndSize;
+    f32 *StartColor[4];
+    f32 *EndColor[4];
+
+    // Written by the update, uploaded as instance attributes with PositionX/Y
+    f32 *Size;
+    u32 *Color; // RGBA8
+
+    // Dead particles of slice i are written from Dead[SliceBegin[i]]
+    u32 *Dead;
+    u32 SliceBegin[PARTICLE_MAX_SLICES + 1];
+    u32 DeadCount[PARTICLE_MAX_SLICES];
+};
+
+struct particle_system
+{
+    particle_pool Pools[PARTICLE_MAX_POOLS];
+    u32 PoolCount;
+    particle_emitter Emitters[PARTICLE_MAX_EMITTERS];
+
+    // Workers, woken once per update with StartSemaphore
+    SDL_Thread *Workers[PARTICLE_MAX_WORKERS];
+    u32 WorkerCount;
+    SDL_sem *StartSemaphore;
+    SDL_sem *DoneSemaphore;
+    SDL_atomic_t IsRunning;
+    SDL_atomic_t NextSlice;
+    u32 SliceCount; // Of the current update
+    f32 TimeStep;
+
+    // Stats of the last update, shown in the debug overlay
+    u32 LiveCount;
+    u32 SpawnedCount;
+    u32 DiedCount;
+    u32 ThreadCount;
+};
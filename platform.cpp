@@ -2,6 +2,14 @@
 
 #include "shared.h"
 #include "platform.h"
+#include "profiler.h"
+#include <emmintrin.h> // _mm_pause, the frame limiter spins on the performance counter
+
+#if HEADLESS
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 clock *P_CreateClock()
 {
@@ -23,6 +31,11 @@ void P_UpdateClock(clock *Clock)
     Clock->SecondsElapsed += Clock->DeltaTime;
 }
 
+f64 P_GetSecondsElapsed(u64 Start, u64 End)
+{
+    return (f64)(End - Start) / (f64)SDL_GetPerformanceFrequency();
+}
+
 void P_ToggleFullscreen(window *Window)
 {
     u32 WindowFlags = SDL_GetWindowFlags(Window->Handle);
@@ -42,6 +55,7 @@ void P_ToggleFullscreen(window *Window)
 
 window *P_CreateOpenGLWindow(char *Title, u32 Width, u32 Height)
 {
+    PF_SCOPE("P_CreateOpenGLWindow");
     window *Result = NULL;
     Result = (window*)Malloc(sizeof(window));
     Result->Width = Width;
@@ -53,8 +67,10 @@ window *P_CreateOpenGLWindow(char *Title, u32 Width, u32 Height)
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 8);
+    // NOTE: The default framebuffer only receives the fullscreen composite,
+    // it is never multisampled. See anti_aliasing_mode in renderer.h
+    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 0);
+    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 0);
 #if DEBUG
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
 #endif
@@ -96,7 +112,234 @@ window *P_CreateOpenGLWindow(char *Title, u32 Width, u32 Height)
         exit(-4);
     }
 
-    SDL_GL_SetSwapInterval(1);
+    // NOTE: The swap interval is set by the frame pacer, see P_SetFramePacing
+    return (Result);
+}
+
+window *P_CreateHeadlessWindow(u32 Width, u32 Height)
+{
+    // Returns NULL when there is no surfaceless EGL display or no GL 3.3 context
+    PF_SCOPE("P_CreateHeadlessWindow");
+#if HEADLESS
+    PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay Display = EGL_NO_DISPLAY;
+    if(GetPlatformDisplay)
+    {
+        Display = GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    EGLint Major;
+    EGLint Minor;
+    if(Display == EGL_NO_DISPLAY || !eglInitialize(Display, &Major, &Minor))
+    {
+        printf("No surfaceless EGL display (EGL_MESA_platform_surfaceless)\n");
+        return NULL;
+    }
+
+    // NOTE: Surfaceless displays have no window configs, the default EGL_SURFACE_TYPE (EGL_WINDOW_BIT) matches none
+    EGLint ConfigAttributes[] =
+    {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE,
+    };
+    EGLConfig Config;
+    EGLint ConfigCount = 0;
+    if(!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(Display, ConfigAttributes, &Config, 1, &ConfigCount) || ConfigCount == 0)
+    {
+        printf("No EGL config for desktop OpenGL\n");
+        eglTerminate(Display);
+        return NULL;
+    }
+
+    // Same profile as the window, core when the driver has no compatibility 3.3
+    EGLint ContextAttributes[] =
+    {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE,
+    };
+    EGLContext Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, ContextAttributes);
+    if(Context == EGL_NO_CONTEXT)
+    {
+        ContextAttributes[5] = EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT;
+        Context = eglCreateContext(Display, Config, EGL_NO_CONTEXT, ContextAttributes);
+    }
+    if(Context == EGL_NO_CONTEXT || !eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context))
+    {
+        printf("Could not create a surfaceless OpenGL 3.3 context (EGL error 0x%x)\n", eglGetError());
+        eglTerminate(Display);
+        return NULL;
+    }
+
+    if(!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        printf("gladLoadGLLoader failed\n");
+        eglTerminate(Display);
+        return NULL;
+    }
+
+    window *Result = (window*)Malloc(sizeof(window));
+    Result->Width = (i32)Width;
+    Result->Height = (i32)Height;
+    Result->IsHeadless = true;
+    Result->EGLDisplay = Display;
+    Result->EGLContext = Context;
+    printf("Headless EGL %d.%d: %s\n", Major, Minor, (char*)glGetString(GL_RENDERER));
 
     return (Result);
+#else
+    (void)Width;
+    (void)Height;
+    printf("Headless rendering needs a build with -DHEADLESS\n");
+    return NULL;
+#endif
+}
+
+void P_DestroyHeadlessWindow(window *Window)
+{
+#if HEADLESS
+    eglMakeCurrent(Window->EGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(Window->EGLDisplay, Window->EGLContext);
+    eglTerminate(Window->EGLDisplay);
+#endif
+    Free(Window);
+}
+
+char *P_GetFramePacingName(frame_pacing_mode Mode)
+{
+    switch(Mode)
+    {
+        case FramePacing_VSync: return "VSync";
+        case FramePacing_AdaptiveVSync: return "Adaptive VSync";
+        case FramePacing_Limiter: return "Limiter";
+        case FramePacing_Uncapped: return "Uncapped";
+        default: return "Unknown";
+    }
+}
+
+void P_SetFramePacing(frame_pacer *Pacer, frame_pacing_mode Mode)
+{
+    Pacer->Mode = Mode;
+    Pacer->ActiveMode = Mode;
+    f64 LimiterFPS = Pacer->TargetFPS;
+
+    if(Pacer->ActiveMode == FramePacing_AdaptiveVSync &&
+       (!Pacer->HasSwapInterval || SDL_GL_SetSwapInterval(-1) != 0))
+    {
+        Pacer->ActiveMode = FramePacing_VSync;
+    }
+    if(Pacer->ActiveMode == FramePacing_VSync &&
+       (!Pacer->HasSwapInterval || SDL_GL_SetSwapInterval(1) != 0))
+    {
+        Pacer->ActiveMode = FramePacing_Limiter;
+        LimiterFPS = Pacer->RefreshRate > 0.0 ? Pacer->RefreshRate : FRAME_PACING_DEFAULT_FPS;
+    }
+    if((Pacer->ActiveMode == FramePacing_Limiter || Pacer->ActiveMode == FramePacing_Uncapped) && Pacer->HasSwapInterval)
+    {
+        SDL_GL_SetSwapInterval(0);
+    }
+
+    Pacer->FrameTicks = (u64)((f64)Pacer->Frequency / LimiterFPS);
+    Pacer->Deadline = 0;
+    Pacer->HistoryCount = 0;
+    Pacer->HistoryIndex = 0;
+}
+
+frame_pacer *P_CreateFramePacer(window *Window, frame_pacing_mode Mode, f64 TargetFPS)
+{
+    // TargetFPS 0 limits to the display refresh rate
+    frame_pacer *Result = (frame_pacer*)Malloc(sizeof(frame_pacer)); Assert(Result);
+    Result->Frequency = SDL_GetPerformanceFrequency();
+    Result->HasSwapInterval = !Window->IsHeadless;
+    Result->SleepMarginMs = FRAME_PACING_MAX_SLEEP_MARGIN_MS;
+
+    SDL_DisplayMode DisplayMode = {};
+    if(!Window->IsHeadless && SDL_GetWindowDisplayMode(Window->Handle, &DisplayMode) == 0)
+    {
+        Result->RefreshRate = (f64)DisplayMode.refresh_rate;
+    }
+    Result->TargetFPS = TargetFPS > 0.0 ? TargetFPS :
+                        Result->RefreshRate > 0.0 ? Result->RefreshRate : FRAME_PACING_DEFAULT_FPS;
+
+    P_SetFramePacing(Result, Mode);
+    return Result;
+}
+
+void P_WaitForNextFrame(frame_pacer *Pacer)
+{
+    // Returns when the next frame may start, then updates the pacing stats
+    PF_SCOPE("P_WaitForNextFrame");
+    u64 Begin = SDL_GetPerformanceCounter();
+    u64 Now = Begin;
+    Pacer->SpinMs = 0.0f;
+
+    if(Pacer->ActiveMode == FramePacing_Limiter)
+    {
+        if(Pacer->Deadline == 0 || Now > Pacer->Deadline + Pacer->FrameTicks)
+        {
+            // First frame, or more than a frame late: start the cadence
+            // again from now instead of rushing frames to catch up
+            Pacer->Deadline = Now;
+        }
+
+        f64 RemainingMs = Pacer->Deadline > Now ? P_GetSecondsElapsed(Now, Pacer->Deadline) * 1000.0 : 0.0;
+        if(RemainingMs >= Pacer->SleepMarginMs + 1.0) // SDL_Delay sleeps whole milliseconds
+        {
+            u32 SleepMs = (u32)(RemainingMs - Pacer->SleepMarginMs);
+            SDL_Delay(SleepMs);
+            Now = SDL_GetPerformanceCounter();
+
+            // The margin grows at once when SDL_Delay wakes up late and
+            // shrinks slowly, one late wake up must not spin every frame
+            f64 OversleepMs = P_GetSecondsElapsed(Begin, Now) * 1000.0 - (f64)SleepMs;
+            if(OversleepMs > Pacer->SleepMarginMs)
+            {
+                Pacer->SleepMarginMs = OversleepMs;
+            }
+            else
+            {
+                Pacer->SleepMarginMs += (OversleepMs - Pacer->SleepMarginMs) * 0.01;
+            }
+            Pacer->SleepMarginMs = SDL_max(SDL_min(Pacer->SleepMarginMs, FRAME_PACING_MAX_SLEEP_MARGIN_MS), FRAME_PACING_MIN_SLEEP_MARGIN_MS);
+        }
+
+        u64 SpinBegin = Now;
+        while(Now < Pacer->Deadline)
+        {
+            _mm_pause();
+            Now = SDL_GetPerformanceCounter();
+        }
+        Pacer->SpinMs = (f32)(P_GetSecondsElapsed(SpinBegin, Now) * 1000.0);
+        Pacer->Deadline += Pacer->FrameTicks;
+    }
+    Pacer->WaitMs = (f32)(P_GetSecondsElapsed(Begin, Now) * 1000.0);
+
+    if(Pacer->LastFrameBegin)
+    {
+        f32 IntervalMs = (f32)(P_GetSecondsElapsed(Pacer->LastFrameBegin, Now) * 1000.0);
+        Pacer->IntervalMs = IntervalMs;
+        Pacer->Intervals[Pacer->HistoryIndex] = IntervalMs;
+        Pacer->HistoryIndex = (Pacer->HistoryIndex + 1) % FRAME_PACING_HISTORY;
+        Pacer->HistoryCount = SDL_min(Pacer->HistoryCount + 1, FRAME_PACING_HISTORY);
+
+        f32 TotalMs = 0.0f;
+        f32 WorstMs = 0.0f;
+        for(u32 i = 0; i < Pacer->HistoryCount; i++)
+        {
+            TotalMs += Pacer->Intervals[i];
+            WorstMs = SDL_max(WorstMs, Pacer->Intervals[i]);
+        }
+        f32 AvgMs = TotalMs / (f32)Pacer->HistoryCount;
+        f32 Variance = 0.0f;
+        for(u32 i = 0; i < Pacer->HistoryCount; i++)
+        {
+            f32 Deviation = Pacer->Intervals[i] - AvgMs;
+            Variance += Deviation * Deviation;
+        }
+        Pacer->AvgIntervalMs = AvgMs;
+        Pacer->JitterMs = sqrtf(Variance / (f32)Pacer->HistoryCount);
+        Pacer->WorstIntervalMs = WorstMs;
+    }
+    Pacer->LastFrameBegin = Now;
 }
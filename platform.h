@@ -1,12 +1,27 @@
 #pragma once
 
+/*
+  Headless
+
+  P_CreateHeadlessWindow creates a GL 3.3 context without a display or a
+  window: EGL on the Mesa surfaceless platform (EGL_MESA_platform_surfaceless),
+  so it runs on llvmpipe/softpipe on machines without a GPU. The renderer
+  draws into its output framebuffer instead of the default one and
+  never swaps. Only compiled with -DHEADLESS (links against libEGL), see
+  headless.h.
+*/
+
 struct window
 {
-    SDL_Window *Handle;
+    SDL_Window *Handle; // NULL when headless
     SDL_GLContext Context;
 
     i32 Width;
     i32 Height;
+
+    b32 IsHeadless;
+    void *EGLDisplay;
+    void *EGLContext;
 };
 
 struct clock
@@ -16,3 +31,68 @@ struct clock
     f64 DeltaTime;
     f64 SecondsElapsed;
 };
+
+/*
+  Frame pacing
+
+  P_WaitForNextFrame is called at the top of the main loop, before the
+  clock is updated. Modes:
+
+      VSync          SDL_GL_SetSwapInterval(1), the swap waits for the display.
+      Adaptive VSync SDL_GL_SetSwapInterval(-1), a late frame is shown right
+                     away (tears) instead of waiting a whole refresh. Falls
+                     back to VSync when the driver does not support it.
+      Limiter        No VSync, frames start every 1/TargetFPS seconds: sleep
+                     with SDL_Delay until SleepMarginMs before the deadline,
+                     then spin on the performance counter. The margin follows
+                     how late SDL_Delay wakes up on this machine.
+      Uncapped       No VSync and no wait, for benchmarks and headless runs.
+
+  The VSync modes fall back to the limiter at the display refresh rate
+  when the swap interval can not be set. Jitter is the standard deviation
+  of the time between frame starts over the last FRAME_PACING_HISTORY
+  frames, the present latency is measured by the renderer (see gpu_profiler).
+*/
+
+#define FRAME_PACING_HISTORY 128
+#define FRAME_PACING_DEFAULT_FPS 60.0 // Limiter target when the display refresh rate is unknown
+#define FRAME_PACING_MIN_SLEEP_MARGIN_MS 0.5
+#define FRAME_PACING_MAX_SLEEP_MARGIN_MS 4.0
+
+enum frame_pacing_mode
+{
+    FramePacing_VSync,
+    FramePacing_AdaptiveVSync,
+    FramePacing_Limiter,
+    FramePacing_Uncapped,
+
+    FramePacing_Count,
+};
+
+struct frame_pacer
+{
+    frame_pacing_mode Mode; // Requested
+    frame_pacing_mode ActiveMode; // After the fallbacks
+    f64 TargetFPS; // Of the limiter
+    f64 RefreshRate; // Of the display, 0 when unknown
+    b32 HasSwapInterval; // False when headless
+
+    u64 Frequency;
+    u64 FrameTicks; // 1 / TargetFPS
+    u64 Deadline; // Earliest start of the next frame, limiter only
+    f64 SleepMarginMs;
+
+    // Last frame
+    u64 LastFrameBegin;
+    f32 WaitMs; // Slept and spun by the limiter
+    f32 SpinMs;
+
+    // Time between frame starts
+    f32 Intervals[FRAME_PACING_HISTORY];
+    u32 HistoryIndex;
+    u32 HistoryCount;
+    f32 IntervalMs;
+    f32 AvgIntervalMs;
+    f32 JitterMs;
+    f32 WorstIntervalMs;
+};
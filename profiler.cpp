@@ -0,0 +1,432 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "shared.h"
+#include "profiler.h"
+
+#if PROFILER_ENABLED
+
+global profiler Profiler__;
+global thread_local profiler_thread *ProfilerThread__ = NULL;
+global thread_local b32 ProfilerThreadRejected__ = false; // Every ring buffer was taken
+
+void PF_Initialize()
+{
+    Profiler__.Frequency = SDL_GetPerformanceFrequency();
+    Profiler__.FrameBegin = SDL_GetPerformanceCounter();
+}
+
+profiler_thread *PF_GetThread(const char *Name)
+{
+    // Claims a ring buffer the first time a thread writes an event. The
+    // count never goes past PROFILER_MAX_THREADS, the main thread loops on it
+    if(!ProfilerThread__ && !ProfilerThreadRejected__)
+    {
+        i32 Index;
+        do
+        {
+            Index = SDL_AtomicGet(&Profiler__.ThreadCount);
+            if(Index >= PROFILER_MAX_THREADS)
+            {
+                ProfilerThreadRejected__ = true;
+                return NULL;
+            }
+        } while(!SDL_AtomicCAS(&Profiler__.ThreadCount, Index, Index + 1));
+
+        ProfilerThread__ = &Profiler__.Threads[Index];
+        ProfilerThread__->ID = SDL_ThreadID();
+        ProfilerThread__->Name = Name;
+    }
+    return ProfilerThread__;
+}
+
+u32 PF_GetThreadCount()
+{
+    u32 Result = (u32)SDL_AtomicGet(&Profiler__.ThreadCount);
+    return SDL_min(Result, PROFILER_MAX_THREADS);
+}
+
+void PF_SetThreadName(const char *Name)
+{
+    profiler_thread *Thread = PF_GetThread(Name);
+    if(Thread)
+    {
+        Thread->Name = Name;
+    }
+}
+
+u32 PF_RegisterZone(const char *Name, b32 IsCounter)
+{
+    // Call sites with the same name share a zone
+    SDL_AtomicLock(&Profiler__.ZoneLock);
+    u32 Result = PROFILER_MAX_ZONES;
+    for(u32 i = 0; i < Profiler__.ZoneCount; i++)
+    {
+        if(strcmp(Profiler__.Zones[i].Name, Name) == 0)
+        {
+            Result = i;
+            break;
+        }
+    }
+    if(Result == PROFILER_MAX_ZONES)
+    {
+        if(Profiler__.ZoneCount < PROFILER_MAX_ZONES)
+        {
+            Result = Profiler__.ZoneCount++;
+            Profiler__.Zones[Result].Name = Name;
+            Profiler__.Zones[Result].IsCounter = IsCounter;
+        }
+        else
+        {
+            Result = PROFILER_MAX_ZONES - 1; // Zones past the limit are added to the last one
+        }
+    }
+    SDL_AtomicUnlock(&Profiler__.ZoneLock);
+
+    return Result;
+}
+
+void PF_WriteEvent(u32 Zone, profiler_event_type Type, i64 Value)
+{
+    profiler_thread *Thread = PF_GetThread("Thread");
+    if(!Thread)
+    {
+        return;
+    }
+
+    u32 WriteCount = (u32)SDL_AtomicGet(&Thread->WriteCount);
+    profiler_event *Event = &Thread->Events[WriteCount % PROFILER_RING_SIZE];
+    Event->Timestamp = SDL_GetPerformanceCounter();
+    Event->Zone = Zone;
+    Event->Type = Type;
+    Event->Value = Value;
+    // NOTE: SDL_AtomicSet is a full barrier, the event is written before the count
+    SDL_AtomicSet(&Thread->WriteCount, (i32)(WriteCount + 1));
+}
+
+int PF_CompareF32(const void *A, const void *B)
+{
+    f32 First = *(const f32 *)A;
+    f32 Second = *(const f32 *)B;
+    return (First > Second) - (First < Second);
+}
+
+void PF_UpdateStats(profiler_stats *Stats, f32 *History, u32 Count, f32 LastMs)
+{
+    // Percentiles of the last Count frames, nearest rank
+    f32 Sorted[PROFILER_HISTORY];
+    f32 TotalMs = 0.0f;
+    for(u32 i = 0; i < Count; i++)
+    {
+        Sorted[i] = History[i];
+        TotalMs += History[i];
+    }
+    qsort(Sorted, Count, sizeof(f32), PF_CompareF32);
+
+    Stats->LastMs = LastMs;
+    Stats->AvgMs = TotalMs / (f32)Count;
+    Stats->P50Ms = Sorted[(Count * 50 + 99) / 100 - 1];
+    Stats->P95Ms = Sorted[(Count * 95 + 99) / 100 - 1];
+    Stats->P99Ms = Sorted[(Count * 99 + 99) / 100 - 1];
+    Stats->WorstMs = Sorted[Count - 1];
+}
+
+void PF_AddTraceEvent(trace_event_type Type, u32 Zone, u32 Thread, u64 Begin, u64 End, i64 Value)
+{
+    trace_capture *Capture = Profiler__.Capture;
+    if(!Capture || Begin < Capture->BeginTimestamp)
+    {
+        return;
+    }
+    if(Capture->EventCount == TRACE_MAX_EVENTS)
+    {
+        Capture->DroppedEvents++;
+        return;
+    }
+
+    trace_event *Event = &Capture->Events[Capture->EventCount++];
+    Event->Begin = Begin;
+    Event->End = End;
+    Event->Value = Value;
+    Event->Zone = Zone;
+    Event->Thread = (u16)Thread;
+    Event->Type = (u16)Type;
+}
+
+void PF_ReadThreadEvents(profiler_thread *Thread, u32 ThreadIndex)
+{
+    u32 WriteCount = (u32)SDL_AtomicGet(&Thread->WriteCount);
+
+    // NOTE: Leave half of the ring between us and the writer, events
+    // older than that may be overwritten while we read them. The open
+    // zones of the lost events can not be matched anymore.
+    if(WriteCount - Thread->ReadCount > PROFILER_RING_SIZE / 2)
+    {
+        u32 NewReadCount = WriteCount - PROFILER_RING_SIZE / 2;
+        Thread->LostEvents += NewReadCount - Thread->ReadCount;
+        Thread->ReadCount = NewReadCount;
+        Thread->Depth = 0;
+    }
+
+    for(; Thread->ReadCount != WriteCount; Thread->ReadCount++)
+    {
+        profiler_event *Event = &Thread->Events[Thread->ReadCount % PROFILER_RING_SIZE];
+        if(Event->Type == ProfilerEvent_Counter)
+        {
+            PF_AddTraceEvent(TraceEvent_Counter, Event->Zone, ThreadIndex, Event->Timestamp, Event->Timestamp, Event->Value);
+        }
+        else if(Event->Type == ProfilerEvent_Begin)
+        {
+            if(Thread->Depth < PROFILER_MAX_DEPTH)
+            {
+                Thread->OpenZones[Thread->Depth] = Event->Zone;
+                Thread->OpenTimestamps[Thread->Depth] = Event->Timestamp;
+            }
+            Thread->Depth++;
+        }
+        else if(Thread->Depth > 0)
+        {
+            Thread->Depth--;
+            if(Thread->Depth < PROFILER_MAX_DEPTH)
+            {
+                profiler_zone *Zone = &Profiler__.Zones[Thread->OpenZones[Thread->Depth]];
+                u64 Elapsed = Event->Timestamp - Thread->OpenTimestamps[Thread->Depth];
+                Zone->FrameMs += (f32)((f64)Elapsed * 1000.0 / (f64)Profiler__.Frequency);
+                Zone->FrameHits++;
+                Zone->Depth = Thread->Depth;
+
+                PF_AddTraceEvent(TraceEvent_Zone, Thread->OpenZones[Thread->Depth], ThreadIndex,
+                                 Thread->OpenTimestamps[Thread->Depth], Event->Timestamp, 0);
+            }
+        }
+    }
+}
+
+void PF_TraceWrite(trace_writer *Writer, const char *Format, ...)
+{
+    // Formats into the write buffer, flushes it to the file when it is full
+    for(u32 Attempt = 0; Attempt < 2; Attempt++)
+    {
+        va_list Args;
+        va_start(Args, Format);
+        size_t Available = TRACE_WRITE_BUFFER_SIZE - Writer->Used;
+        i32 Length = SDL_vsnprintf(Writer->Buffer + Writer->Used, Available, Format, Args);
+        va_end(Args);
+
+        if(Length >= 0 && (size_t)Length < Available)
+        {
+            Writer->Used += (size_t)Length;
+            return;
+        }
+        SDL_RWwrite(Writer->File, Writer->Buffer, 1, Writer->Used);
+        Writer->Used = 0;
+    }
+}
+
+void PF_WriteTrace(trace_capture *Capture)
+{
+    trace_writer Writer = {};
+    Writer.File = SDL_RWFromFile(Capture->Filename, "wb");
+    if(!Writer.File)
+    {
+        printf("Could not write trace %s: %s\n", Capture->Filename, SDL_GetError());
+        return;
+    }
+    Writer.Buffer = (char *)malloc(TRACE_WRITE_BUFFER_SIZE);
+
+    // Chrome trace-event format, timestamps are microseconds from the start of the capture
+    f64 ToMicroseconds = 1000000.0 / (f64)Capture->Frequency;
+    PF_TraceWrite(&Writer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    PF_TraceWrite(&Writer, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Glow\"}}");
+    for(u32 i = 0; i < Capture->ThreadCount; i++)
+    {
+        PF_TraceWrite(&Writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                      i + 1, Capture->ThreadNames[i]);
+    }
+
+    for(u32 i = 0; i < Capture->EventCount; i++)
+    {
+        trace_event *Event = &Capture->Events[i];
+        f64 Timestamp = (f64)(Event->Begin - Capture->BeginTimestamp) * ToMicroseconds;
+        f64 Duration = (f64)(Event->End - Event->Begin) * ToMicroseconds;
+        switch(Event->Type)
+        {
+            case TraceEvent_Zone:
+            {
+                PF_TraceWrite(&Writer, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                              Capture->ZoneNames[Event->Zone], Timestamp, Duration, Event->Thread + 1);
+            } break;
+            case TraceEvent_Counter:
+            {
+                PF_TraceWrite(&Writer, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"value\":%lld}}",
+                              Capture->ZoneNames[Event->Zone], Timestamp, (long long)Event->Value);
+            } break;
+            case TraceEvent_Frame:
+            {
+                PF_TraceWrite(&Writer, ",\n{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                              Timestamp, Duration, Event->Thread + 1);
+                PF_TraceWrite(&Writer, ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                              Timestamp, Event->Thread + 1);
+            } break;
+        }
+    }
+    PF_TraceWrite(&Writer, "\n]}\n");
+
+    SDL_RWwrite(Writer.File, Writer.Buffer, 1, Writer.Used);
+    SDL_RWclose(Writer.File);
+    free(Writer.Buffer);
+
+    printf("Trace written to %s, %u events", Capture->Filename, Capture->EventCount);
+    if(Capture->DroppedEvents)
+    {
+        printf(", %u dropped", Capture->DroppedEvents);
+    }
+    printf("\n");
+}
+
+i32 SDLCALL PF_TraceWriterThread(void *Data)
+{
+    // NOTE: Owns the capture from here on, malloc/free are thread safe, Malloc's counter is not
+    trace_capture *Capture = (trace_capture *)Data;
+    PF_WriteTrace(Capture);
+    free(Capture->Events);
+    free(Capture);
+    return 0;
+}
+
+b32 PF_BeginCapture(u32 FrameCount, const char *Filename)
+{
+    // FrameCount 0 captures until PF_EndCapture
+    if(Profiler__.Capture)
+    {
+        return false;
+    }
+
+    trace_capture *Capture = (trace_capture *)calloc(1, sizeof(trace_capture));
+    Capture->Events = (trace_event *)malloc(TRACE_MAX_EVENTS * sizeof(trace_event));
+    if(!Capture->Events)
+    {
+        free(Capture);
+        return false;
+    }
+    SDL_strlcpy(Capture->Filename, Filename, sizeof(Capture->Filename));
+    Capture->Frequency = Profiler__.Frequency;
+    Capture->BeginTimestamp = SDL_GetPerformanceCounter();
+    Capture->FramesLeft = FrameCount;
+
+    Profiler__.Capture = Capture;
+    Profiler__.StopCapture = false;
+    return true;
+}
+
+void PF_EndCapture()
+{
+    // The capture stops at the end of this frame, once the events are read
+    Profiler__.StopCapture = true;
+}
+
+void PF_FinishCapture()
+{
+    trace_capture *Capture = Profiler__.Capture;
+    Profiler__.Capture = NULL;
+    Profiler__.StopCapture = false;
+
+    SDL_AtomicLock(&Profiler__.ZoneLock);
+    for(u32 i = 0; i < Profiler__.ZoneCount; i++)
+    {
+        Capture->ZoneNames[i] = Profiler__.Zones[i].Name;
+    }
+    SDL_AtomicUnlock(&Profiler__.ZoneLock);
+    Capture->ThreadCount = PF_GetThreadCount();
+    for(u32 i = 0; i < Capture->ThreadCount; i++)
+    {
+        Capture->ThreadNames[i] = Profiler__.Threads[i].Name;
+    }
+
+    SDL_Thread *Thread = SDL_CreateThread(PF_TraceWriterThread, "TraceWriter", Capture);
+    if(Thread)
+    {
+        SDL_DetachThread(Thread);
+    }
+    else
+    {
+        PF_TraceWriterThread(Capture);
+    }
+}
+
+b32 PF_IsCapturing()
+{
+    return Profiler__.Capture != NULL;
+}
+
+void PF_EndFrame()
+{
+    // Called once per frame by the main thread, after the frame is presented
+    u64 Now = SDL_GetPerformanceCounter();
+    u64 FrameBegin = Profiler__.FrameBegin;
+    f32 FrameMs = (f32)((f64)(Now - FrameBegin) * 1000.0 / (f64)Profiler__.Frequency);
+    Profiler__.FrameBegin = Now;
+
+    u32 ThreadCount = PF_GetThreadCount();
+    for(u32 i = 0; i < ThreadCount; i++)
+    {
+        PF_ReadThreadEvents(&Profiler__.Threads[i], i);
+    }
+
+    if(Profiler__.Capture)
+    {
+        // Frames that started before the capture are cut at its start
+        u64 Begin = SDL_max(FrameBegin, Profiler__.Capture->BeginTimestamp);
+        u32 MainThread = (u32)(ProfilerThread__ ? ProfilerThread__ - Profiler__.Threads : 0);
+        PF_AddTraceEvent(TraceEvent_Frame, 0, MainThread, Begin, Now, 0);
+
+        if(Profiler__.Capture->FramesLeft > 0 && --Profiler__.Capture->FramesLeft == 0)
+        {
+            Profiler__.StopCapture = true;
+        }
+        if(Profiler__.StopCapture)
+        {
+            PF_FinishCapture();
+        }
+    }
+
+    u32 HistoryIndex = Profiler__.HistoryIndex;
+    Profiler__.HistoryIndex = (Profiler__.HistoryIndex + 1) % PROFILER_HISTORY;
+    Profiler__.HistoryCount = SDL_min(Profiler__.HistoryCount + 1, PROFILER_HISTORY);
+
+    SDL_AtomicLock(&Profiler__.ZoneLock);
+    u32 ZoneCount = Profiler__.ZoneCount;
+    SDL_AtomicUnlock(&Profiler__.ZoneLock);
+    for(u32 i = 0; i < ZoneCount; i++)
+    {
+        profiler_zone *Zone = &Profiler__.Zones[i];
+        Zone->History[HistoryIndex] = Zone->FrameMs;
+        Zone->Hits = Zone->FrameHits;
+        PF_UpdateStats(&Zone->Stats, Zone->History, Profiler__.HistoryCount, Zone->FrameMs);
+        Zone->FrameMs = 0.0f;
+        Zone->FrameHits = 0;
+    }
+
+    Profiler__.FrameHistory[HistoryIndex] = FrameMs;
+    PF_UpdateStats(&Profiler__.FrameStats, Profiler__.FrameHistory, Profiler__.HistoryCount, FrameMs);
+}
+
+profiler *PF_GetProfiler()
+{
+    return &Profiler__;
+}
+
+f32 PF_GetFrameMs(u32 FramesAgo)
+{
+    // CPU time of a previous frame, 0 is the last one, for the frame-time graph
+    if(FramesAgo >= Profiler__.HistoryCount)
+    {
+        return 0.0f;
+    }
+    u32 Index = (Profiler__.HistoryIndex + PROFILER_HISTORY - 1 - FramesAgo) % PROFILER_HISTORY;
+    return Profiler__.FrameHistory[Index];
+}
+
+#endif
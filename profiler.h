@@ -0,0 +1,204 @@
+#pragma once
+
+#include "shared.h"
+
+/*
+  CPU profiler
+
+  PF_SCOPE("Name") times the rest of the enclosing block. Every thread
+  writes begin/end events into its own ring buffer without locks, once a
+  frame PF_EndFrame (main thread) matches them into per zone times and
+  keeps the last PROFILER_HISTORY frames of every zone and of the whole
+  frame, with p50/p95/p99 and the worst frame. Zones can be nested, the
+  time of a zone includes its children.
+
+  PF_BeginCapture also copies the zones, PF_COUNTER values and frame
+  boundaries of the next frames into a trace buffer. PF_EndFrame is the
+  only writer, once the capture ends a writer thread saves it as a
+  Chrome trace-event JSON file (chrome://tracing, ui.perfetto.dev) and
+  the game keeps going.
+
+  Only compiled in DEBUG or PROFILE builds, otherwise PF_SCOPE and the
+  rest of the calls expand to nothing.
+*/
+
+#if DEBUG || PROFILE
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+
+#define PROFILER_MAX_THREADS 16 // Main, asset and particle workers, capture writer
+#define PROFILER_MAX_ZONES 64
+#define PROFILER_RING_SIZE 4096 // Events per thread
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_HISTORY 240 // Frames, 4 seconds at 60 fps
+#define TRACE_MAX_EVENTS (1 << 18) // Per capture, 32 byte trace_event, 8MB
+#define TRACE_DEFAULT_FRAMES 300 // Captured by the F4 hotkey
+#define TRACE_WRITE_BUFFER_SIZE Kilobytes(64)
+
+#if PROFILER_ENABLED
+
+enum profiler_event_type
+{
+    ProfilerEvent_Begin,
+    ProfilerEvent_End,
+    ProfilerEvent_Counter,
+};
+
+struct profiler_event
+{
+    u64 Timestamp; // SDL_GetPerformanceCounter
+    u32 Zone;
+    u32 Type; // profiler_event_type
+    i64 Value; // Counters only
+};
+
+struct profiler_thread
+{
+    SDL_threadID ID;
+    const char *Name;
+
+    // Written only by the owner thread, WriteCount is published after the event
+    profiler_event Events[PROFILER_RING_SIZE];
+    SDL_atomic_t WriteCount;
+
+    // Only touched by PF_EndFrame
+    u32 ReadCount;
+    u32 OpenZones[PROFILER_MAX_DEPTH];
+    u64 OpenTimestamps[PROFILER_MAX_DEPTH];
+    u32 Depth;
+    u32 LostEvents; // The thread wrote faster than PF_EndFrame read
+};
+
+struct profiler_stats
+{
+    f32 LastMs;
+    f32 AvgMs;
+    f32 P50Ms;
+    f32 P95Ms;
+    f32 P99Ms;
+    f32 WorstMs;
+};
+
+struct profiler_zone
+{
+    const char *Name;
+    b32 IsCounter; // Registered by PF_COUNTER, has no time
+    u32 Depth; // Nesting depth it was last closed at
+    u32 Hits; // Times it was closed last frame
+
+    f32 FrameMs; // Accumulated while matching events
+    u32 FrameHits;
+    f32 History[PROFILER_HISTORY];
+    profiler_stats Stats;
+};
+
+enum trace_event_type
+{
+    TraceEvent_Zone,
+    TraceEvent_Counter,
+    TraceEvent_Frame,
+};
+
+struct trace_event
+{
+    u64 Begin;
+    u64 End; // Zones and frames
+    i64 Value; // Counters
+    u32 Zone;
+    u16 Thread;
+    u16 Type; // trace_event_type
+};
+
+struct trace_capture
+{
+    char Filename[256];
+    u64 Frequency;
+    u64 BeginTimestamp; // Events that started before are not captured
+    u32 FramesLeft; // 0 captures until PF_EndCapture
+
+    trace_event *Events;
+    u32 EventCount;
+    u32 DroppedEvents; // Did not fit in TRACE_MAX_EVENTS
+
+    // Copied when the capture ends, the writer thread never touches the profiler
+    const char *ZoneNames[PROFILER_MAX_ZONES];
+    const char *ThreadNames[PROFILER_MAX_THREADS];
+    u32 ThreadCount;
+};
+
+struct trace_writer
+{
+    SDL_RWops *File;
+    char *Buffer;
+    size_t Used;
+};
+
+struct profiler
+{
+    u64 Frequency;
+    u64 FrameBegin;
+
+    profiler_thread Threads[PROFILER_MAX_THREADS];
+    SDL_atomic_t ThreadCount;
+
+    profiler_zone Zones[PROFILER_MAX_ZONES];
+    u32 ZoneCount;
+    SDL_SpinLock ZoneLock;
+
+    // CPU time of whole frames, PF_EndFrame to PF_EndFrame
+    f32 FrameHistory[PROFILER_HISTORY];
+    profiler_stats FrameStats;
+    u32 HistoryIndex; // Next frame is written here
+    u32 HistoryCount;
+
+    // Trace capture, only touched by the main thread
+    trace_capture *Capture;
+    b32 StopCapture;
+};
+
+void PF_WriteEvent(u32 Zone, profiler_event_type Type, i64 Value);
+u32 PF_RegisterZone(const char *Name, b32 IsCounter = false);
+
+struct profiler_scope
+{
+    u32 Zone;
+
+    profiler_scope(u32 ZoneIndex)
+    {
+        Zone = ZoneIndex;
+        PF_WriteEvent(Zone, ProfilerEvent_Begin, 0);
+    }
+
+    ~profiler_scope()
+    {
+        PF_WriteEvent(Zone, ProfilerEvent_End, 0);
+    }
+};
+
+#define PF_CONCAT_(A, B) A##B
+#define PF_CONCAT(A, B) PF_CONCAT_(A, B)
+// NOTE: The zone is registered once per call site, the first time it runs
+#define PF_SCOPE(Name)                                                  \
+    static u32 PF_CONCAT(ProfilerZone, __LINE__) = PF_RegisterZone(Name); \
+    profiler_scope PF_CONCAT(ProfilerScope, __LINE__)(PF_CONCAT(ProfilerZone, __LINE__))
+// Value of Name at this point, shown as a graph in the trace
+#define PF_COUNTER(Name, Value)                                                     \
+    do                                                                              \
+    {                                                                               \
+        static u32 PF_CONCAT(ProfilerCounter, __LINE__) = PF_RegisterZone(Name, true); \
+        PF_WriteEvent(PF_CONCAT(ProfilerCounter, __LINE__), ProfilerEvent_Counter, (i64)(Value)); \
+    } while(0)
+
+#else
+
+#define PF_SCOPE(Name)
+#define PF_COUNTER(Name, Value)
+#define PF_Initialize()
+#define PF_SetThreadName(Name)
+#define PF_EndFrame()
+inline b32 PF_BeginCapture(u32, const char *) { return false; }
+#define PF_EndCapture()
+
+#endif
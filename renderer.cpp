@@ -12,287 +12,2560 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "external/stb_image.h"
 
+#include <float.h>
+#include <xmmintrin.h> // SSE, frustum culling
+
 // Freetype
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-#include "shared.h"
-#include "renderer.h"
-#include "entity.h"
+#include "shared.h"
+#include "renderer.h"
+#include "entity.h"
+#include "atlas.cpp" // The skyline packer also packs the glyphs of every font
+#include "profiler.h"
+
+// NOTE: Textures used by the renderer 32 floating point srgb textures
+
+// Global renderer settings
+global f32 Exposure__ = 2.0f;
+global anti_aliasing_mode AntiAliasing__ = AntiAliasing_FXAA;
+global i32 MultisampleCount__ = 4; // Only used by AntiAliasing_MSAA
+global b32 EnableDynamicResolution = 1;
+global f32 GPUFrameBudgetMs = 14.0f; // Dynamic resolution scales the scene to keep the GPU frame time under this
+global i32 EnableBloom = 1; // NOTE: When 0 the bloom chain is skipped and the composite does not sample it.
+global u32 BloomMipCount = 4; // Levels of the bloom chain, the more levels the wider the glow
+global glm::vec4 BackgroundColor = glm::vec4(0.01f, 0.01f, 0.01f, 1.0f);
+global glm::vec4 MenuBackgroundColor = glm::vec4(0.005f, 0.005f, 0.005f, 1.0f);
+global f32 BrightnessThreshold = 0.1f;
+global f32 CameraSpeed = 7.0f;
+global b32 EnableShaderCache = 1; // NOTE: When 0 every shader is compiled from source
+
+// Uniform reflection tables, see R_ReflectShader
+global shader_program ShaderPrograms__[SHADER_MAX_PROGRAMS];
+global u32 ShaderProgramCount__ = 0;
+global u32 UniformUploads__ = 0; // Per frame counters, R_EndFrame moves them into the renderer
+global u32 UniformUploadsSkipped__ = 0;
+
+// Program binaries, see R_InitializeShaderCache
+global shader_cache ShaderCache__ = {};
+
+// Everything starts as the GL defaults (nothing bound, blend and depth test off)
+global gl_state GLState__ = {};
+
+void R_UseProgram(u32 Program)
+{
+    if(GLState__.Program == Program)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    glUseProgram(Program);
+    GLState__.Program = Program;
+    GLState__.Changes++;
+}
+
+void R_BindVertexArray(u32 VertexArray)
+{
+    if(GLState__.VertexArray == VertexArray)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    glBindVertexArray(VertexArray);
+    GLState__.VertexArray = VertexArray;
+    GLState__.Changes++;
+}
+
+u32 *R_GetBufferBinding(GLenum Target)
+{
+    switch(Target)
+    {
+        case GL_ARRAY_BUFFER: return &GLState__.ArrayBuffer;
+        case GL_UNIFORM_BUFFER: return &GLState__.UniformBuffer;
+        case GL_PIXEL_UNPACK_BUFFER: return &GLState__.PixelUnpackBuffer;
+        case GL_PIXEL_PACK_BUFFER: return &GLState__.PixelPackBuffer;
+        // NOTE: GL_ELEMENT_ARRAY_BUFFER is part of the vertex array state, it's not tracked
+        default: return NULL;
+    }
+}
+
+void R_BindBuffer(GLenum Target, u32 Buffer)
+{
+    u32 *Binding = R_GetBufferBinding(Target);
+    if(Binding && *Binding == Buffer)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    glBindBuffer(Target, Buffer);
+    if(Binding)
+    {
+        *Binding = Buffer;
+    }
+    GLState__.Changes++;
+}
+
+void R_BindBufferBase(GLenum Target, u32 Index, u32 Buffer)
+{
+    // Binding to an indexed target also changes the generic binding
+    glBindBufferBase(Target, Index, Buffer);
+    u32 *Binding = R_GetBufferBinding(Target);
+    if(Binding)
+    {
+        *Binding = Buffer;
+    }
+    GLState__.Changes++;
+}
+
+void R_DeleteBuffer(u32 *Buffer)
+{
+    // GL unbinds deleted objects, the name can be handed out again by glGenBuffers
+    Assert(Buffer);
+    if(GLState__.ArrayBuffer == *Buffer) GLState__.ArrayBuffer = 0;
+    if(GLState__.UniformBuffer == *Buffer) GLState__.UniformBuffer = 0;
+    if(GLState__.PixelUnpackBuffer == *Buffer) GLState__.PixelUnpackBuffer = 0;
+    if(GLState__.PixelPackBuffer == *Buffer) GLState__.PixelPackBuffer = 0;
+    glDeleteBuffers(1, Buffer);
+    *Buffer = 0;
+}
+
+void R_BindTexture(u32 Unit, u32 Texture)
+{
+    Assert(Unit < GL_STATE_MAX_TEXTURE_UNITS);
+
+    if(GLState__.Textures[Unit] == Texture)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    if(GLState__.ActiveTextureUnit != Unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + Unit);
+        GLState__.ActiveTextureUnit = Unit;
+        GLState__.Changes++;
+    }
+    glBindTexture(GL_TEXTURE_2D, Texture);
+    GLState__.Textures[Unit] = Texture;
+    GLState__.Changes++;
+}
+
+void R_BindTextureForUpload(u32 Texture)
+{
+    // glTexImage2D/glTexParameteri work on whatever unit is active, use
+    // that one instead of switching units just to upload
+    R_BindTexture(GLState__.ActiveTextureUnit, Texture);
+}
+
+void R_DeleteTexture(u32 *Texture)
+{
+    Assert(Texture);
+    for(u32 Unit = 0; Unit < GL_STATE_MAX_TEXTURE_UNITS; Unit++)
+    {
+        if(GLState__.Textures[Unit] == *Texture)
+        {
+            GLState__.Textures[Unit] = 0;
+        }
+    }
+    glDeleteTextures(1, Texture);
+    *Texture = 0;
+}
+
+void R_BindFramebuffer(u32 Framebuffer)
+{
+    // NOTE: Draw and read framebuffers are always bound together (GL_FRAMEBUFFER)
+    if(GLState__.Framebuffer == Framebuffer)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+    GLState__.Framebuffer = Framebuffer;
+    GLState__.Changes++;
+}
+
+void R_SetBlend(b32 Enabled, GLenum Source = GL_SRC_ALPHA, GLenum Destination = GL_ONE_MINUS_SRC_ALPHA)
+{
+    if(GLState__.BlendEnabled != Enabled)
+    {
+        if(Enabled)
+        {
+            glEnable(GL_BLEND);
+        }
+        else
+        {
+            glDisable(GL_BLEND);
+        }
+        GLState__.BlendEnabled = Enabled;
+        GLState__.Changes++;
+    }
+    else
+    {
+        GLState__.ChangesSkipped++;
+    }
+
+    // The blend function does nothing while blending is off, keep the old one
+    if(Enabled)
+    {
+        if(GLState__.BlendSource != Source || GLState__.BlendDestination != Destination)
+        {
+            glBlendFunc(Source, Destination);
+            GLState__.BlendSource = Source;
+            GLState__.BlendDestination = Destination;
+            GLState__.Changes++;
+        }
+        else
+        {
+            GLState__.ChangesSkipped++;
+        }
+    }
+}
+
+void R_SetDepthTest(b32 Enabled)
+{
+    if(GLState__.DepthTestEnabled == Enabled)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    if(Enabled)
+    {
+        glEnable(GL_DEPTH_TEST);
+    }
+    else
+    {
+        glDisable(GL_DEPTH_TEST);
+    }
+    GLState__.DepthTestEnabled = Enabled;
+    GLState__.Changes++;
+}
+
+void R_SetDepthWrite(b32 Enabled)
+{
+    if(GLState__.DepthWriteDisabled == !Enabled)
+    {
+        GLState__.ChangesSkipped++;
+        return;
+    }
+
+    glDepthMask(Enabled ? GL_TRUE : GL_FALSE);
+    GLState__.DepthWriteDisabled = !Enabled;
+    GLState__.Changes++;
+}
+
+void R_BeginGPUTimer(renderer *Renderer, gpu_pass Pass)
+{
+    // Starts timing a section of Pass, sections can not be nested
+    gpu_profiler *Profiler = &Renderer->GPUProfiler;
+    gpu_timer_frame *Frame = &Profiler->Frames[Profiler->FrameIndex];
+    Assert(!Profiler->IsTiming);
+    if(Profiler->IsTiming || Frame->QueryCount == GPU_TIMER_MAX_QUERIES)
+    {
+        return;
+    }
+
+    Frame->Passes[Frame->QueryCount] = Pass;
+    glBeginQuery(GL_TIME_ELAPSED, Frame->Queries[Frame->QueryCount]);
+    Profiler->IsTiming = true;
+}
+
+void R_EndGPUTimer(renderer *Renderer)
+{
+    gpu_profiler *Profiler = &Renderer->GPUProfiler;
+    if(!Profiler->IsTiming)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    Profiler->Frames[Profiler->FrameIndex].QueryCount++;
+    Profiler->IsTiming = false;
+}
+
+void R_UpdateGPUTimerStats(gpu_timer_stats *Stats, f32 Ms, u32 HistoryIndex, u32 HistoryCount)
+{
+    Stats->Ms = Ms;
+    Stats->History[HistoryIndex] = Ms;
+
+    Stats->MinMs = FLT_MAX;
+    Stats->MaxMs = 0.0f;
+    f32 TotalMs = 0.0f;
+    for(u32 i = 0; i < HistoryCount; i++)
+    {
+        Stats->MinMs = SDL_min(Stats->MinMs, Stats->History[i]);
+        Stats->MaxMs = SDL_max(Stats->MaxMs, Stats->History[i]);
+        TotalMs += Stats->History[i];
+    }
+    Stats->AvgMs = TotalMs / (f32)HistoryCount;
+}
+
+void R_ReadGPUTimers(renderer *Renderer)
+{
+    // Reads the queries of the frame that used this slot
+    // RENDER_GPU_FRAMES_IN_FLIGHT frames ago. The end timestamp is the
+    // last query of the frame, once it is available the rest are too.
+    gpu_profiler *Profiler = &Renderer->GPUProfiler;
+    gpu_timer_frame *Frame = &Profiler->Frames[Profiler->FrameIndex];
+    if(!Frame->IsPending)
+    {
+        return;
+    }
+    Frame->IsPending = false;
+
+    i32 Available = 0;
+    glGetQueryObjectiv(Frame->Timestamps[1], GL_QUERY_RESULT_AVAILABLE, &Available);
+    if(!Available)
+    {
+        Profiler->DroppedFrames++;
+        return;
+    }
+
+    f32 PassMs[GPUPass_Count] = {};
+    for(u32 i = 0; i < Frame->QueryCount; i++)
+    {
+        u64 Elapsed = 0;
+        glGetQueryObjectui64v(Frame->Queries[i], GL_QUERY_RESULT, &Elapsed);
+        PassMs[Frame->Passes[i]] += (f32)((f64)Elapsed / 1000000.0);
+    }
+
+    u64 Begin = 0;
+    u64 End = 0;
+    glGetQueryObjectui64v(Frame->Timestamps[0], GL_QUERY_RESULT, &Begin);
+    glGetQueryObjectui64v(Frame->Timestamps[1], GL_QUERY_RESULT, &End);
+    f32 FrameMs = (f32)((f64)(End - Begin) / 1000000.0);
+    f32 LatencyMs = (f32)((f64)((i64)End - Frame->SubmitTime) / 1000000.0);
+
+    u32 HistoryIndex = Profiler->HistoryIndex;
+    Profiler->HistoryIndex = (Profiler->HistoryIndex + 1) % GPU_TIMER_HISTORY;
+    Profiler->HistoryCount = SDL_min(Profiler->HistoryCount + 1, GPU_TIMER_HISTORY);
+    for(u32 Pass = 0; Pass < GPUPass_Count; Pass++)
+    {
+        R_UpdateGPUTimerStats(&Profiler->Passes[Pass], PassMs[Pass], HistoryIndex, Profiler->HistoryCount);
+    }
+    R_UpdateGPUTimerStats(&Profiler->Frame, FrameMs, HistoryIndex, Profiler->HistoryCount);
+    R_UpdateGPUTimerStats(&Profiler->Latency, LatencyMs, HistoryIndex, Profiler->HistoryCount);
+
+    Renderer->GPUFrameMs = FrameMs;
+}
+
+void R_BeginGPUFrame(renderer *Renderer)
+{
+    gpu_profiler *Profiler = &Renderer->GPUProfiler;
+    R_ReadGPUTimers(Renderer);
+
+    gpu_timer_frame *Frame = &Profiler->Frames[Profiler->FrameIndex];
+    Frame->QueryCount = 0;
+    glGetInteger64v(GL_TIMESTAMP, &Frame->SubmitTime);
+    glQueryCounter(Frame->Timestamps[0], GL_TIMESTAMP);
+}
+
+void R_EndGPUFrame(renderer *Renderer)
+{
+    gpu_profiler *Profiler = &Renderer->GPUProfiler;
+    gpu_timer_frame *Frame = &Profiler->Frames[Profiler->FrameIndex];
+    glQueryCounter(Frame->Timestamps[1], GL_TIMESTAMP);
+    Frame->IsPending = true;
+    Profiler->FrameIndex = (Profiler->FrameIndex + 1) % RENDER_GPU_FRAMES_IN_FLIGHT;
+}
+
+gpu_timer_stats *R_GetGPUTimerStats(renderer *Renderer, gpu_pass Pass)
+{
+    // Milliseconds the GPU spent on Pass, RENDER_GPU_FRAMES_IN_FLIGHT frames old
+    Assert(Pass < GPUPass_Count);
+    return &Renderer->GPUProfiler.Passes[Pass];
+}
+
+char *R_GetGPUPassName(gpu_pass Pass)
+{
+    switch(Pass)
+    {
+        case GPUPass_Scene: return "Scene";
+        case GPUPass_Text: return "Text";
+        case GPUPass_Resolve: return "MSAA Resolve";
+        case GPUPass_BloomDownsample: return "Bloom Downsample";
+        case GPUPass_BloomUpsample: return "Bloom Upsample";
+        case GPUPass_Composite: return "Composite";
+        default: return "Unknown";
+    }
+}
+
+void R_ExtractFrustum(frustum *Frustum, glm::mat4 ViewProjection)
+{
+    // Gribb/Hartmann, every plane is the last row of the matrix plus or minus another row.
+    // glm is column major, Row[i] is (M[0][i], M[1][i], M[2][i], M[3][i]).
+    glm::mat4 M = glm::transpose(ViewProjection);
+    Frustum->Planes[0] = M[3] + M[0]; // Left
+    Frustum->Planes[1] = M[3] - M[0]; // Right
+    Frustum->Planes[2] = M[3] + M[1]; // Bottom
+    Frustum->Planes[3] = M[3] - M[1]; // Top
+    Frustum->Planes[4] = M[3] + M[2]; // Near
+    Frustum->Planes[5] = M[3] - M[2]; // Far
+    for(u32 i = 0; i < 6; i++)
+    {
+        Frustum->Planes[i] /= glm::length(glm::vec3(Frustum->Planes[i]));
+    }
+}
+
+void R_UpdateCamera(renderer *Renderer, camera *Camera)
+{
+    Camera->Projection = glm::perspective(glm::radians(Camera->FoV), (f32)Renderer->Window->Width / (f32)Renderer->Window->Height, Camera->Near, Camera->Far);
+    Camera->Ortho = glm::ortho(0.0f, (f32)Renderer->Window->Width, 0.0f, (f32)Renderer->Window->Height);
+    Camera->View = glm::lookAt(Camera->Position, Camera->Position + Camera->Front, Camera->Up);
+    Renderer->View = Camera->View;
+    R_ExtractFrustum(&Renderer->Frustum, Camera->Projection * Camera->View);
+
+    { // Upload new camera matrices to UBO
+        R_BindBuffer(GL_UNIFORM_BUFFER, Renderer->UniformCameraBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(Camera->Projection)); // NOTE: As long as we dont change the FoV or Width/Height of windows, the projection remains the same. We could not update it every frame.
+        glBufferSubData(GL_UNIFORM_BUFFER, 64, sizeof(glm::mat4), glm::value_ptr(Camera->Ortho));
+        glBufferSubData(GL_UNIFORM_BUFFER, 128, sizeof(glm::mat4), glm::value_ptr(Camera->View));
+    }
+
+}
+
+void R_DrawUnitQuad(renderer *Renderer)
+{
+    R_BindVertexArray(Renderer->UnitQuadVAO);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); Renderer->CurrentDrawCallsPerFrame++;
+}
+
+void R_OrphanStreamBuffer(stream_buffer *Stream)
+{
+    // The driver hands us new storage, the GPU keeps reading the old one,
+    // so the fences of the old storage are not needed anymore
+    R_BindBuffer(GL_ARRAY_BUFFER, Stream->Handle);
+    glBufferData(GL_ARRAY_BUFFER, Stream->RegionSize * RENDER_STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+    for(u32 i = 0; i < RENDER_STREAM_FRAMES; i++)
+    {
+        if(Stream->Fences[i])
+        {
+            glDeleteSync(Stream->Fences[i]);
+            Stream->Fences[i] = NULL;
+        }
+    }
+    Stream->Orphans++;
+}
+
+void R_BeginStreamFrame(renderer *Renderer)
+{
+    stream_buffer *Stream = &Renderer->StreamBuffer;
+    Stream->Offset = 0;
+    if(Stream->Mode == StreamBuffer_Orphaning)
+    {
+        R_OrphanStreamBuffer(Stream);
+        return;
+    }
+
+    Stream->Region = (Stream->Region + 1) % RENDER_STREAM_FRAMES;
+    GLsync Fence = Stream->Fences[Stream->Region];
+    if(Fence)
+    {
+        // The GPU is still reading the region RENDER_STREAM_FRAMES frames later, orphan instead of waiting for it
+        GLenum Status = glClientWaitSync(Fence, 0, 0);
+        if(Status == GL_ALREADY_SIGNALED || Status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(Fence);
+            Stream->Fences[Stream->Region] = NULL;
+        }
+        else
+        {
+            R_OrphanStreamBuffer(Stream);
+        }
+    }
+}
+
+void R_EndStreamFrame(renderer *Renderer)
+{
+    // Called after the last draw of the frame
+    stream_buffer *Stream = &Renderer->StreamBuffer;
+    if(Stream->Mode == StreamBuffer_Unsynchronized)
+    {
+        Stream->Fences[Stream->Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        f32 MapMs = (f32)((f64)Stream->MapTicks * 1000.0 / (f64)SDL_GetPerformanceFrequency());
+        Stream->SlowFrames = MapMs > RENDER_STREAM_SLOW_MAP_MS ? Stream->SlowFrames + 1 : 0;
+        if(Stream->SlowFrames == RENDER_STREAM_SLOW_FRAMES)
+        {
+            printf("Mapping the stream buffer takes %.2fms per frame, switching to orphaning\n", MapMs);
+            Stream->Mode = StreamBuffer_Orphaning;
+            Stream->Region = 0;
+        }
+    }
+
+    Stream->PreviousBytes = Stream->Bytes;
+    Stream->PreviousOrphans = Stream->Orphans;
+    Stream->Bytes = 0;
+    Stream->Orphans = 0;
+    Stream->MapTicks = 0;
+}
+
+size_t R_StreamUpload(renderer *Renderer, void *Data, size_t Size, size_t Stride)
+{
+    // Appends Data to the region of this frame and returns its offset in
+    // bytes, a multiple of Stride so draws can start at Offset / Stride.
+    // The stream buffer is left bound to GL_ARRAY_BUFFER.
+    stream_buffer *Stream = &Renderer->StreamBuffer;
+    Assert(Size + Stride <= Stream->RegionSize);
+    R_BindBuffer(GL_ARRAY_BUFFER, Stream->Handle);
+
+    size_t RegionBegin = Stream->Region * Stream->RegionSize;
+    size_t Offset = (RegionBegin + Stream->Offset + Stride - 1) / Stride * Stride;
+    if(Offset + Size > RegionBegin + Stream->RegionSize)
+    {
+        // The frame outgrew its region, start the region again on new storage
+        R_OrphanStreamBuffer(Stream);
+        Offset = (RegionBegin + Stride - 1) / Stride * Stride;
+    }
+
+    u64 Begin = SDL_GetPerformanceCounter();
+    b32 IsWritten = false;
+    if(Stream->Mode == StreamBuffer_Unsynchronized)
+    {
+        void *Mapped = glMapBufferRange(GL_ARRAY_BUFFER, Offset, Size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if(Mapped)
+        {
+            memcpy(Mapped, Data, Size);
+            // NOTE: GL_FALSE means the storage was lost while mapped, upload it again below
+            IsWritten = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+        }
+    }
+    if(!IsWritten)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, Offset, Size, Data);
+    }
+    Stream->MapTicks += SDL_GetPerformanceCounter() - Begin;
+
+    Stream->Offset = Offset + Size - RegionBegin;
+    Stream->Bytes += Size;
+    return Offset;
+}
+
+void R_ReserveStream(renderer *Renderer, size_t Size)
+{
+    // Orphans now when Size bytes do not fit in the rest of the region, the
+    // uploads that follow are then never split between two buffer storages.
+    stream_buffer *Stream = &Renderer->StreamBuffer;
+    Assert(Size <= Stream->RegionSize);
+    if(Stream->Offset + Size > Stream->RegionSize)
+    {
+        R_OrphanStreamBuffer(Stream);
+        Stream->Offset = 0;
+    }
+}
+
+void R_SetSpriteInstanceAttributes(size_t BaseOffset)
+{
+    // Points the instance attributes of the bound SpriteVAO at BaseOffset of the bound GL_ARRAY_BUFFER.
+    // NOTE: OpenGL 3.3 has no base instance, the attributes move with every batch instead.
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(sprite_instance), (void*)(BaseOffset + offsetof(sprite_instance, PositionAngle)));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(sprite_instance), (void*)(BaseOffset + offsetof(sprite_instance, SizeThreshold)));
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(sprite_instance), (void*)(BaseOffset + offsetof(sprite_instance, Tint)));
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(sprite_instance), (void*)(BaseOffset + offsetof(sprite_instance, UVRect)));
+}
+
+void R_FlushSprites(renderer *Renderer)
+{
+    // Draws every sprite pushed since the last flush with one instanced draw call
+    if(Renderer->SpriteInstanceCount == 0)
+    {
+        return;
+    }
+
+    size_t Offset = R_StreamUpload(Renderer, Renderer->SpriteInstances, sizeof(sprite_instance) * Renderer->SpriteInstanceCount, sizeof(sprite_instance));
+
+    R_UseProgram(Renderer->SpriteBatchShader);
+    R_BindTexture(0, Renderer->SpriteBatchTexture);
+    R_BindVertexArray(Renderer->SpriteVAO);
+    R_SetSpriteInstanceAttributes(Offset);
+    R_BeginGPUTimer(Renderer, GPUPass_Scene);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, Renderer->SpriteInstanceCount); Renderer->CurrentDrawCallsPerFrame++;
+    R_EndGPUTimer(Renderer);
+
+    Renderer->SpriteInstanceCount = 0;
+}
+
+void R_PushSprite(renderer *Renderer, u32 Shader, texture *Texture, glm::vec3 Position, glm::vec3 Size, f32 RotationAngle, glm::vec4 Tint, f32 Threshold)
+{
+    Assert(Renderer);
+    Assert(Texture);
+
+    // A change of shader or texture breaks the batch, draw what we have so far
+    if(Renderer->SpriteInstanceCount == SPRITE_BATCH_MAX_INSTANCES ||
+       Renderer->SpriteBatchShader != Shader ||
+       Renderer->SpriteBatchTexture != Texture->Handle)
+    {
+        R_FlushSprites(Renderer);
+        Renderer->SpriteBatchShader = Shader;
+        Renderer->SpriteBatchTexture = Texture->Handle;
+    }
+
+    sprite_instance *Instance = &Renderer->SpriteInstances[Renderer->SpriteInstanceCount++];
+    Instance->PositionAngle = glm::vec4(Position, RotationAngle);
+    Instance->SizeThreshold = glm::vec4(Size.x, Size.y, Threshold, 0.0f);
+    Instance->Tint = Tint;
+    Instance->UVRect = Texture->UVRect;
+}
+
+shader_program *R_GetShaderProgram(u32 Shader)
+{
+    for(u32 i = 0; i < ShaderProgramCount__; i++)
+    {
+        if(ShaderPrograms__[i].Handle == Shader)
+        {
+            return &ShaderPrograms__[i];
+        }
+    }
+
+    return NULL;
+}
+
+void R_ReflectShader(u32 Program)
+{
+    // Enumerates the active uniforms of a freshly linked program once,
+    // so R_SetUniform never calls glGetUniformLocation.
+    if(Program == 0)
+    {
+        return;
+    }
+
+    shader_program *Reflection = R_GetShaderProgram(Program);
+    if(Reflection == NULL)
+    {
+        Assert(ShaderProgramCount__ < SHADER_MAX_PROGRAMS);
+        Reflection = &ShaderPrograms__[ShaderProgramCount__++];
+    }
+    *Reflection = {};
+    Reflection->Handle = Program;
+
+    i32 UniformCount = 0;
+    glGetProgramiv(Program, GL_ACTIVE_UNIFORMS, &UniformCount);
+    for(i32 i = 0; i < UniformCount; i++)
+    {
+        char Name[256];
+        i32 NameLength = 0;
+        i32 ArraySize = 0;
+        GLenum Type;
+        glGetActiveUniform(Program, (u32)i, sizeof(Name), &NameLength, &ArraySize, &Type, Name);
+
+        // Uniforms inside a uniform block have no location, they are set through the buffer
+        i32 Location = glGetUniformLocation(Program, Name);
+        if(Location < 0)
+        {
+            continue;
+        }
+
+        if(Reflection->UniformCount == SHADER_MAX_UNIFORMS)
+        {
+            printf("R_ReflectShader: Program %d has more than %d uniforms\n", Program, SHADER_MAX_UNIFORMS);
+            break;
+        }
+
+        // Arrays are reported as "Name[0]", we look them up as "Name"
+        char *Bracket = strchr(Name, '[');
+        if(Bracket)
+        {
+            *Bracket = '\0';
+        }
+
+        shader_uniform *Uniform = &Reflection->Uniforms[Reflection->UniformCount++];
+        Uniform->NameHash = HashString(Name);
+        Uniform->Location = Location;
+        Uniform->Type = Type;
+        Uniform->ArraySize = ArraySize;
+        Uniform->HasValue = false;
+    }
+}
+
+u64 R_HashShaderString(u64 Hash, const char *String)
+{
+    // FNV-1a 64, continues from Hash
+    for(const char *At = String; At && *At; At++)
+    {
+        Hash ^= (u8)*At;
+        Hash *= 1099511628211ull;
+    }
+
+    return Hash;
+}
+
+void R_InitializeShaderCache(renderer *Renderer)
+{
+    // Needs the driver strings, call before the first R_CreateShader
+    u64 Hash = 14695981039346656037ull;
+    Hash = R_HashShaderString(Hash, (const char*)Renderer->HardwareVendor);
+    Hash = R_HashShaderString(Hash, (const char*)Renderer->HardwareModel);
+    Hash = R_HashShaderString(Hash, (const char*)Renderer->OpenGLVersion);
+    ShaderCache__.DriverHash = Hash;
+
+    if(EnableShaderCache && SDL_GL_ExtensionSupported("GL_ARB_get_program_binary"))
+    {
+        ShaderCache__.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glGetProgramBinary");
+        ShaderCache__.ProgramBinary = (PFNGLPROGRAMBINARYPROC)SDL_GL_GetProcAddress("glProgramBinary");
+        ShaderCache__.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)SDL_GL_GetProcAddress("glProgramParameteri");
+
+        // NOTE: Some drivers expose the extension with no binary formats, nothing could be loaded back
+        i32 FormatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &FormatCount);
+        ShaderCache__.IsSupported = ShaderCache__.GetProgramBinary && ShaderCache__.ProgramBinary &&
+                                    ShaderCache__.ProgramParameteri && FormatCount > 0;
+    }
+}
+
+u32 R_LoadProgramBinary(char *CacheFilename, u64 Key)
+{
+    // Returns 0 when there is no binary for Key or the driver rejects it
+    SDL_RWops *RWops = SDL_RWFromFile(CacheFilename, "rb");
+    if(RWops == NULL)
+    {
+        ShaderCache__.Misses++;
+        return 0;
+    }
+
+    shader_cache_header Header = {};
+    size_t FileSize = (size_t)SDL_RWsize(RWops);
+    u8 *Binary = NULL;
+    if(SDL_RWread(RWops, &Header, sizeof(Header), 1) == 1 &&
+       Header.Magic == SHADER_CACHE_MAGIC &&
+       Header.Version == SHADER_CACHE_VERSION &&
+       Header.Key == Key &&
+       FileSize == sizeof(Header) + Header.Size)
+    {
+        Binary = (u8*)malloc(Header.Size);
+        if(Binary && SDL_RWread(RWops, Binary, Header.Size, 1) != 1)
+        {
+            free(Binary);
+            Binary = NULL;
+        }
+    }
+    SDL_RWclose(RWops);
+
+    if(Binary == NULL)
+    {
+        ShaderCache__.Misses++;
+        return 0;
+    }
+
+    u32 Result = glCreateProgram();
+    ShaderCache__.ProgramBinary(Result, Header.Format, Binary, (GLsizei)Header.Size);
+    free(Binary);
+    i32 IsLinked = 0;
+    glGetProgramiv(Result, GL_LINK_STATUS, (GLint *)&IsLinked);
+    if(IsLinked == GL_FALSE)
+    {
+        glDeleteProgram(Result);
+        ShaderCache__.Rejected++;
+        return 0;
+    }
+
+    ShaderCache__.Hits++;
+    return Result;
+}
+
+void R_SaveProgramBinary(char *CacheFilename, u64 Key, u32 Program)
+{
+    i32 Size = 0;
+    glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &Size);
+    if(Size <= 0)
+    {
+        return;
+    }
+
+    u8 *Binary = (u8*)malloc((size_t)Size);
+    if(Binary == NULL)
+    {
+        return;
+    }
+
+    shader_cache_header Header = {};
+    GLenum Format = 0;
+    GLsizei Length = 0;
+    ShaderCache__.GetProgramBinary(Program, Size, &Length, &Format, Binary);
+    Header.Magic = SHADER_CACHE_MAGIC;
+    Header.Version = SHADER_CACHE_VERSION;
+    Header.Key = Key;
+    Header.Format = Format;
+    Header.Size = (u32)Length;
+
+    SDL_RWops *RWops = SDL_RWFromFile(CacheFilename, "wb");
+    if(RWops)
+    {
+        b32 IsWritten = SDL_RWwrite(RWops, &Header, sizeof(Header), 1) == 1 &&
+                        SDL_RWwrite(RWops, Binary, Header.Size, 1) == 1;
+        SDL_RWclose(RWops);
+        if(!IsWritten)
+        {
+            printf("R_SaveProgramBinary: Could not write %s\n", CacheFilename);
+        }
+    }
+    free(Binary);
+}
+
+u32 R_CreateShader(char *Filename)
+{
+    PF_SCOPE("R_CreateShader");
+    Assert(Filename);
+
+    u64 BeginCounter = SDL_GetPerformanceCounter();
+    u32 Result = 0;
+    // Packed text files are 0 terminated inside the mapping, see pack.h
+    char *SourceFile = (char*)PK_FindFile(Filename, NULL);
+    b32 IsSourceOwned = SourceFile == NULL;
+    if(IsSourceOwned)
+    {
+        SourceFile = ReadTextFile(Filename);
+    }
+    char *VertexPrefix = "#version 330 core\n#define VERTEX_SHADER\n";
+    char *FragmentPrefix = "#version 330 core\n#define FRAGMENT_SHADER\n";
+
+    // The define prefixes are part of the key, another define set is another program
+    char CacheFilename[256];
+    snprintf(CacheFilename, sizeof(CacheFilename), "%s.bin", Filename);
+    u64 CacheKey = R_HashShaderString(ShaderCache__.DriverHash, VertexPrefix);
+    CacheKey = R_HashShaderString(CacheKey, FragmentPrefix);
+    CacheKey = R_HashShaderString(CacheKey, SourceFile);
+    if(ShaderCache__.IsSupported)
+    {
+        Result = R_LoadProgramBinary(CacheFilename, CacheKey);
+    }
+
+    if(Result == 0)
+    {
+        // Compile Vertex Shader
+        u32 VertexShaderObject = glCreateShader(GL_VERTEX_SHADER);
+        char *VertexSource[2] = {VertexPrefix, SourceFile};
+        glShaderSource(VertexShaderObject, 2, VertexSource, NULL);
+        glCompileShader(VertexShaderObject);
+        i32 Compiled;
+        glGetShaderiv(VertexShaderObject, GL_COMPILE_STATUS, &Compiled);
+        if (Compiled != GL_TRUE)
+        {
+            i32 LogLength = 0;
+            char ErrorMessage[1024];
+            glGetShaderInfoLog(VertexShaderObject, 1024, &LogLength, ErrorMessage);
+            fprintf(stderr, "%s-%s\n", Filename, ErrorMessage);
+            VertexShaderObject = 0;
+        }
+
+        // Compile Fragment Shader
+        u32 FragmentShaderObject = glCreateShader(GL_FRAGMENT_SHADER);
+        char *FragmentSource[2] = {FragmentPrefix, SourceFile};
+        glShaderSource(FragmentShaderObject, 2, FragmentSource, NULL);
+        glCompileShader(FragmentShaderObject);
+        // i32 Compiled;
+        glGetShaderiv(FragmentShaderObject, GL_COMPILE_STATUS, &Compiled);
+        if (Compiled != GL_TRUE)
+        {
+            i32 LogLength = 0;
+            char ErrorMessage[1024];
+            glGetShaderInfoLog(FragmentShaderObject, 1024, &LogLength, ErrorMessage);
+            fprintf(stderr, "%s-%s\n", Filename, ErrorMessage);
+            FragmentShaderObject = 0;
+        }
+
+        // Link program
+        Result = glCreateProgram();
+        if(ShaderCache__.IsSupported)
+        {
+            ShaderCache__.ProgramParameteri(Result, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glAttachShader(Result, VertexShaderObject);
+        glAttachShader(Result, FragmentShaderObject);
+        glLinkProgram(Result);
+        i32 IsLinked = 0;
+        glGetProgramiv(Result, GL_LINK_STATUS, (GLint *)&IsLinked);
+        if (IsLinked == GL_FALSE)
+        {
+            i32 MaxLogLength = 1024;
+            char InfoLog[1024] = {0};
+            glGetProgramInfoLog(Result, MaxLogLength, &MaxLogLength, &InfoLog[0]);
+            printf("%s: SHADER PROGRAM FAILED TO COMPILE/LINK\n", Filename);
+            printf("%s\n", InfoLog);
+            glDeleteProgram(Result);
+            Result = 0;
+        }
+
+        glDeleteShader(VertexShaderObject);
+        glDeleteShader(FragmentShaderObject);
+
+        if(Result && ShaderCache__.IsSupported)
+        {
+            R_SaveProgramBinary(CacheFilename, CacheKey, Result);
+        }
+    }
+    if(IsSourceOwned)
+    {
+        Free(SourceFile);
+    }
+
+    R_ReflectShader(Result);
+
+    ShaderCache__.Ms += P_GetSecondsElapsed(BeginCounter, SDL_GetPerformanceCounter()) * 1000.0;
+    return Result;
+}
+
+shader_uniform *R_GetUniform(u32 Shader, char *Name)
+{
+    // Returns NULL for uniforms that are not active, the GLSL compiler
+    // removes unused ones. Setting those is a no-op, like location -1.
+    Assert(Name);
+
+    shader_program *Program = R_GetShaderProgram(Shader);
+    if(Program)
+    {
+        u32 NameHash = HashString(Name);
+        for(u32 i = 0; i < Program->UniformCount; i++)
+        {
+            if(Program->Uniforms[i].NameHash == NameHash)
+            {
+                return &Program->Uniforms[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+b32 R_UniformNeedsUpload(shader_uniform *Uniform, void *Value, size_t Size)
+{
+    // NOTE: Like glUniform*, the uniform's program has to be the active one.
+    if(Uniform == NULL)
+    {
+        return false;
+    }
+
+    Assert(Size <= sizeof(Uniform->Value));
+    if(Uniform->HasValue && memcmp(Uniform->Value, Value, Size) == 0)
+    {
+        UniformUploadsSkipped__++;
+        return false;
+    }
+
+    memcpy(Uniform->Value, Value, Size);
+    Uniform->HasValue = true;
+    UniformUploads__++;
+    return true;
+}
+
+void R_SetUniform(shader_uniform *Uniform, i32 Value)
+{
+    if(R_UniformNeedsUpload(Uniform, &Value, sizeof(Value)))
+    {
+        glUniform1i(Uniform->Location, Value);
+    }
+}
+
+void R_SetUniform(shader_uniform *Uniform, f32 Value)
+{
+    if(R_UniformNeedsUpload(Uniform, &Value, sizeof(Value)))
+    {
+        glUniform1f(Uniform->Location, Value);
+    }
+}
+
+void R_SetUniform(shader_uniform *Uniform, glm::mat4 *Value)
+{
+    if(R_UniformNeedsUpload(Uniform, glm::value_ptr(*Value), sizeof(glm::mat4)))
+    {
+        glUniformMatrix4fv(Uniform->Location, 1, GL_FALSE, glm::value_ptr(*Value));
+    }
+}
+
+void R_SetUniform(shader_uniform *Uniform, glm::vec2 Value)
+{
+    if(R_UniformNeedsUpload(Uniform, glm::value_ptr(Value), sizeof(glm::vec2)))
+    {
+        glUniform2f(Uniform->Location, Value.x, Value.y);
+    }
+}
+
+void R_SetUniform(shader_uniform *Uniform, glm::vec3 Value)
+{
+    if(R_UniformNeedsUpload(Uniform, glm::value_ptr(Value), sizeof(glm::vec3)))
+    {
+        glUniform3f(Uniform->Location, Value.x, Value.y, Value.z);
+    }
+}
+
+void R_SetUniform(shader_uniform *Uniform, glm::vec4 Value)
+{
+    if(R_UniformNeedsUpload(Uniform, glm::value_ptr(Value), sizeof(glm::vec4)))
+    {
+        glUniform4f(Uniform->Location, Value.x, Value.y, Value.z, Value.w);
+    }
+}
+
+void R_SetUniform(u32 Shader, char *Name, i32 Value)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), Value);
+}
+
+void R_SetUniform(u32 Shader, char *Name, f32 Value)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), Value);
+}
+
+void R_SetUniform(u32 Shader, char *Name, glm::mat4 *Value)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), Value);
+}
+
+void R_SetUniform(u32 Shader, char *Name, glm::mat4 Value)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), &Value);
+}
+
+void R_SetUniform(u32 Shader, char *Name, f32 X, f32 Y, f32 Z)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), glm::vec3(X, Y, Z));
+}
+
+void R_SetUniform(u32 Shader, char *Name, glm::vec3 Value)
+{
+    Assert(Name);
+    R_SetUniform(R_GetUniform(Shader, Name), Value);
+}
+
+void R_DrawParticles(renderer *Renderer, render_command_particles *Particles)
+{
+    // One instanced draw for the whole pool, every array is its own instance attribute
+    if(Particles->Count == 0)
+    {
+        return;
+    }
+
+    size_t ArraySize = sizeof(f32) * Particles->Count;
+    R_ReserveStream(Renderer, ArraySize * 4 + sizeof(f32) * 3);
+    size_t PositionXOffset = R_StreamUpload(Renderer, Particles->PositionX, ArraySize, sizeof(f32));
+    size_t PositionYOffset = R_StreamUpload(Renderer, Particles->PositionY, ArraySize, sizeof(f32));
+    size_t SizeOffset = R_StreamUpload(Renderer, Particles->Size, ArraySize, sizeof(f32));
+    size_t ColorOffset = R_StreamUpload(Renderer, Particles->Color, ArraySize, sizeof(u32));
+
+    R_UseProgram(Particles->Shader);
+    R_SetUniform(Renderer->Uniforms.ParticleUVRect, Particles->Texture->UVRect);
+    R_SetUniform(Renderer->Uniforms.ParticleIntensity, Particles->Intensity);
+    R_BindTexture(0, Particles->Texture->Handle);
+    R_BindVertexArray(Renderer->ParticleVAO);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(f32), (void*)PositionXOffset);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(f32), (void*)PositionYOffset);
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(f32), (void*)SizeOffset);
+    glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(u32), (void*)ColorOffset);
+
+    // Additive particles are not sorted, they must not hide each other
+    R_SetDepthWrite(false);
+    R_BeginGPUTimer(Renderer, GPUPass_Scene);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, Particles->Count); Renderer->CurrentDrawCallsPerFrame++;
+    R_EndGPUTimer(Renderer);
+    R_SetDepthWrite(true);
+}
+
+void R_FlushText(renderer *Renderer)
+{
+    // Draws every glyph pushed since the last flush with one draw call
+    if(Renderer->TextVertexCount == 0)
+    {
+        return;
+    }
+
+    size_t Offset = R_StreamUpload(Renderer, Renderer->TextVertices, sizeof(text_vertex) * Renderer->TextVertexCount, sizeof(text_vertex));
+
+    R_UseProgram(Renderer->Shaders.Text);
+    f32 TextBrightnessThreshold = 1.0f;
+    R_SetUniform(Renderer->Uniforms.TextBrightnessThreshold, TextBrightnessThreshold);
+    R_SetUniform(Renderer->Uniforms.TextDistanceField, Renderer->TextBatchFont->IsDistanceField);
+    R_BindTexture(0, Renderer->TextBatchFont->Texture);
+    R_BindVertexArray(Renderer->TextVAO);
+    R_BeginGPUTimer(Renderer, GPUPass_Text);
+    glDrawArrays(GL_TRIANGLES, (i32)(Offset / sizeof(text_vertex)), Renderer->TextVertexCount); Renderer->CurrentDrawCallsPerFrame++;
+    R_EndGPUTimer(Renderer);
+
+    Renderer->TextVertexCount = 0;
+}
+
+u32 R_LayoutText(text_vertex *Vertices, u32 MaxVertexCount, char *Text, font *Font, glm::vec2 Position, glm::vec2 Scale, glm::vec3 Color)
+{
+    // Writes 6 vertices per visible glyph, returns how many vertices were written
+    u32 Result = 0;
+    Scale *= Font->MetricsScale;
+
+    // Iterate through all the characters in string
+    for(char *Ptr = Text; *Ptr != '\0'; Ptr++)
+    {
+        character *Ch = &Font->Characters[(u8)*Ptr];
+
+        f32 XPos = Position.x + Ch->Bearing.x * Scale.x;
+        f32 YPos = Position.y - (Ch->Size.y - Ch->Bearing.y) * Scale.y;
+
+        f32 W = Ch->Size.x * Scale.x;
+        f32 H = Ch->Size.y * Scale.y;
+
+        // Spaces only advance the cursor
+        if(Ch->Size.x > 0 && Ch->Size.y > 0)
+        {
+            if(Result + 6 > MaxVertexCount)
+            {
+                break;
+            }
+
+            // Glyph rows are stored top to bottom, V = 0 is the top of the glyph
+            f32 U0 = Ch->UVRect.x;
+            f32 V0 = Ch->UVRect.y;
+            f32 U1 = Ch->UVRect.x + Ch->UVRect.z;
+            f32 V1 = Ch->UVRect.y + Ch->UVRect.w;
+
+            text_vertex *Vertex = &Vertices[Result];
+            Vertex[0] = {glm::vec2(XPos,     YPos + H), glm::vec2(U0, V0), Color};
+            Vertex[1] = {glm::vec2(XPos,     YPos),     glm::vec2(U0, V1), Color};
+            Vertex[2] = {glm::vec2(XPos + W, YPos),     glm::vec2(U1, V1), Color};
+            Vertex[3] = {glm::vec2(XPos,     YPos + H), glm::vec2(U0, V0), Color};
+            Vertex[4] = {glm::vec2(XPos + W, YPos),     glm::vec2(U1, V1), Color};
+            Vertex[5] = {glm::vec2(XPos + W, YPos + H), glm::vec2(U1, V0), Color};
+            Result += 6;
+        }
+
+        // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+        Position.x += (Ch->Advance >> 6) * Scale.x; // Bitshift by 6 to get value in pixels (2^6 = 64)
+    }
+
+    return Result;
+}
+
+void R_PushText(renderer *Renderer, char *Text, font *Font, glm::vec2 Position, glm::vec2 Scale, glm::vec3 Color)
+{
+    // Lays out the string into the text batch, a change of font or a full batch breaks the batch
+    size_t VertexCount = strlen(Text) * 6;
+    if(Renderer->TextBatchFont != Font ||
+       Renderer->TextVertexCount + VertexCount > TEXT_BATCH_MAX_GLYPHS * 6)
+    {
+        R_FlushText(Renderer);
+        Renderer->TextBatchFont = Font;
+    }
+
+    Renderer->TextVertexCount += R_LayoutText(Renderer->TextVertices + Renderer->TextVertexCount, TEXT_BATCH_MAX_GLYPHS * 6 - Renderer->TextVertexCount,
+                                              Text, Font, Position, Scale, Color);
+}
+
+void R_FlushTextObjects(renderer *Renderer)
+{
+    // Draws every text object pushed since the last flush, they all share a font
+    if(Renderer->RetainedTextBatchCount == 0)
+    {
+        return;
+    }
+
+    R_UseProgram(Renderer->Shaders.Text);
+    f32 TextBrightnessThreshold = 1.0f;
+    R_SetUniform(Renderer->Uniforms.TextBrightnessThreshold, TextBrightnessThreshold);
+    R_SetUniform(Renderer->Uniforms.TextDistanceField, Renderer->RetainedTextBatchFont->IsDistanceField);
+    R_BindTexture(0, Renderer->RetainedTextBatchFont->Texture);
+    R_BindVertexArray(Renderer->RetainedTextVAO);
+    R_BeginGPUTimer(Renderer, GPUPass_Text);
+    glMultiDrawArrays(GL_TRIANGLES, Renderer->RetainedTextFirst, Renderer->RetainedTextCounts, Renderer->RetainedTextBatchCount); Renderer->CurrentDrawCallsPerFrame++;
+    R_EndGPUTimer(Renderer);
+
+    Renderer->RetainedTextBatchCount = 0;
+}
+
+void R_PushTextObject(renderer *Renderer, text_object *Object)
+{
+    if(Object->IsDirty)
+    {
+        // Only runs when the string or the style changed since the last upload
+        u32 MaxVertexCount = TEXT_OBJECT_MAX_LENGTH * 6;
+        text_vertex *Vertices = PushArray(&Renderer->FrameArena, MaxVertexCount, text_vertex);
+        if(!Vertices)
+        {
+            return;
+        }
+
+        Object->VertexCount = R_LayoutText(Vertices, MaxVertexCount, Object->Text, Object->Font, Object->Position, Object->Scale, Object->Color);
+        R_BindBuffer(GL_ARRAY_BUFFER, Renderer->RetainedTextBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(text_vertex) * Object->FirstVertex, sizeof(text_vertex) * Object->VertexCount, Vertices);
+        Object->IsDirty = false;
+    }
+
+    if(Object->VertexCount == 0)
+    {
+        return;
+    }
+
+    if(Renderer->RetainedTextBatchFont != Object->Font ||
+       Renderer->RetainedTextBatchCount == TEXT_MAX_OBJECTS)
+    {
+        R_FlushTextObjects(Renderer);
+        Renderer->RetainedTextBatchFont = Object->Font;
+    }
+
+    Renderer->RetainedTextFirst[Renderer->RetainedTextBatchCount] = (i32)Object->FirstVertex;
+    Renderer->RetainedTextCounts[Renderer->RetainedTextBatchCount] = (i32)Object->VertexCount;
+    Renderer->RetainedTextBatchCount++;
+}
+
+void R_FlushBatches(renderer *Renderer)
+{
+    R_FlushSprites(Renderer);
+    R_FlushText(Renderer);
+    R_FlushTextObjects(Renderer);
+}
+
+u64 R_MakeSortKey(render_layer Layer, b32 IsTranslucent, u32 Shader, u32 Texture, f32 Depth)
+{
+    // See the key layout in renderer.h
+    shader_program *Program = R_GetShaderProgram(Shader);
+    u64 ShaderIndex = Program ? (u64)(Program - ShaderPrograms__) : 0;
+    u64 TextureBits = Texture & 0xFFFF;
+
+    // Positive floats sort like integers, keep the 24 most significant bits
+    // (the sign is always 0)
+    u32 DepthFloatBits;
+    Depth = Depth > 0.0f ? Depth : 0.0f;
+    memcpy(&DepthFloatBits, &Depth, sizeof(DepthFloatBits));
+    u64 DepthBits = (DepthFloatBits >> 7) & 0xFFFFFF;
+
+    u64 Result = (u64)Layer << 60;
+    if(IsTranslucent)
+    {
+        // Back to front, the farthest sprite has the smallest key
+        Result |= (u64)1 << 59;
+        Result |= (0xFFFFFF - DepthBits) << 35;
+        Result |= (ShaderIndex & 0xFF) << 27;
+        Result |= TextureBits << 11;
+    }
+    else
+    {
+        // Grouped by state, then front to back so the depth test rejects hidden fragments early
+        Result |= (ShaderIndex & 0xFF) << 51;
+        Result |= TextureBits << 35;
+        Result |= DepthBits << 11;
+    }
+
+    return Result;
+}
+
+b32 R_IsTranslucentKey(u64 Key)
+{
+    return (Key >> 59) & 1;
+}
+
+f32 R_GetViewDepth(renderer *Renderer, glm::vec3 Position)
+{
+    // Distance in front of the camera, the camera looks down -Z in view space
+    return -(Renderer->View * glm::vec4(Position, 1.0f)).z;
+}
+
+void *R_PushCommand(renderer *Renderer, render_command_type Type, u64 Key, size_t DataSize)
+{
+    // Returns the command's data or NULL when the command buffer is full, safe to call from any thread
+    u32 Index = (u32)SDL_AtomicAdd(&Renderer->CommandCount, 1);
+    if(Index >= RENDER_MAX_COMMANDS)
+    {
+        return NULL;
+    }
+
+    void *Data = PushSize(&Renderer->FrameArena, DataSize);
+    render_command *Command = &Renderer->Commands[Index];
+    Command->Key = Key;
+    Command->Type = Type;
+    Command->Data = Data; // NULL when the arena is full, R_ExecuteCommands skips it
+
+    return Data;
+}
+
+void R_SortCommands(render_command *Commands, render_command *Temp, u32 Count)
+{
+    PF_SCOPE("R_SortCommands");
+    // LSD radix sort, one pass per key byte. It's stable, so commands
+    // with equal keys keep their submission order.
+    render_command *Source = Commands;
+    render_command *Destination = Temp;
+    for(u32 Byte = 0; Byte < 8; Byte++)
+    {
+        u32 Shift = Byte * 8;
+        u32 Offsets[256] = {};
+        for(u32 i = 0; i < Count; i++)
+        {
+            Offsets[(Source[i].Key >> Shift) & 0xFF]++;
+        }
+
+        // Every key has the same value in this byte, nothing to move
+        if(Offsets[(Source[0].Key >> Shift) & 0xFF] == Count)
+        {
+            continue;
+        }
+
+        u32 Total = 0;
+        for(u32 Bucket = 0; Bucket < 256; Bucket++)
+        {
+            u32 BucketCount = Offsets[Bucket];
+            Offsets[Bucket] = Total;
+            Total += BucketCount;
+        }
+
+        for(u32 i = 0; i < Count; i++)
+        {
+            Destination[Offsets[(Source[i].Key >> Shift) & 0xFF]++] = Source[i];
+        }
+
+        render_command *Swap = Source;
+        Source = Destination;
+        Destination = Swap;
+    }
+
+    if(Source != Commands)
+    {
+        memcpy(Commands, Source, sizeof(render_command) * Count);
+    }
+}
+
+void R_ExecuteCommands(renderer *Renderer)
+{
+    PF_SCOPE("R_ExecuteCommands");
+    u32 Count = (u32)SDL_AtomicGet(&Renderer->CommandCount);
+    Count = Count < RENDER_MAX_COMMANDS ? Count : RENDER_MAX_COMMANDS;
+
+    if(Count > 0)
+    {
+        render_command *Temp = PushArray(&Renderer->FrameArena, Count, render_command);
+        if(Temp)
+        {
+            R_SortCommands(Renderer->Commands, Temp, Count);
+        }
+        // NOTE: Without scratch memory for the sort we draw in submission order
+    }
+
+    i32 CurrentlyTranslucent = -1; // Unknown until the first command
+    GLenum CurrentBlendSource = GL_SRC_ALPHA;
+    GLenum CurrentBlendDestination = GL_ONE_MINUS_SRC_ALPHA;
+    i32 CurrentType = -1;
+    for(u32 i = 0; i < Count; i++)
+    {
+        render_command *Command = &Renderer->Commands[i];
+        if(!Command->Data)
+        {
+            continue;
+        }
+
+        // Sprites, text and text objects have their own batch, draw what
+        // the previous one has before switching
+        if((i32)Command->Type != CurrentType)
+        {
+            R_FlushBatches(Renderer);
+            CurrentType = (i32)Command->Type;
+        }
+
+        // Cooked textures with premultiplied alpha already have their color multiplied,
+        // particles are premultiplied by their shader and added to the scene
+        b32 IsTranslucent = R_IsTranslucentKey(Command->Key);
+        GLenum BlendSource = GL_SRC_ALPHA;
+        GLenum BlendDestination = GL_ONE_MINUS_SRC_ALPHA;
+        if(Command->Type == RenderCommand_Sprite && ((render_command_sprite*)Command->Data)->Texture->IsPremultiplied)
+        {
+            BlendSource = GL_ONE;
+        }
+        else if(Command->Type == RenderCommand_Particles)
+        {
+            BlendSource = GL_ONE;
+            BlendDestination = GL_ONE;
+        }
+        if(IsTranslucent != CurrentlyTranslucent || (IsTranslucent && (BlendSource != CurrentBlendSource || BlendDestination != CurrentBlendDestination)))
+        {
+            // Opaque draws skip blending entirely
+            R_FlushBatches(Renderer);
+            R_SetBlend(IsTranslucent, BlendSource, BlendDestination);
+            CurrentlyTranslucent = IsTranslucent;
+            CurrentBlendSource = BlendSource;
+            CurrentBlendDestination = BlendDestination;
+        }
+
+        switch(Command->Type)
+        {
+            case RenderCommand_Sprite:
+            {
+                render_command_sprite *Sprite = (render_command_sprite*)Command->Data;
+                R_PushSprite(Renderer, Sprite->Shader, Sprite->Texture, Sprite->Position, Sprite->Size, Sprite->RotationAngle, Sprite->Tint, Sprite->Threshold);
+                break;
+            }
+            case RenderCommand_Text:
+            {
+                render_command_text *Text = (render_command_text*)Command->Data;
+                R_PushText(Renderer, Text->Text, Text->Font, Text->Position, Text->Scale, Text->Color);
+                break;
+            }
+            case RenderCommand_TextObject:
+            {
+                render_command_text_object *TextObject = (render_command_text_object*)Command->Data;
+                R_PushTextObject(Renderer, TextObject->Object);
+                break;
+            }
+            case RenderCommand_Particles:
+            {
+                R_DrawParticles(Renderer, (render_command_particles*)Command->Data);
+                break;
+            }
+            default:
+            {
+                InvalidCodePath;
+                break;
+            }
+        }
+    }
+    R_FlushBatches(Renderer);
+
+    SDL_AtomicSet(&Renderer->CommandCount, 0);
+    ResetArena(&Renderer->FrameArena);
+}
+
+size_t R_GetFormatBytes(GLenum Format)
+{
+    switch(Format)
+    {
+        case GL_RGBA16F: return 8;
+        case GL_R11F_G11F_B10F: return 4;
+        case GL_DEPTH24_STENCIL8: return 4;
+        default: return 4;
+    }
+}
+
+b32 R_IsDepthFormat(GLenum Format)
+{
+    return Format == GL_DEPTH24_STENCIL8;
+}
+
+size_t R_GetRenderTargetBytes(GLenum Format, i32 Width, i32 Height, i32 Samples)
+{
+    return (size_t)Width * (size_t)Height * (size_t)SDL_max(Samples, 1) * R_GetFormatBytes(Format);
+}
+
+u32 R_AddRenderResource(render_graph *Graph, char *Name, GLenum Format, i32 Width, i32 Height, i32 Samples = 0)
+{
+    Assert(Graph->ResourceCount < RENDER_GRAPH_MAX_RESOURCES);
+    u32 Result = Graph->ResourceCount++;
+    render_resource *Resource = &Graph->Resources[Result];
+    *Resource = {};
+    Resource->Name = Name;
+    Resource->Format = Format;
+    Resource->Width = Width;
+    Resource->Height = Height;
+    Resource->Samples = Samples;
+    return Result;
+}
+
+u32 R_ImportRenderResource(render_graph *Graph, char *Name)
+{
+    // Drawn into, never allocated, passes that write it are never culled
+    u32 Result = R_AddRenderResource(Graph, Name, GL_RGBA8, 0, 0);
+    Graph->Resources[Result].IsImported = true;
+    return Result;
+}
+
+u32 R_AddRenderPass(render_graph *Graph, char *Name, render_pass_type Type, gpu_pass Timer)
+{
+    Assert(Graph->PassCount < RENDER_GRAPH_MAX_PASSES);
+    u32 Result = Graph->PassCount++;
+    render_pass *Pass = &Graph->Passes[Result];
+    *Pass = {};
+    Pass->Name = Name;
+    Pass->Type = Type;
+    Pass->Timer = Timer;
+    return Result;
+}
+
+void R_ReadResource(render_graph *Graph, u32 Pass, u32 Resource)
+{
+    render_pass *RenderPass = &Graph->Passes[Pass];
+    Assert(RenderPass->ReadCount < RENDER_GRAPH_MAX_READS);
+    RenderPass->Reads[RenderPass->ReadCount++] = Resource;
+}
+
+void R_WriteResource(render_graph *Graph, u32 Pass, u32 Resource)
+{
+    render_pass *RenderPass = &Graph->Passes[Pass];
+    Assert(RenderPass->WriteCount < RENDER_GRAPH_MAX_WRITES);
+    RenderPass->Writes[RenderPass->WriteCount++] = Resource;
+}
+
+void R_CreateRenderTarget(render_target *Target)
+{
+    if(Target->IsRenderbuffer)
+    {
+        glGenRenderbuffers(1, &Target->Handle);
+        glBindRenderbuffer(GL_RENDERBUFFER, Target->Handle);
+        if(Target->Samples > 0)
+        {
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, Target->Samples, Target->Format, Target->Width, Target->Height);
+        }
+        else
+        {
+            glRenderbufferStorage(GL_RENDERBUFFER, Target->Format, Target->Width, Target->Height);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        return;
+    }
+
+    glGenTextures(1, &Target->Handle);
+    R_BindTextureForUpload(Target->Handle);
+    GLenum Format = Target->Format == GL_R11F_G11F_B10F ? GL_RGB : GL_RGBA;
+    glTexImage2D(GL_TEXTURE_2D, 0, Target->Format, Target->Width, Target->Height, 0, Format, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void R_DeleteRenderTarget(render_target *Target)
+{
+    if(Target->IsRenderbuffer)
+    {
+        glDeleteRenderbuffers(1, &Target->Handle);
+        Target->Handle = 0;
+    }
+    else
+    {
+        R_DeleteTexture(&Target->Handle);
+    }
+}
+
+void R_AttachRenderTarget(GLenum Attachment, render_target *Target)
+{
+    if(Target->IsRenderbuffer)
+    {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, Attachment, GL_RENDERBUFFER, Target->Handle);
+    }
+    else
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, Attachment, GL_TEXTURE_2D, Target->Handle, 0);
+    }
+}
+
+void R_ResetRenderGraph(render_graph *Graph)
+{
+    // Forgets the passes and resources, the targets stay in the pool
+    R_BindFramebuffer(0);
+    for(u32 i = 0; i < Graph->PassCount; i++)
+    {
+        glDeleteFramebuffers(1, &Graph->Passes[i].Framebuffer);
+        glDeleteFramebuffers(1, &Graph->Passes[i].ReadFramebuffer);
+    }
+    Graph->PassCount = 0;
+    Graph->ResourceCount = 0;
+}
+
+b32 R_CompileRenderGraph(render_graph *Graph)
+{
+    // Culls, aliases and allocates, see the render graph in renderer.h.
+    // Returns false when a framebuffer is not complete.
+    Graph->CulledPassCount = 0;
+    Graph->AliasedResourceCount = 0;
+    Graph->DeclaredBytes = 0;
+    for(u32 i = 0; i < Graph->ResourceCount; i++)
+    {
+        render_resource *Resource = &Graph->Resources[i];
+        Resource->IsUsed = Resource->IsImported;
+        Resource->FirstPass = -1;
+        Resource->LastPass = -1;
+        if(!Resource->IsImported)
+        {
+            Graph->DeclaredBytes += R_GetRenderTargetBytes(Resource->Format, Resource->Width, Resource->Height, Resource->Samples);
+        }
+    }
+
+    // 1- Cull the passes whose writes nobody reads
+    for(i32 PassIndex = (i32)Graph->PassCount - 1; PassIndex >= 0; PassIndex--)
+    {
+        render_pass *Pass = &Graph->Passes[PassIndex];
+        Pass->IsCulled = true;
+        for(u32 i = 0; i < Pass->WriteCount; i++)
+        {
+            if(Graph->Resources[Pass->Writes[i]].IsUsed)
+            {
+                Pass->IsCulled = false;
+            }
+        }
+
+        if(Pass->IsCulled)
+        {
+            Graph->CulledPassCount++;
+            continue;
+        }
+        for(u32 i = 0; i < Pass->ReadCount; i++)
+        {
+            Graph->Resources[Pass->Reads[i]].IsUsed = true;
+        }
+    }
+
+    // 2- Lifetimes, from the first write to the last access
+    for(u32 PassIndex = 0; PassIndex < Graph->PassCount; PassIndex++)
+    {
+        render_pass *Pass = &Graph->Passes[PassIndex];
+        if(Pass->IsCulled)
+        {
+            continue;
+        }
+
+        for(u32 i = 0; i < Pass->ReadCount; i++)
+        {
+            render_resource *Resource = &Graph->Resources[Pass->Reads[i]];
+            Assert(Resource->FirstPass != -1); // Read before any pass wrote it
+            Resource->LastPass = (i32)PassIndex;
+        }
+        for(u32 i = 0; i < Pass->WriteCount; i++)
+        {
+            render_resource *Resource = &Graph->Resources[Pass->Writes[i]];
+            if(R_IsDepthFormat(Resource->Format))
+            {
+                Resource->IsUsed = true; // The depth test of its own pass reads it
+            }
+            if(Resource->IsUsed)
+            {
+                if(Resource->FirstPass == -1)
+                {
+                    Resource->FirstPass = (i32)PassIndex;
+                }
+                Resource->LastPass = (i32)PassIndex;
+            }
+        }
+    }
+
+    // 3- Targets, a resource takes the smallest free target it fits in
+    render_target Targets[RENDER_GRAPH_MAX_TARGETS] = {};
+    u32 TargetCount = 0;
+    for(u32 PassIndex = 0; PassIndex < Graph->PassCount; PassIndex++)
+    {
+        for(u32 i = 0; i < Graph->ResourceCount; i++)
+        {
+            render_resource *Resource = &Graph->Resources[i];
+            if(!Resource->IsUsed || Resource->IsImported || Resource->FirstPass != (i32)PassIndex)
+            {
+                continue;
+            }
+
+            i32 Best = -1;
+            for(u32 t = 0; t < TargetCount; t++)
+            {
+                render_target *Target = &Targets[t];
+                if(Target->FreeAfter < (i32)PassIndex &&
+                   Target->Format == Resource->Format &&
+                   Target->Samples == Resource->Samples &&
+                   Target->Width >= Resource->Width &&
+                   Target->Height >= Resource->Height &&
+                   (Best == -1 || Target->Width * Target->Height < Targets[Best].Width * Targets[Best].Height))
+                {
+                    Best = (i32)t;
+                }
+            }
+
+            if(Best == -1)
+            {
+                Assert(TargetCount < RENDER_GRAPH_MAX_TARGETS);
+                Best = (i32)TargetCount++;
+                render_target *Target = &Targets[Best];
+                Target->Format = Resource->Format;
+                Target->Width = Resource->Width;
+                Target->Height = Resource->Height;
+                Target->Samples = Resource->Samples;
+                Target->IsRenderbuffer = Resource->Samples > 0 || R_IsDepthFormat(Resource->Format);
+            }
+            else
+            {
+                Graph->AliasedResourceCount++;
+            }
+            Targets[Best].FreeAfter = Resource->LastPass;
+            Resource->Target = (u32)Best;
+        }
+    }
+
+    // 4- Reuse the GL objects of the last compile that match, create the rest
+    b32 IsKept[RENDER_GRAPH_MAX_TARGETS] = {};
+    Graph->AllocatedBytes = 0;
+    for(u32 t = 0; t < TargetCount; t++)
+    {
+        render_target *Target = &Targets[t];
+        for(u32 Old = 0; Old < Graph->TargetCount; Old++)
+        {
+            render_target *OldTarget = &Graph->Targets[Old];
+            if(!IsKept[Old] &&
+               OldTarget->Format == Target->Format && OldTarget->Samples == Target->Samples &&
+               OldTarget->Width == Target->Width && OldTarget->Height == Target->Height)
+            {
+                Target->Handle = OldTarget->Handle;
+                IsKept[Old] = true;
+                break;
+            }
+        }
+
+        if(Target->Handle == 0)
+        {
+            R_CreateRenderTarget(Target);
+        }
+        Graph->AllocatedBytes += R_GetRenderTargetBytes(Target->Format, Target->Width, Target->Height, Target->Samples);
+    }
+    for(u32 Old = 0; Old < Graph->TargetCount; Old++)
+    {
+        if(!IsKept[Old])
+        {
+            R_DeleteRenderTarget(&Graph->Targets[Old]);
+        }
+    }
+    memcpy(Graph->Targets, Targets, sizeof(Targets));
+    Graph->TargetCount = TargetCount;
+
+    // 5- Framebuffers, writes nobody reads are left out (GL_NONE)
+    b32 Result = true;
+    for(u32 PassIndex = 0; PassIndex < Graph->PassCount; PassIndex++)
+    {
+        render_pass *Pass = &Graph->Passes[PassIndex];
+        if(Pass->IsCulled || Graph->Resources[Pass->Writes[0]].IsImported)
+        {
+            continue;
+        }
+
+        glGenFramebuffers(1, &Pass->Framebuffer);
+        R_BindFramebuffer(Pass->Framebuffer);
+        GLenum DrawBuffers[RENDER_GRAPH_MAX_WRITES];
+        i32 ColorCount = 0;
+        for(u32 i = 0; i < Pass->WriteCount; i++)
+        {
+            render_resource *Resource = &Graph->Resources[Pass->Writes[i]];
+            render_target *Target = &Graph->Targets[Resource->Target];
+            if(R_IsDepthFormat(Resource->Format))
+            {
+                R_AttachRenderTarget(GL_DEPTH_STENCIL_ATTACHMENT, Target);
+                continue;
+            }
+
+            GLenum Attachment = GL_COLOR_ATTACHMENT0 + ColorCount;
+            DrawBuffers[ColorCount++] = Resource->IsUsed ? Attachment : GL_NONE;
+            if(Resource->IsUsed)
+            {
+                R_AttachRenderTarget(Attachment, Target);
+            }
+        }
+        glDrawBuffers(ColorCount, DrawBuffers);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            printf("%s Framebuffer is not complete\n", Pass->Name);
+            Result = false;
+        }
+
+        if(Pass->Type == RenderPass_Resolve)
+        {
+            glGenFramebuffers(1, &Pass->ReadFramebuffer);
+            R_BindFramebuffer(Pass->ReadFramebuffer);
+            render_resource *Source = &Graph->Resources[Pass->Reads[0]];
+            R_AttachRenderTarget(GL_COLOR_ATTACHMENT0, &Graph->Targets[Source->Target]);
+            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                printf("%s read Framebuffer is not complete\n", Pass->Name);
+                Result = false;
+            }
+        }
+    }
+    R_BindFramebuffer(0);
+
+    return Result;
+}
+
+u64 R_GetRenderGraphKey(renderer *Renderer)
+{
+    // Every setting R_BuildRenderGraph reads, the graph is built again when one changes
+    u64 Key = (u64)Renderer->TargetWidth;
+    Key |= (u64)Renderer->TargetHeight << 16;
+    Key |= (u64)Renderer->AntiAliasing << 32;
+    Key |= (u64)Renderer->MultisampleCount << 36;
+    Key |= (u64)(EnableBloom != 0) << 44;
+    Key |= (u64)BloomMipCount << 45;
+    return Key;
+}
+
+global char *BloomLevelNames__[BLOOM_MAX_MIPS] = { "Bloom level 0", "Bloom level 1", "Bloom level 2", "Bloom level 3", "Bloom level 4" };
+
+void R_BuildRenderGraph(renderer *Renderer)
+{
+    // Declares every pass after the command buffer for the current
+    // settings, at the size of the render targets, and compiles them.
+    render_graph *Graph = &Renderer->RenderGraph;
+    R_ResetRenderGraph(Graph);
+    Graph->Key = R_GetRenderGraphKey(Renderer);
+
+    i32 Width = (i32)Renderer->TargetWidth;
+    i32 Height = (i32)Renderer->TargetHeight;
+    b32 IsMultisampled = Renderer->AntiAliasing == AntiAliasing_MSAA;
+
+    u32 Backbuffer = R_ImportRenderResource(Graph, "Backbuffer");
+    u32 SceneColor = R_AddRenderResource(Graph, "Scene color", GL_RGBA16F, Width, Height);
+    // Only bloom reads the brightness, and only its color, 4 bytes like the bloom chain
+    u32 SceneBrightness = R_AddRenderResource(Graph, "Scene brightness", GL_R11F_G11F_B10F, Width, Height);
+
+    u32 Scene = R_AddRenderPass(Graph, "Scene", RenderPass_Scene, GPUPass_Scene);
+    if(IsMultisampled)
+    {
+        i32 Samples = Renderer->MultisampleCount;
+        u32 MultisampleColor = R_AddRenderResource(Graph, "Multisample color", GL_RGBA16F, Width, Height, Samples);
+        u32 MultisampleBrightness = R_AddRenderResource(Graph, "Multisample brightness", GL_R11F_G11F_B10F, Width, Height, Samples);
+        u32 MultisampleDepth = R_AddRenderResource(Graph, "Multisample depth", GL_DEPTH24_STENCIL8, Width, Height, Samples);
+        R_WriteResource(Graph, Scene, MultisampleColor);
+        R_WriteResource(Graph, Scene, MultisampleBrightness);
+        R_WriteResource(Graph, Scene, MultisampleDepth);
+
+        // A blit reads a single color buffer, one pass per attachment
+        u32 ResolveColor = R_AddRenderPass(Graph, "Resolve color", RenderPass_Resolve, GPUPass_Resolve);
+        R_ReadResource(Graph, ResolveColor, MultisampleColor);
+        R_WriteResource(Graph, ResolveColor, SceneColor);
+        u32 ResolveBrightness = R_AddRenderPass(Graph, "Resolve brightness", RenderPass_Resolve, GPUPass_Resolve);
+        R_ReadResource(Graph, ResolveBrightness, MultisampleBrightness);
+        R_WriteResource(Graph, ResolveBrightness, SceneBrightness);
+    }
+    else
+    {
+        u32 SceneDepth = R_AddRenderResource(Graph, "Scene depth", GL_DEPTH24_STENCIL8, Width, Height);
+        R_WriteResource(Graph, Scene, SceneColor);
+        R_WriteResource(Graph, Scene, SceneBrightness);
+        R_WriteResource(Graph, Scene, SceneDepth);
+    }
+
+    // Bloom chain, every level is half the size of the one above
+    u32 MipCount = SDL_max(SDL_min(BloomMipCount, BLOOM_MAX_MIPS), 1u);
+    u32 Mips[BLOOM_MAX_MIPS];
+    u32 LevelCount = 0;
+    u32 Source = SceneBrightness;
+    i32 MipWidth = Width;
+    i32 MipHeight = Height;
+    for(u32 i = 0; i < MipCount; i++)
+    {
+        MipWidth = SDL_max(MipWidth / 2, 1);
+        MipHeight = SDL_max(MipHeight / 2, 1);
+        Mips[i] = R_AddRenderResource(Graph, BloomLevelNames__[i], GL_R11F_G11F_B10F, MipWidth, MipHeight);
+        u32 Downsample = R_AddRenderPass(Graph, "Bloom downsample", RenderPass_BloomDownsample, GPUPass_BloomDownsample);
+        R_ReadResource(Graph, Downsample, Source);
+        R_WriteResource(Graph, Downsample, Mips[i]);
+        Source = Mips[i];
+        LevelCount++;
+
+        if(MipWidth == 1 && MipHeight == 1)
+        {
+            break;
+        }
+    }
+    for(u32 i = LevelCount - 1; i > 0; i--)
+    {
+        u32 Upsample = R_AddRenderPass(Graph, "Bloom upsample", RenderPass_BloomUpsample, GPUPass_BloomUpsample);
+        R_ReadResource(Graph, Upsample, Mips[i]);
+        R_WriteResource(Graph, Upsample, Mips[i - 1]);
+    }
+
+    // Without bloom nobody reads the chain and every pass of it is culled
+    u32 Composite = R_AddRenderPass(Graph, "Composite", RenderPass_Composite, GPUPass_Composite);
+    R_ReadResource(Graph, Composite, SceneColor);
+    if(EnableBloom)
+    {
+        R_ReadResource(Graph, Composite, Mips[0]);
+    }
+    R_WriteResource(Graph, Composite, Backbuffer);
+
+    Graph->IsComplete = R_CompileRenderGraph(Graph);
+    if(!Graph->IsComplete)
+    {
+        if(IsMultisampled)
+        {
+            printf("Multisample Framebuffer not complete, falling back to FXAA\n");
+            Renderer->AntiAliasing = AntiAliasing_FXAA;
+            R_BuildRenderGraph(Renderer);
+            return;
+        }
+        printf("Framebuffer not complete, exiting!\n");
+        exit(-1);
+    }
+
+    // Cost of the current anti-aliasing mode
+    Renderer->AntiAliasingBytes = 0;
+    Renderer->AntiAliasingReadsPerPixel = 0;
+    for(u32 t = 0; t < Graph->TargetCount; t++)
+    {
+        render_target *Target = &Graph->Targets[t];
+        if(Target->Samples > 0)
+        {
+            Renderer->AntiAliasingBytes += R_GetRenderTargetBytes(Target->Format, Target->Width, Target->Height, Target->Samples);
+        }
+    }
+    if(Renderer->AntiAliasing == AntiAliasing_FXAA)
+    {
+        Renderer->AntiAliasingReadsPerPixel = 9; // 5 to find the edge, 4 along it, see bloom.glsl
+    }
+    else if(IsMultisampled)
+    {
+        // The resolve reads every sample of both color attachments
+        Renderer->AntiAliasingReadsPerPixel = (u32)Renderer->MultisampleCount * (EnableBloom ? 2 : 1);
+    }
+
+    printf("Render graph: %u of %u passes, %u targets (%u resources aliased), %.1f MB, %.1f MB declared\n",
+           Graph->PassCount - Graph->CulledPassCount, Graph->PassCount, Graph->TargetCount, Graph->AliasedResourceCount,
+           (f64)Graph->AllocatedBytes / (1024.0 * 1024.0), (f64)Graph->DeclaredBytes / (1024.0 * 1024.0));
+}
+
+void R_ExecuteRenderGraph(renderer *Renderer)
+{
+    render_graph *Graph = &Renderer->RenderGraph;
+
+    // Part of every resource drawn this frame, see dynamic resolution
+    i32 UsedWidth[RENDER_GRAPH_MAX_RESOURCES] = {};
+    i32 UsedHeight[RENDER_GRAPH_MAX_RESOURCES] = {};
+
+    // Consecutive passes of the same GPU pass share one timer query
+    i32 Timer = -1;
+    for(u32 PassIndex = 0; PassIndex < Graph->PassCount; PassIndex++)
+    {
+        render_pass *Pass = &Graph->Passes[PassIndex];
+        if(Pass->IsCulled)
+        {
+            continue;
+        }
+
+        // NOTE: The command buffer times its own batches, GL_TIME_ELAPSED queries can not be nested
+        if(Timer != -1 && (Pass->Type == RenderPass_Scene || Timer != (i32)Pass->Timer))
+        {
+            R_EndGPUTimer(Renderer);
+            Timer = -1;
+        }
+        if(Timer == -1 && Pass->Type != RenderPass_Scene)
+        {
+            R_BeginGPUTimer(Renderer, Pass->Timer);
+            Timer = (i32)Pass->Timer;
+        }
 
-// NOTE: Textures used by the renderer 32 floating point srgb textures
+        switch(Pass->Type)
+        {
+            case RenderPass_Scene:
+            {
+                for(u32 i = 0; i < Pass->WriteCount; i++)
+                {
+                    UsedWidth[Pass->Writes[i]] = (i32)Renderer->RenderWidth;
+                    UsedHeight[Pass->Writes[i]] = (i32)Renderer->RenderHeight;
+                }
 
-// Global renderer settings
-global f32 Exposure__ = 2.0f;
-global f32 EnableVSync = 0;
-global i32 EnableBloom = 1; // NOTE: This turns off a boolean in the bloom glsl shader.
-global u32 BlurPassCount = 7; // How many times should we blurr the image
-global glm::vec4 BackgroundColor = glm::vec4(0.01f, 0.01f, 0.01f, 1.0f);
-global glm::vec4 MenuBackgroundColor = glm::vec4(0.005f, 0.005f, 0.005f, 1.0f);
-global f32 BrightnessThreshold = 0.1f;
-global f32 CameraSpeed = 7.0f;
+                // Only the part of the render targets the scene is drawn into is cleared
+                R_BindFramebuffer(Pass->Framebuffer);
+                glViewport(0, 0, Renderer->RenderWidth, Renderer->RenderHeight);
+                glScissor(0, 0, Renderer->RenderWidth, Renderer->RenderHeight);
+                glEnable(GL_SCISSOR_TEST);
+                glClearColor(Renderer->BackgroundColor.r, Renderer->BackgroundColor.g, Renderer->BackgroundColor.b, Renderer->BackgroundColor.a);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glDisable(GL_SCISSOR_TEST);
 
-void R_UpdateCamera(renderer *Renderer, camera *Camera)
-{
-    Camera->Projection = glm::perspective(glm::radians(Camera->FoV), (f32)Renderer->Window->Width / (f32)Renderer->Window->Height, Camera->Near, Camera->Far);
-    Camera->Ortho = glm::ortho(0.0f, (f32)Renderer->Window->Width, 0.0f, (f32)Renderer->Window->Height);
-    Camera->View = glm::lookAt(Camera->Position, Camera->Position + Camera->Front, Camera->Up);
+                R_ExecuteCommands(Renderer);
+                R_SetBlend(false);
+            } break;
 
-    { // Upload new camera matrices to UBO
-        glBindBuffer(GL_UNIFORM_BUFFER, Renderer->UniformCameraBuffer);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(Camera->Projection)); // NOTE: As long as we dont change the FoV or Width/Height of windows, the projection remains the same. We could not update it every frame.
-        glBufferSubData(GL_UNIFORM_BUFFER, 64, sizeof(glm::mat4), glm::value_ptr(Camera->Ortho));
-        glBufferSubData(GL_UNIFORM_BUFFER, 128, sizeof(glm::mat4), glm::value_ptr(Camera->View));
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            case RenderPass_Resolve:
+            {
+                u32 Source = Pass->Reads[0];
+                u32 Destination = Pass->Writes[0];
+                UsedWidth[Destination] = UsedWidth[Source];
+                UsedHeight[Destination] = UsedHeight[Source];
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, Pass->ReadFramebuffer);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, Pass->Framebuffer);
+                glBlitFramebuffer(0, 0, UsedWidth[Source], UsedHeight[Source],
+                                  0, 0, UsedWidth[Source], UsedHeight[Source],
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+                // NOTE: Read and draw framebuffers were bound separately, rebind both so gl_state stays right
+                glBindFramebuffer(GL_FRAMEBUFFER, Pass->Framebuffer);
+                GLState__.Framebuffer = Pass->Framebuffer;
+                GLState__.Changes += 3;
+            } break;
+
+            case RenderPass_BloomDownsample:
+            case RenderPass_BloomUpsample:
+            {
+                // NOTE: SourceScale is the part of the source target drawn this frame
+                u32 Source = Pass->Reads[0];
+                u32 Destination = Pass->Writes[0];
+                render_target *SourceTarget = &Graph->Targets[Graph->Resources[Source].Target];
+                if(Pass->Type == RenderPass_BloomDownsample)
+                {
+                    UsedWidth[Destination] = SDL_max(UsedWidth[Source] / 2, 1);
+                    UsedHeight[Destination] = SDL_max(UsedHeight[Source] / 2, 1);
+                    R_UseProgram(Renderer->Shaders.BloomDownsample);
+                }
+                else
+                {
+                    R_UseProgram(Renderer->Shaders.BloomUpsample);
+                }
+
+                R_BindFramebuffer(Pass->Framebuffer);
+                glViewport(0, 0, UsedWidth[Destination], UsedHeight[Destination]);
+                R_BindTexture(0, SourceTarget->Handle);
+                glm::vec2 SourceScale = glm::vec2((f32)UsedWidth[Source] / (f32)SourceTarget->Width,
+                                                  (f32)UsedHeight[Source] / (f32)SourceTarget->Height);
+                if(Pass->Type == RenderPass_BloomDownsample)
+                {
+                    R_SetUniform(Renderer->Uniforms.BloomDownsampleSourceScale, SourceScale);
+                }
+                else
+                {
+                    R_SetUniform(Renderer->Uniforms.BloomUpsampleSourceScale, SourceScale);
+                }
+                R_DrawUnitQuad(Renderer);
+            } break;
+
+            case RenderPass_Composite:
+            {
+                // Render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
+                u32 Scene = Pass->Reads[0];
+                render_target *SceneTarget = &Graph->Targets[Graph->Resources[Scene].Target];
+                b32 IsBloomRead = Pass->ReadCount > 1;
+                glm::vec2 BloomScale = glm::vec2(1.0f);
+                u32 BloomTexture = 0;
+                if(IsBloomRead)
+                {
+                    u32 Bloom = Pass->Reads[1];
+                    render_target *BloomTarget = &Graph->Targets[Graph->Resources[Bloom].Target];
+                    BloomTexture = BloomTarget->Handle;
+                    BloomScale = glm::vec2((f32)UsedWidth[Bloom] / (f32)BloomTarget->Width,
+                                           (f32)UsedHeight[Bloom] / (f32)BloomTarget->Height);
+                }
+
+                // The backbuffer is imported, the window or the headless output framebuffer
+                glViewport(0, 0, Renderer->DrawableWidth, Renderer->DrawableHeight);
+                R_BindFramebuffer(Renderer->OutputFramebuffer);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                R_UseProgram(Renderer->Shaders.Bloom);
+                R_BindTexture(0, SceneTarget->Handle);
+                R_BindTexture(1, BloomTexture);
+                R_SetUniform(Renderer->Uniforms.BloomEnabled, IsBloomRead);
+                R_SetUniform(Renderer->Uniforms.BloomExposure, Renderer->Exposure);
+                R_SetUniform(Renderer->Uniforms.BloomFXAA, (i32)(Renderer->AntiAliasing == AntiAliasing_FXAA));
+                R_SetUniform(Renderer->Uniforms.BloomSceneScale, glm::vec2((f32)UsedWidth[Scene] / (f32)SceneTarget->Width,
+                                                                           (f32)UsedHeight[Scene] / (f32)SceneTarget->Height));
+                R_SetUniform(Renderer->Uniforms.BloomBlurScale, BloomScale);
+                R_DrawUnitQuad(Renderer);
+            } break;
+        }
     }
 
+    if(Timer != -1)
+    {
+        R_EndGPUTimer(Renderer);
+    }
 }
 
-void R_DrawUnitQuad(renderer *Renderer)
+void R_SetRenderScale(renderer *Renderer, f32 Scale)
 {
-    glBindVertexArray(Renderer->UnitQuadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); Renderer->CurrentDrawCallsPerFrame++;
-    glBindVertexArray(0);
+    // The scene is drawn into the bottom left RenderWidth x RenderHeight
+    // of the render targets, in steps of RENDER_SCALE_PIXEL_STEP pixels
+    // so small changes of the scale do not move the viewport every frame.
+    Scale = glm::clamp(Scale, RENDER_MIN_SCALE, 1.0f);
+    u32 Width = (u32)((f32)Renderer->DrawableWidth * Scale) / RENDER_SCALE_PIXEL_STEP * RENDER_SCALE_PIXEL_STEP;
+    u32 Height = (u32)((f32)Renderer->DrawableHeight * Scale) / RENDER_SCALE_PIXEL_STEP * RENDER_SCALE_PIXEL_STEP;
+    if(Scale == 1.0f)
+    {
+        Width = Renderer->DrawableWidth;
+        Height = Renderer->DrawableHeight;
+    }
+
+    Renderer->RenderScale = Scale;
+    Renderer->RenderWidth = SDL_min(SDL_max(Width, 1u), Renderer->TargetWidth);
+    Renderer->RenderHeight = SDL_min(SDL_max(Height, 1u), Renderer->TargetHeight);
 }
 
-u32 R_CreateShader(char *Filename)
+void R_UpdateRenderScale(renderer *Renderer)
 {
-    Assert(Filename);
-
-    u32 Result;
-    char *SourceFile = ReadTextFile(Filename);
-
-    // Compile Vertex Shader
-    u32 VertexShaderObject = glCreateShader(GL_VERTEX_SHADER);
-    char *VertexSource[2] = {"#version 330 core\n#define VERTEX_SHADER\n", SourceFile};
-    glShaderSource(VertexShaderObject, 2, VertexSource, NULL);
-    glCompileShader(VertexShaderObject);
-    i32 Compiled;
-    glGetShaderiv(VertexShaderObject, GL_COMPILE_STATUS, &Compiled);
-    if (Compiled != GL_TRUE)
-    {
-        i32 LogLength = 0;
-        char ErrorMessage[1024];
-        glGetShaderInfoLog(VertexShaderObject, 1024, &LogLength, ErrorMessage);
-        fprintf(stderr, "%s-%s\n", Filename, ErrorMessage);
-        VertexShaderObject = 0;
-    }
-
-    // Compile Fragment Shader
-    u32 FragmentShaderObject = glCreateShader(GL_FRAGMENT_SHADER);
-    char *FragmentSource[2] = {"#version 330 core\n#define FRAGMENT_SHADER\n", SourceFile};
-    glShaderSource(FragmentShaderObject, 2, FragmentSource, NULL);
-    glCompileShader(FragmentShaderObject);
-    // i32 Compiled;
-    glGetShaderiv(FragmentShaderObject, GL_COMPILE_STATUS, &Compiled);
-    if (Compiled != GL_TRUE)
-    {
-        i32 LogLength = 0;
-        char ErrorMessage[1024];
-        glGetShaderInfoLog(FragmentShaderObject, 1024, &LogLength, ErrorMessage);
-        fprintf(stderr, "%s-%s\n", Filename, ErrorMessage);
-        FragmentShaderObject = 0;
-    }
-
-    // Link program
-    Result = glCreateProgram();
-    glAttachShader(Result, VertexShaderObject);
-    glAttachShader(Result, FragmentShaderObject);
-    glLinkProgram(Result);
-    i32 IsLinked = 0;
-    glGetProgramiv(Result, GL_LINK_STATUS, (GLint *)&IsLinked);
-    if (IsLinked == GL_FALSE)
+    if(!EnableDynamicResolution)
     {
-        i32 MaxLogLength = 1024;
-        char InfoLog[1024] = {0};
-        glGetProgramInfoLog(Result, MaxLogLength, &MaxLogLength, &InfoLog[0]);
-        printf("%s: SHADER PROGRAM FAILED TO COMPILE/LINK\n", Filename);
-        printf("%s\n", InfoLog);
-        glDeleteProgram(Result);
-        Result = 0;
+        if(Renderer->RenderScale != 1.0f)
+        {
+            R_SetRenderScale(Renderer, 1.0f);
+        }
+        return;
     }
 
-    glDeleteShader(VertexShaderObject);
-    glDeleteShader(FragmentShaderObject);
-    Free(SourceFile);
+    if(Renderer->GPUFrameMs <= 0.0f)
+    {
+        return;
+    }
 
-    return Result;
+    // GPU time grows with the pixel count, the square of the scale. Aim
+    // for the scale that would hit the budget and move a tenth of the
+    // way there every frame, one slow frame does not drop the resolution.
+    f32 MeasuredScale = (f32)Renderer->RenderWidth / (f32)Renderer->DrawableWidth;
+    f32 IdealScale = MeasuredScale * sqrtf(GPUFrameBudgetMs / Renderer->GPUFrameMs);
+    IdealScale = glm::clamp(IdealScale, RENDER_MIN_SCALE, 1.0f);
+    R_SetRenderScale(Renderer, Renderer->RenderScale + (IdealScale - Renderer->RenderScale) * 0.1f);
 }
 
-void R_SetUniform(u32 Shader, char *Name, i32 Value)
+void R_EnableReadback(renderer *Renderer, b32 Enabled)
 {
-    Assert(Name);
-    glUniform1i(glGetUniformLocation(Shader, Name), Value);
-}
+    frame_readback *Readback = &Renderer->Readback;
+    if(Readback->IsEnabled == Enabled)
+    {
+        return;
+    }
 
-void R_SetUniform(u32 Shader, char *Name, f32 Value)
-{
-    Assert(Name);
-    glUniform1f(glGetUniformLocation(Shader, Name), Value);
+    if(Enabled)
+    {
+        glGenBuffers(RENDER_READBACK_FRAMES, Readback->Buffers);
+    }
+    else
+    {
+        Assert(!Readback->IsMapped);
+        for(u32 i = 0; i < RENDER_READBACK_FRAMES; i++)
+        {
+            if(Readback->Fences[i])
+            {
+                glDeleteSync(Readback->Fences[i]);
+            }
+            R_DeleteBuffer(&Readback->Buffers[i]);
+        }
+        *Readback = {};
+    }
+    Readback->IsEnabled = Enabled;
 }
 
-void R_SetUniform(u32 Shader, char *Name, glm::mat4 *Value)
+void R_QueueReadback(renderer *Renderer)
 {
-    Assert(Name);
-    glUniformMatrix4fv(glGetUniformLocation(Shader, Name), 1, GL_FALSE, glm::value_ptr(*Value));
-}
+    // Called by R_EndFrame before the swap, the output is still there
+    frame_readback *Readback = &Renderer->Readback;
+    if(!Readback->IsEnabled)
+    {
+        return;
+    }
+    PF_SCOPE("R_QueueReadback");
+    Assert(!Readback->IsMapped);
 
-void R_SetUniform(u32 Shader, char *Name, glm::mat4 Value)
-{
-    Assert(Name);
-    glUniformMatrix4fv(glGetUniformLocation(Shader, Name), 1, GL_FALSE, glm::value_ptr(Value));
+    if(Readback->PendingCount == RENDER_READBACK_FRAMES)
+    {
+        // Nobody mapped the oldest frame, it is overwritten
+        glDeleteSync(Readback->Fences[Readback->First]);
+        Readback->Fences[Readback->First] = 0;
+        Readback->First = (Readback->First + 1) % RENDER_READBACK_FRAMES;
+        Readback->PendingCount--;
+    }
+
+    u32 Index = (Readback->First + Readback->PendingCount) % RENDER_READBACK_FRAMES;
+    u32 Width = Renderer->DrawableWidth;
+    u32 Height = Renderer->DrawableHeight;
+    size_t Size = (size_t)Width * (size_t)Height * 4;
+
+    R_BindBuffer(GL_PIXEL_PACK_BUFFER, Readback->Buffers[Index]);
+    if(Size > Readback->BufferSizes[Index])
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)Size, NULL, GL_STREAM_READ);
+        Readback->BufferSizes[Index] = Size;
+    }
+
+    // With a pack buffer bound the last argument is an offset into it
+    R_BindFramebuffer(Renderer->OutputFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (i32)Width, (i32)Height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    R_BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    Readback->Fences[Index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    Readback->Widths[Index] = Width;
+    Readback->Heights[Index] = Height;
+    Readback->PendingCount++;
 }
 
-void R_SetUniform(u32 Shader, char *Name, f32 X, f32 Y, f32 Z)
+u8 *R_MapReadback(renderer *Renderer, u32 *Width, u32 *Height)
 {
-    Assert(Name);
-    glUniform3f(glGetUniformLocation(Shader, Name), X, Y, Z);
+    // Returns the oldest queued frame, RGBA8 with the bottom row first, or
+    // NULL when the GPU has not copied it yet. Call R_UnmapReadback before
+    // the next R_EndFrame.
+    frame_readback *Readback = &Renderer->Readback;
+    if(!Readback->IsEnabled || Readback->PendingCount == 0)
+    {
+        return NULL;
+    }
+    Assert(!Readback->IsMapped);
+
+    u32 Index = Readback->First;
+    GLenum Status = glClientWaitSync(Readback->Fences[Index], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(Status == GL_TIMEOUT_EXPIRED)
+    {
+        if(Readback->PendingCount < RENDER_READBACK_FRAMES)
+        {
+            return NULL;
+        }
+
+        // The next R_EndFrame would overwrite it, wait
+        PF_SCOPE("R_MapReadback Stall");
+        Readback->StalledFrames++;
+        Status = glClientWaitSync(Readback->Fences[Index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    glDeleteSync(Readback->Fences[Index]);
+    Readback->Fences[Index] = 0;
+
+    u8 *Result = NULL;
+    if(Status == GL_ALREADY_SIGNALED || Status == GL_CONDITION_SATISFIED)
+    {
+        size_t Size = (size_t)Readback->Widths[Index] * (size_t)Readback->Heights[Index] * 4;
+        R_BindBuffer(GL_PIXEL_PACK_BUFFER, Readback->Buffers[Index]);
+        Result = (u8*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)Size, GL_MAP_READ_BIT);
+        R_BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if(Result == NULL)
+    {
+        // Lost, move on to the next frame
+        Readback->First = (Readback->First + 1) % RENDER_READBACK_FRAMES;
+        Readback->PendingCount--;
+        return NULL;
+    }
+
+    Readback->IsMapped = true;
+    *Width = Readback->Widths[Index];
+    *Height = Readback->Heights[Index];
+    return Result;
 }
 
-void R_SetUniform(u32 Shader, char *Name, glm::vec3 Value)
+void R_UnmapReadback(renderer *Renderer)
 {
-    Assert(Name);
-    glUniform3f(glGetUniformLocation(Shader, Name), Value.x, Value.y, Value.z);
+    frame_readback *Readback = &Renderer->Readback;
+    Assert(Readback->IsMapped);
+
+    R_BindBuffer(GL_PIXEL_PACK_BUFFER, Readback->Buffers[Readback->First]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    R_BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    Readback->First = (Readback->First + 1) % RENDER_READBACK_FRAMES;
+    Readback->PendingCount--;
+    Readback->IsMapped = false;
 }
 
 void R_BeginFrame(renderer *Renderer)
 {
+    R_BeginGPUFrame(Renderer);
+    R_UpdateRenderScale(Renderer);
+    R_BeginStreamFrame(Renderer);
+
     // NOTE: We need to clear the color buffer black, or else
     // the extracted brightness texture has another color
     // besides black, making the whole background glow
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    R_BindFramebuffer(Renderer->OutputFramebuffer);
     glClearColor(Renderer->BackgroundColor.r, Renderer->BackgroundColor.g, Renderer->BackgroundColor.b, Renderer->BackgroundColor.a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, Renderer->Framebuffer);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void R_EndFrame(renderer *Renderer)
 {
-    // Blur bright fragments with two-pass Gaussian Blur
-    // --------------------------------------------------
-    b32 Horizontal = true, FirstIteration = true;
-    glUseProgram(Renderer->Shaders.Blur);
-    for (u32 i = 0; i < BlurPassCount; i++)
+    PF_SCOPE("R_EndFrame");
+    if(R_GetRenderGraphKey(Renderer) != Renderer->RenderGraph.Key)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, Renderer->PingPongFBO[Horizontal]);
-        R_SetUniform(Renderer->Shaders.Blur, "Horizontal", Horizontal);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, FirstIteration ? Renderer->BrightnessBuffer : Renderer->PingPongBuffer[!Horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-        R_DrawUnitQuad(Renderer);
-        Horizontal = !Horizontal;
-        if (FirstIteration)
-        {
-            FirstIteration = false;
-        }
+        R_BuildRenderGraph(Renderer);
     }
-    // Render floating point color buffer to 2D quad and tonemap HDR colors to default framebuffer's (clamped) color range
-    // --------------------------------------------------------------------------------------------------------------------------
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(Renderer->Shaders.Bloom);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Renderer->ColorBuffer);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, Renderer->PingPongBuffer[!Horizontal]);
-    R_SetUniform(Renderer->Shaders.Bloom, "Bloom", EnableBloom);
-    R_SetUniform(Renderer->Shaders.Bloom, "Exposure", Renderer->Exposure);
-    R_DrawUnitQuad(Renderer);
+    R_ExecuteRenderGraph(Renderer);
+    R_QueueReadback(Renderer);
 
-    SDL_GL_SwapWindow(Renderer->Window->Handle);
+    R_EndStreamFrame(Renderer);
+    R_EndGPUFrame(Renderer);
+
+    if(!Renderer->Window->IsHeadless)
+    {
+        PF_SCOPE("SDL_GL_SwapWindow");
+        u64 SwapBegin = SDL_GetPerformanceCounter();
+        SDL_GL_SwapWindow(Renderer->Window->Handle);
+        Renderer->SwapMs = (f32)(P_GetSecondsElapsed(SwapBegin, SDL_GetPerformanceCounter()) * 1000.0);
+    }
 
     Renderer->PreviousDrawCallsPerFrame = Renderer->CurrentDrawCallsPerFrame;
     Renderer->CurrentDrawCallsPerFrame = 0;
+    Renderer->PreviousUniformUploadsPerFrame = UniformUploads__;
+    Renderer->PreviousUniformUploadsSkippedPerFrame = UniformUploadsSkipped__;
+    UniformUploads__ = 0;
+    UniformUploadsSkipped__ = 0;
+    Renderer->PreviousStateChangesPerFrame = GLState__.Changes;
+    Renderer->PreviousStateChangesSkippedPerFrame = GLState__.ChangesSkipped;
+    GLState__.Changes = 0;
+    GLState__.ChangesSkipped = 0;
+    Renderer->PreviousEntitiesDrawn = Renderer->CurrentEntitiesDrawn;
+    Renderer->PreviousEntitiesCulled = Renderer->CurrentEntitiesCulled;
+    Renderer->CurrentEntitiesDrawn = 0;
+    Renderer->CurrentEntitiesCulled = 0;
 }
 
-void R_ResizeRenderer(renderer *Renderer, i32 Width, i32 Height)
+b32 R_SetTextureFormat(texture *Texture)
 {
-    /*
-      This function deletes and recreates the opengl textures that we
-      are using/rendering to. Framebuffers do not need to be resized,
-      only the textures. The following textures are deleted and
-      recreated to reflect the new width and height.
+    Assert(Texture);
 
-      u32 ColorBuffer;
-      u32 BrightnessBuffer;
-      u32 DepthStencilRenderbuffer;
-      u32 PingPongBuffer[2];
-    */
+    if(Texture->ChannelCount == 3)
+    {
+        Texture->Format = GL_RGB;
+        Texture->InternalFormat = GL_SRGB;
+    }
+    else if(Texture->ChannelCount == 4)
+    {
+        Texture->Format = GL_RGBA;
+        // NOTE: If anything looks weird when drawing textures,
+        // maybe toggle between GL_SRGB and GL_SRGB_ALPHA. I'm to
+        // lazy to check opengl docs right now.
+        // Texture->InternalFormat = GL_SRGB;
+        Texture->InternalFormat = GL_SRGB_ALPHA;
+    }
+    else
+    {
+        return false;
+    }
 
-    Assert(Renderer);
-    Assert(Width > 0);
-    Assert(Height > 0);
+    return true;
+}
 
-    // Delete old texture and depth+stencil renderbuffer
-    glDeleteTextures(1, &Renderer->ColorBuffer);
-    glDeleteTextures(1, &Renderer->BrightnessBuffer);
-    glDeleteRenderbuffers(1, &Renderer->DepthStencilRenderbuffer);
+void R_UploadTexture(texture *Texture, void *Data)
+{
+    // NOTE: Data is either a pointer to the pixels or, when a
+    // GL_PIXEL_UNPACK_BUFFER is bound, an offset inside that buffer.
+    Assert(Texture);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, Renderer->Framebuffer);
-    // Colorbuffer
-    glGenTextures(1, &Renderer->ColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, Renderer->ColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, Width, Height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glGenTextures(1, &Texture->Handle);
+    R_BindTextureForUpload(Texture->Handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // stb_image rows are tightly packed, RGB images with odd widths need this
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    i32 MipMapDetailLevel = 0;
+    // REMINDER: Textures to be used for data should not be uploaded as GL_SRGB!
+    // NOTE: InternalFormat is the format we want to store the data, Format is the input format
+    glTexImage2D(GL_TEXTURE_2D, MipMapDetailLevel, Texture->InternalFormat, Texture->Width, Texture->Height, 0, Texture->Format, GL_UNSIGNED_BYTE, Data);
+    // NOTE(Jorge): Set custom MipMaps filtering values here!
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    Texture->UVRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    Texture->IsReady = true;
+}
+
+void R_UploadCookedTexture(texture *Texture, u32 LevelCount, void *Data)
+{
+    // Every mip level is in Data one after the other (see cooker.h), one
+    // glTexImage2D per level and no glGenerateMipmap. Data is either a
+    // pointer or an offset inside the bound GL_PIXEL_UNPACK_BUFFER.
+    Assert(Texture);
+
+    glGenTextures(1, &Texture->Handle);
+    R_BindTextureForUpload(Texture->Handle);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    // BrightnessBuffer
-    glGenTextures(1, &Renderer->BrightnessBuffer);
-    glBindTexture(GL_TEXTURE_2D, Renderer->BrightnessBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, Width, Height, 0, GL_RGBA, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(u32 Level = 0; Level < LevelCount; Level++)
+    {
+        u8 *LevelData = (u8*)Data + CK_GetLevelOffset(Texture->Width, Texture->Height, Texture->ChannelCount, Level);
+        glTexImage2D(GL_TEXTURE_2D, (i32)Level, Texture->InternalFormat, SDL_max(Texture->Width >> Level, 1), SDL_max(Texture->Height >> Level, 1),
+                     0, Texture->Format, GL_UNSIGNED_BYTE, LevelData);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (i32)LevelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    Texture->UVRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    Texture->IsReady = true;
+}
+
+u32 R_UploadAtlasPage(i32 Width, i32 Height, i32 MaxMipLevel, void *Data)
+{
+    // NOTE: Data is either a pointer to the RGBA pixels or, when a
+    // GL_PIXEL_UNPACK_BUFFER is bound, an offset inside that buffer.
+    u32 Result;
+    glGenTextures(1, &Result);
+    R_BindTextureForUpload(Result);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    // Renderbuffer
-    glGenRenderbuffers(1, &Renderer->DepthStencilRenderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, Renderer->DepthStencilRenderbuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Width, Height);
-    // Attach Buffers to Framebuffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Renderer->ColorBuffer, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, Renderer->BrightnessBuffer, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, Renderer->DepthStencilRenderbuffer);
-    // Tell opengl we are rendering to multiple buffers
-    u32 Attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, Attachments);
-
-    // Check if framebuffer is complete
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    // The levels are stored one after the other, see AT_GetPageSize
+    for(i32 Level = 0; Level <= MaxMipLevel; Level++)
     {
-        printf("Framebuffer not complete, exiting!\n");
-        exit(-1);
+        u8 *LevelData = (u8*)Data + CK_GetLevelOffset(Width, Height, 4, (u32)Level);
+        glTexImage2D(GL_TEXTURE_2D, Level, GL_SRGB_ALPHA, SDL_max(Width >> Level, 1), SDL_max(Height >> Level, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, LevelData);
+    }
+
+    // Deeper mip levels would mix neighbouring sprites, the padding only covers up to MaxMipLevel
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MaxMipLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return Result;
+}
+
+u8 *R_LoadImage(char *Filename, i32 *Width, i32 *Height, i32 *ChannelCount, i32 RequestedChannelCount)
+{
+    // stbi_load that decodes straight from the asset pack when the image is in it
+    size_t Size = 0;
+    u8 *Data = PK_FindFile(Filename, &Size);
+    if(Data)
+    {
+        return stbi_load_from_memory(Data, (i32)Size, Width, Height, ChannelCount, RequestedChannelCount);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    { // SUBSECTION: PingPongFramebuffers
-        glDeleteTextures(1, &Renderer->PingPongBuffer[0]);
-        glDeleteTextures(1, &Renderer->PingPongBuffer[1]);
+    return stbi_load(Filename, Width, Height, ChannelCount, RequestedChannelCount);
+}
+
+texture *R_CreateTexture(char *Filename)
+{
+    Assert(Filename);
+
+    texture *Result = (texture*)Malloc(sizeof(texture));
 
-        glGenTextures(2, Renderer->PingPongBuffer);
-        for (u32 i = 0; i < 2; i++)
+    i32 RequestedChannelCount = 0;
+    i32 FlipVertically = 1;
+    stbi_set_flip_vertically_on_load(FlipVertically);
+    u8 *Data = R_LoadImage(Filename, &Result->Width, &Result->Height, &Result->ChannelCount, RequestedChannelCount);
+    if(Data)
+    {
+        if(!R_SetTextureFormat(Result))
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, Renderer->PingPongFBO[i]);
-            glBindTexture(GL_TEXTURE_2D, Renderer->PingPongBuffer[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, Width, Height, 0, GL_RGB, GL_FLOAT, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Renderer->PingPongBuffer[i], 0);
-            if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            {
-                printf("PingPong Framebuffer %d is not complete, exiting!\n", i);
-            }
+            fprintf(stderr, "%s Texture format is not GL_RGB or GL_RGBA\n", Filename);
+            stbi_image_free(Data);
+            return 0;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        R_UploadTexture(Result, Data);
+
+        stbi_image_free(Data);
+    }
+    else
+    {
+        printf("Could not load image file: %s\n", Filename);
+    }
+
+    return Result;
+}
+
+texture *R_CreateWhiteTexture()
+{
+    texture *Result = (texture*)Malloc(sizeof(texture));
+    Result->Width = 1;
+    Result->Height = 1;
+    Result->ChannelCount = 4;
+    R_SetTextureFormat(Result);
+
+    u8 White[4] = {255, 255, 255, 255};
+    R_UploadTexture(Result, White);
+
+    return Result;
+}
+
+void R_CreateOutputFramebuffer(renderer *Renderer, i32 Width, i32 Height)
+{
+    // (Re)creates the RGBA8 framebuffer headless windows draw into, it
+    // stands in for the default framebuffer and is read by R_ReadPixels.
+    R_BindFramebuffer(0);
+    glDeleteRenderbuffers(1, &Renderer->OutputRenderbuffer);
+    glDeleteFramebuffers(1, &Renderer->OutputFramebuffer);
+
+    glGenRenderbuffers(1, &Renderer->OutputRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, Renderer->OutputRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &Renderer->OutputFramebuffer);
+    R_BindFramebuffer(Renderer->OutputFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Renderer->OutputRenderbuffer);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Output Framebuffer not complete, exiting!\n");
+        exit(-1);
+    }
+    R_BindFramebuffer(0);
+}
+
+void R_ReadPixels(renderer *Renderer, u8 *Pixels)
+{
+    // Copies the last composited frame into Pixels, DrawableWidth x
+    // DrawableHeight RGBA8, top row first. Waits for the GPU.
+    i32 Width = (i32)Renderer->DrawableWidth;
+    i32 Height = (i32)Renderer->DrawableHeight;
+    size_t RowSize = (size_t)Width * 4;
+
+    R_BindFramebuffer(Renderer->OutputFramebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, Pixels);
+
+    // OpenGL rows start at the bottom
+    u8 *Row = (u8*)Malloc(RowSize);
+    for(i32 Y = 0; Y < Height / 2; Y++)
+    {
+        u8 *Top = Pixels + RowSize * (size_t)Y;
+        u8 *Bottom = Pixels + RowSize * (size_t)(Height - 1 - Y);
+        memcpy(Row, Top, RowSize);
+        memcpy(Top, Bottom, RowSize);
+        memcpy(Bottom, Row, RowSize);
+    }
+    Free(Row);
+}
+
+void R_ResizeRenderer(renderer *Renderer, i32 Width, i32 Height)
+{
+    // The render targets are only recreated when the window outgrows
+    // them, toggling fullscreen on the desktop resolution never does.
+    Assert(Renderer);
+    Assert(Width > 0);
+    Assert(Height > 0);
+
+    if((u32)Width > Renderer->TargetWidth || (u32)Height > Renderer->TargetHeight)
+    {
+        Renderer->TargetWidth = SDL_max((u32)Width, Renderer->TargetWidth);
+        Renderer->TargetHeight = SDL_max((u32)Height, Renderer->TargetHeight);
+        R_BuildRenderGraph(Renderer);
+    }
+
+    if(Renderer->OutputFramebuffer)
+    {
+        R_CreateOutputFramebuffer(Renderer, Width, Height);
     }
 
+    Renderer->DrawableWidth = (u32)Width;
+    Renderer->DrawableHeight = (u32)Height;
+    R_SetRenderScale(Renderer, Renderer->RenderScale);
     glViewport(0, 0, Width, Height);
 }
 
+
+void R_SetAntiAliasing(renderer *Renderer, anti_aliasing_mode Mode)
+{
+    Renderer->AntiAliasing = Mode;
+    R_BuildRenderGraph(Renderer);
+}
+
+char *R_GetAntiAliasingName(anti_aliasing_mode Mode)
+{
+    switch(Mode)
+    {
+        case AntiAliasing_None: return "None";
+        case AntiAliasing_FXAA: return "FXAA";
+        case AntiAliasing_MSAA: return "MSAA";
+        default: return "Unknown";
+    }
+}
+
+void R_CreateTextVertexArray(u32 *VertexArray, u32 VertexBuffer)
+{
+    // Vertex layout of text.glsl, see text_vertex
+    glGenVertexArrays(1, VertexArray);
+    R_BindVertexArray(*VertexArray);
+    R_BindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)offsetof(text_vertex, Position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)offsetof(text_vertex, UV));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(text_vertex), (void*)offsetof(text_vertex, Color));
+    R_BindBuffer(GL_ARRAY_BUFFER, 0);
+    R_BindVertexArray(0);
+}
+
 renderer *R_CreateRenderer(window *Window)
 {
+    PF_SCOPE("R_CreateRenderer");
     renderer *Result = (renderer*)Malloc(sizeof(renderer));
     Result->Window = Window;
     Result->CurrentDrawCallsPerFrame = 0;
@@ -302,64 +2575,101 @@ renderer *R_CreateRenderer(window *Window)
     { // SECTION: OpenGL "Configuration"
 
         glFrontFace(GL_CCW);
-        glEnable(GL_MULTISAMPLE);
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_BLEND);
-
-        // No V-Sync
-        if(EnableVSync)
-        {
-            SDL_GL_SetSwapInterval(1);
-        }
-        else
-        {
-            SDL_GL_SetSwapInterval(0);
-        }
+        glEnable(GL_MULTISAMPLE);
+        R_SetDepthTest(true);
+        R_SetBlend(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         Result->HardwareVendor = glGetString(GL_VENDOR);
         Result->HardwareModel = glGetString(GL_RENDERER);
         Result->OpenGLVersion = glGetString(GL_VERSION);
         Result->GLSLVersion = glGetString(GL_SHADING_LANGUAGE_VERSION);
+        R_InitializeShaderCache(Result);
 
         Result->Exposure = Exposure__;
+        Result->AntiAliasing = AntiAliasing__;
+
+        i32 MaxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &MaxSamples);
+        Result->MultisampleCount = SDL_min(SDL_min(MultisampleCount__, MaxSamples), MSAA_MAX_SAMPLES);
     }
+    Result->DrawableWidth = (u32)Window->Width;
+    Result->DrawableHeight = (u32)Window->Height;
     glViewport(0, 0, Window->Width, Window->Height);
 
     { // SUBSECTION: Shader compilation
-        Result->Shaders.Blur = R_CreateShader("shaders/blur.glsl");
-        glUseProgram(Result->Shaders.Blur);
-        R_SetUniform(Result->Shaders.Blur, "Image", 0);
+        Result->Shaders.BloomDownsample = R_CreateShader("shaders/bloom_downsample.glsl");
+        R_UseProgram(Result->Shaders.BloomDownsample);
+        R_SetUniform(Result->Shaders.BloomDownsample, "Image", 0);
+
+        Result->Shaders.BloomUpsample = R_CreateShader("shaders/bloom_upsample.glsl");
+        R_UseProgram(Result->Shaders.BloomUpsample);
+        R_SetUniform(Result->Shaders.BloomUpsample, "Image", 0);
 
         Result->Shaders.Bloom = R_CreateShader("shaders/bloom.glsl");
-        glUseProgram(Result->Shaders.Bloom);
+        R_UseProgram(Result->Shaders.Bloom);
         R_SetUniform(Result->Shaders.Bloom, "Scene", 0);
         R_SetUniform(Result->Shaders.Bloom, "BloomBlur", 1);
+        R_SetUniform(Result->Shaders.Bloom, "FXAA", 0);
 
-        Result->Shaders.Hdr = R_CreateShader("shaders/hdr.glsl");
-        glUseProgram(Result->Shaders.Hdr);
+        Result->Shaders.Hdr = R_CreateShader("shaders/HDR.glsl");
+        R_UseProgram(Result->Shaders.Hdr);
         R_SetUniform(Result->Shaders.Hdr, "HDRBuffer", 0);
 
         Result->Shaders.Texture = R_CreateShader("shaders/texture.glsl");
-        glUseProgram(Result->Shaders.Texture);
+        R_UseProgram(Result->Shaders.Texture);
         R_SetUniform(Result->Shaders.Texture, "Image", 0);
 
         Result->Shaders.Ball = R_CreateShader("shaders/ball.glsl");
-        glUseProgram(Result->Shaders.Texture);
+        R_UseProgram(Result->Shaders.Texture);
         R_SetUniform(Result->Shaders.Texture, "Image", 0);
 
         Result->Shaders.Text = R_CreateShader("shaders/text.glsl");
-        glUseProgram(Result->Shaders.Text);
+        R_UseProgram(Result->Shaders.Text);
         R_SetUniform(Result->Shaders.Text, "Text", 0);
+
+        Result->Shaders.Sprite = R_CreateShader("shaders/sprite.glsl");
+        R_UseProgram(Result->Shaders.Sprite);
+        R_SetUniform(Result->Shaders.Sprite, "Image", 0);
+
+        Result->Shaders.SpriteUI = R_CreateShader("shaders/sprite_ui.glsl");
+        R_UseProgram(Result->Shaders.SpriteUI);
+        R_SetUniform(Result->Shaders.SpriteUI, "Image", 0);
+
+        Result->Shaders.Particle = R_CreateShader("shaders/particle.glsl");
+        R_UseProgram(Result->Shaders.Particle);
+        R_SetUniform(Result->Shaders.Particle, "Image", 0);
+
+        Result->Uniforms.BloomEnabled = R_GetUniform(Result->Shaders.Bloom, "Bloom");
+        Result->Uniforms.BloomExposure = R_GetUniform(Result->Shaders.Bloom, "Exposure");
+        Result->Uniforms.BloomFXAA = R_GetUniform(Result->Shaders.Bloom, "FXAA");
+        Result->Uniforms.BloomSceneScale = R_GetUniform(Result->Shaders.Bloom, "SceneScale");
+        Result->Uniforms.BloomBlurScale = R_GetUniform(Result->Shaders.Bloom, "BloomScale");
+        Result->Uniforms.BloomDownsampleSourceScale = R_GetUniform(Result->Shaders.BloomDownsample, "SourceScale");
+        Result->Uniforms.BloomUpsampleSourceScale = R_GetUniform(Result->Shaders.BloomUpsample, "SourceScale");
+        Result->Uniforms.TextBrightnessThreshold = R_GetUniform(Result->Shaders.Text, "BrightnessThreshold");
+        Result->Uniforms.TextDistanceField = R_GetUniform(Result->Shaders.Text, "DistanceField");
+        Result->Uniforms.ParticleUVRect = R_GetUniform(Result->Shaders.Particle, "UVRect");
+        Result->Uniforms.ParticleIntensity = R_GetUniform(Result->Shaders.Particle, "Intensity");
+
+        // Warm startups load every program from the cache, cold ones compile all of them
+        if(ShaderCache__.IsSupported)
+        {
+            printf("Shaders ready after: %.2fms (%s, %u cached, %u compiled, %u rejected binaries)\n", ShaderCache__.Ms,
+                   ShaderCache__.Misses + ShaderCache__.Rejected == 0 ? "warm" : "cold",
+                   ShaderCache__.Hits, ShaderCache__.Misses + ShaderCache__.Rejected, ShaderCache__.Rejected);
+        }
+        else
+        {
+            printf("Shaders ready after: %.2fms (no program binary cache)\n", ShaderCache__.Ms);
+        }
     }
 
     { // SUBSECTION: Upload vertex data to GPU
         // Upload Quad Data to the GPU
         glGenVertexArrays(1, &Result->QuadVAO);
         glGenBuffers(1, &Result->QuadVBO);
-        glBindVertexArray(Result->QuadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, Result->QuadVBO);
+        R_BindVertexArray(Result->QuadVAO);
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->QuadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(QuadVertices__), &QuadVertices__, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)0);
@@ -371,29 +2681,81 @@ renderer *R_CreateRenderer(window *Window)
         // is used
         glGenVertexArrays(1, &Result->UnitQuadVAO);
         glGenBuffers(1, &Result->UnitQuadVBO);
-        glBindVertexArray(Result->UnitQuadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, Result->UnitQuadVBO);
+        R_BindVertexArray(Result->UnitQuadVAO);
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->UnitQuadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(UnitQuadVertices__), &UnitQuadVertices__, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)(3 * sizeof(f32)));
 
-        // Upload Text Data to GPU
-        glGenVertexArrays(1, &Result->TextVAO);
-        glBindVertexArray(Result->TextVAO);
-        glGenBuffers(1, &Result->TextVertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, Result->TextVertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 6 * 3, NULL, GL_DYNAMIC_DRAW); // 6 Vertices, 3 floats each
+        // Sprite instances and text quads of every frame
+        stream_buffer *Stream = &Result->StreamBuffer;
+        Stream->Mode = StreamBuffer_Unsynchronized;
+        Stream->RegionSize = RENDER_STREAM_REGION_SIZE;
+        glGenBuffers(1, &Stream->Handle);
+        R_BindBuffer(GL_ARRAY_BUFFER, Stream->Handle);
+        glBufferData(GL_ARRAY_BUFFER, Stream->RegionSize * RENDER_STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+
+        // Text batch, every glyph is 6 text_vertex
+        R_CreateTextVertexArray(&Result->TextVAO, Stream->Handle);
+        Result->TextVertices = (text_vertex*)Malloc(sizeof(text_vertex) * TEXT_BATCH_MAX_GLYPHS * 6); Assert(Result->TextVertices);
+        Result->TextVertexCount = 0;
+
+        // Retained text, every text object owns a range of this buffer
+        glGenBuffers(1, &Result->RetainedTextBuffer);
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->RetainedTextBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(text_vertex) * TEXT_MAX_OBJECTS * TEXT_OBJECT_MAX_LENGTH * 6, NULL, GL_DYNAMIC_DRAW);
+        R_CreateTextVertexArray(&Result->RetainedTextVAO, Result->RetainedTextBuffer);
+        Result->TextObjects = (text_object*)Malloc(sizeof(text_object) * TEXT_MAX_OBJECTS); Assert(Result->TextObjects);
+        Result->TextObjectCount = 0;
+
+        // Scratch space of R_DrawEntityList, the frustum lets everything through until R_UpdateCamera
+        Result->CullBounds = (cull_bounds*)Malloc(sizeof(cull_bounds)); Assert(Result->CullBounds);
+
+        // Sprite batch, the quad vertices are shared with QuadVAO and
+        // every sprite_instance advances once per instance (divisor 1)
+        glGenVertexArrays(1, &Result->SpriteVAO);
+        R_BindVertexArray(Result->SpriteVAO);
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->QuadVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)(3 * sizeof(f32)));
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->StreamBuffer.Handle);
+        for(u32 Attribute = 3; Attribute <= 6; Attribute++)
+        {
+            glEnableVertexAttribArray(Attribute);
+            glVertexAttribDivisor(Attribute, 1);
+        }
+        R_SetSpriteInstanceAttributes(0);
+        R_BindBuffer(GL_ARRAY_BUFFER, 0);
+        R_BindVertexArray(0);
+
+        // Particles, attributes 3-6 are pointed at the pool arrays by every draw, see R_DrawParticles
+        glGenVertexArrays(1, &Result->ParticleVAO);
+        R_BindVertexArray(Result->ParticleVAO);
+        R_BindBuffer(GL_ARRAY_BUFFER, Result->QuadVBO);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(f32), 0);
-        glGenBuffers(1, &Result->TextTexCoordsBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, Result->TextTexCoordsBuffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(f32) * 6 * 2, TextTexCoords__, GL_STATIC_DRAW); // 6 Vertices, 2 floats(UV) each
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)0);
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(f32), 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*)(3 * sizeof(f32)));
+        for(u32 Attribute = 3; Attribute <= 6; Attribute++)
+        {
+            glEnableVertexAttribArray(Attribute);
+            glVertexAttribDivisor(Attribute, 1);
+        }
+        R_BindBuffer(GL_ARRAY_BUFFER, 0);
+        R_BindVertexArray(0);
+
+        Result->SpriteInstances = (sprite_instance*)Malloc(sizeof(sprite_instance) * SPRITE_BATCH_MAX_INSTANCES); Assert(Result->SpriteInstances);
+        Result->SpriteInstanceCount = 0;
+    }
+
+    { // SECTION: Command buffer
+        InitializeArena(&Result->FrameArena, RENDER_FRAME_ARENA_SIZE);
+        Result->Commands = (render_command*)Malloc(sizeof(render_command) * RENDER_MAX_COMMANDS); Assert(Result->Commands);
+        SDL_AtomicSet(&Result->CommandCount, 0);
     }
 
     { // SECTION: Uniform Buffer Object for the Camera Matrices
@@ -405,176 +2767,419 @@ renderer *R_CreateRenderer(window *Window)
         // buffer. With newer version of opengl you can set the index
         // in the glsl uniform declaration. Since we are using 3.3
         // sadly we cannot use this feature.
+        u32 UniformBlockIndexSpriteShader;
+        u32 UniformBlockIndexSpriteUIShader;
+        u32 UniformBlockIndexParticleShader;
         UniformBlockIndexTextureShader = glGetUniformBlockIndex(Result->Shaders.Texture, "CameraMatrices");
         UniformBlockIndexTextShader = glGetUniformBlockIndex(Result->Shaders.Text, "CameraMatrices");
+        UniformBlockIndexSpriteShader = glGetUniformBlockIndex(Result->Shaders.Sprite, "CameraMatrices");
+        UniformBlockIndexSpriteUIShader = glGetUniformBlockIndex(Result->Shaders.SpriteUI, "CameraMatrices");
+        UniformBlockIndexParticleShader = glGetUniformBlockIndex(Result->Shaders.Particle, "CameraMatrices");
         // Sets a uniform block to a specific binding point
         glUniformBlockBinding(Result->Shaders.Texture, UniformBlockIndexTextureShader, 0);
         glUniformBlockBinding(Result->Shaders.Text, UniformBlockIndexTextShader, 0);
+        glUniformBlockBinding(Result->Shaders.Sprite, UniformBlockIndexSpriteShader, 0);
+        glUniformBlockBinding(Result->Shaders.SpriteUI, UniformBlockIndexSpriteUIShader, 0);
+        glUniformBlockBinding(Result->Shaders.Particle, UniformBlockIndexParticleShader, 0);
 
         glGenBuffers(1,&Result->UniformCameraBuffer);
-        glBindBuffer(GL_UNIFORM_BUFFER, Result->UniformCameraBuffer);
+        R_BindBuffer(GL_UNIFORM_BUFFER, Result->UniformCameraBuffer);
         glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4) * 3, NULL, GL_STATIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-        glBindBufferBase(GL_UNIFORM_BUFFER, 0, Result->UniformCameraBuffer);
+        R_BindBufferBase(GL_UNIFORM_BUFFER, 0, Result->UniformCameraBuffer);
     }
 
+    Result->WhiteTexture = R_CreateWhiteTexture();
+
     { // SECTION: HDR+Bloom setup
-        // Main Framebuffer
-        glGenFramebuffers(1, &Result->Framebuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, Result->Framebuffer);
-
-        // Colorbuffer texture attachment
-        glGenTextures(1, &Result->ColorBuffer);
-        glBindTexture(GL_TEXTURE_2D, Result->ColorBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, Window->Width, Window->Height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        // BrightnessBuffer, Texture attachment needed to store every
-        // HDR color > 1.0f. This buffer is needed for Bloom
-        glGenTextures(1, &Result->BrightnessBuffer);
-        glBindTexture(GL_TEXTURE_2D, Result->BrightnessBuffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, Window->Width, Window->Height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glGenRenderbuffers(1, &Result->DepthStencilRenderbuffer);
-        glBindRenderbuffer(GL_RENDERBUFFER, Result->DepthStencilRenderbuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Window->Width, Window->Height);
-
-        // Attach Buffers to Framebuffer
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Result->ColorBuffer, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, Result->BrightnessBuffer, 0);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, Result->DepthStencilRenderbuffer);
-        // Tell opengl we are rendering to multiple buffers
-        u32 Attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        glDrawBuffers(2, Attachments);
-
-        // Check if framebuffer is complete
-        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        // Render targets are allocated once, big enough for fullscreen on this display
+        i32 TargetWidth = Window->Width;
+        i32 TargetHeight = Window->Height;
+        SDL_DisplayMode DisplayMode;
+        if(SDL_GetDesktopDisplayMode(SDL_GetWindowDisplayIndex(Window->Handle), &DisplayMode) == 0)
+        {
+            TargetWidth = SDL_max(TargetWidth, DisplayMode.w);
+            TargetHeight = SDL_max(TargetHeight, DisplayMode.h);
+        }
+        Result->TargetWidth = (u32)TargetWidth;
+        Result->TargetHeight = (u32)TargetHeight;
+        R_BuildRenderGraph(Result);
+
+        // No default framebuffer without a window
+        if(Window->IsHeadless)
+        {
+            R_CreateOutputFramebuffer(Result, Window->Width, Window->Height);
+        }
+        R_SetRenderScale(Result, 1.0f);
+
+        for(u32 i = 0; i < RENDER_GPU_FRAMES_IN_FLIGHT; i++)
+        {
+            glGenQueries(GPU_TIMER_MAX_QUERIES, Result->GPUProfiler.Frames[i].Queries);
+            glGenQueries(2, Result->GPUProfiler.Frames[i].Timestamps);
+        }
+    }
+
+    return (Result);
+}
+
+void R_DistanceTransform1D(f32 *Grid, i32 Count, i32 Stride, f32 *F, i32 *V, f32 *Z)
+{
+    // Squared euclidean distance transform of one row or column, lower
+    // envelope of parabolas (Felzenszwalb and Huttenlocher). F, V and Z
+    // are scratch arrays of Count, Count and Count + 1 elements.
+    for(i32 q = 0; q < Count; q++)
+    {
+        F[q] = Grid[q * Stride];
+    }
+
+    i32 k = 0;
+    V[0] = 0;
+    Z[0] = -FLT_MAX;
+    Z[1] = FLT_MAX;
+    for(i32 q = 1; q < Count; q++)
+    {
+        f32 S = ((F[q] + (f32)(q * q)) - (F[V[k]] + (f32)(V[k] * V[k]))) / (f32)(2 * q - 2 * V[k]);
+        while(S <= Z[k])
+        {
+            k--;
+            S = ((F[q] + (f32)(q * q)) - (F[V[k]] + (f32)(V[k] * V[k]))) / (f32)(2 * q - 2 * V[k]);
+        }
+        k++;
+        V[k] = q;
+        Z[k] = S;
+        Z[k + 1] = FLT_MAX;
+    }
+
+    k = 0;
+    for(i32 q = 0; q < Count; q++)
+    {
+        while(Z[k + 1] < (f32)q)
         {
-            printf("Framebuffer not complete, exiting!\n");
-            exit(-1);
+            k++;
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        Grid[q * Stride] = (f32)((q - V[k]) * (q - V[k])) + F[V[k]];
+    }
+}
+
+void R_DistanceTransform2D(f32 *Grid, i32 Width, i32 Height)
+{
+    // Grid holds 0 on the pixels we measure the distance to and a huge
+    // value everywhere else, it ends up with the squared distances.
+    i32 MaxCount = Width > Height ? Width : Height;
+    f32 *F = (f32*)malloc(sizeof(f32) * MaxCount);
+    i32 *V = (i32*)malloc(sizeof(i32) * MaxCount);
+    f32 *Z = (f32*)malloc(sizeof(f32) * (MaxCount + 1));
+
+    for(i32 X = 0; X < Width; X++)
+    {
+        R_DistanceTransform1D(Grid + X, Height, Width, F, V, Z);
+    }
+    for(i32 Y = 0; Y < Height; Y++)
+    {
+        R_DistanceTransform1D(Grid + Y * Width, Width, 1, F, V, Z);
+    }
+
+    free(F);
+    free(V);
+    free(Z);
+}
 
-        { // SUBSECTION: PingPong Framebuffers creation
+i32 R_PositiveModulo(i32 A, i32 B)
+{
+    i32 Result = A % B;
+    return Result < 0 ? Result + B : Result;
+}
 
-            glGenFramebuffers(2, Result->PingPongFBO);
-            glGenTextures(2, Result->PingPongBuffer);
-            for (u32 i = 0; i < 2; i++)
+u8 *R_BuildGlyphDistanceField(FT_Bitmap *Bitmap, i32 Left, i32 Top, character *Character)
+{
+    // Turns a glyph rasterized FONT_SDF_SUPERSAMPLE times too big into a
+    // distance field at FONT_SDF_SIZE. 128 is the outline, bigger values
+    // are inside. Updates the size and bearing of Character, returns the
+    // pixels (malloc, the caller frees them).
+    // NOTE: freetype 2.10 has no FT_RENDER_MODE_SDF, we compute it ourselves.
+    i32 Supersample = FONT_SDF_SUPERSAMPLE;
+    i32 Spread = FONT_SDF_SPREAD * Supersample;
+
+    // Pad the glyph so its origin and size land on whole output pixels
+    i32 PadLeft = Spread + R_PositiveModulo(Left - Spread, Supersample);
+    i32 PadTop = Spread + R_PositiveModulo(-(Top + Spread), Supersample);
+    i32 GridWidth = PadLeft + (i32)Bitmap->width + Spread;
+    i32 GridHeight = PadTop + (i32)Bitmap->rows + Spread;
+    GridWidth += R_PositiveModulo(-GridWidth, Supersample);
+    GridHeight += R_PositiveModulo(-GridHeight, Supersample);
+
+    size_t GridSize = (size_t)GridWidth * (size_t)GridHeight;
+    f32 *DistanceOutside = (f32*)malloc(sizeof(f32) * GridSize); // Squared distance to the closest inside pixel
+    f32 *DistanceInside = (f32*)malloc(sizeof(f32) * GridSize); // Squared distance to the closest outside pixel
+    Assert(DistanceOutside && DistanceInside);
+
+    f32 Far = 1e20f;
+    for(i32 Y = 0; Y < GridHeight; Y++)
+    {
+        for(i32 X = 0; X < GridWidth; X++)
+        {
+            i32 BitmapX = X - PadLeft;
+            i32 BitmapY = Y - PadTop;
+            b32 Inside = BitmapX >= 0 && BitmapX < (i32)Bitmap->width &&
+                         BitmapY >= 0 && BitmapY < (i32)Bitmap->rows &&
+                         Bitmap->buffer[BitmapY * Bitmap->pitch + BitmapX] >= 128;
+            DistanceOutside[Y * GridWidth + X] = Inside ? 0.0f : Far;
+            DistanceInside[Y * GridWidth + X] = Inside ? Far : 0.0f;
+        }
+    }
+    R_DistanceTransform2D(DistanceOutside, GridWidth, GridHeight);
+    R_DistanceTransform2D(DistanceInside, GridWidth, GridHeight);
+
+    // Every output pixel is the average signed distance of its block
+    i32 Width = GridWidth / Supersample;
+    i32 Height = GridHeight / Supersample;
+    u8 *Result = (u8*)malloc((size_t)Width * (size_t)Height); Assert(Result);
+    for(i32 Y = 0; Y < Height; Y++)
+    {
+        for(i32 X = 0; X < Width; X++)
+        {
+            f32 Sum = 0.0f;
+            for(i32 BlockY = 0; BlockY < Supersample; BlockY++)
             {
-                glBindFramebuffer(GL_FRAMEBUFFER, Result->PingPongFBO[i]);
-                glBindTexture(GL_TEXTURE_2D, Result->PingPongBuffer[i]);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, Window->Width, Window->Height, 0, GL_RGB, GL_FLOAT, NULL);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, Result->PingPongBuffer[i], 0);
-                if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                for(i32 BlockX = 0; BlockX < Supersample; BlockX++)
                 {
-                    printf("PingPong Framebuffer %d is not complete, exiting!\n", i);
+                    size_t Index = (size_t)(Y * Supersample + BlockY) * GridWidth + (X * Supersample + BlockX);
+                    // The outline is half a pixel away from the centers of the pixels next to it
+                    Sum += DistanceInside[Index] > 0.0f ? -(sqrtf(DistanceInside[Index]) - 0.5f) : sqrtf(DistanceOutside[Index]) - 0.5f;
                 }
             }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            f32 Distance = Sum / (f32)(Supersample * Supersample * Supersample); // In output pixels, positive outside
+            f32 Value = 0.5f - Distance / (2.0f * FONT_SDF_SPREAD);
+            Value = Value < 0.0f ? 0.0f : (Value > 1.0f ? 1.0f : Value);
+            Result[Y * Width + X] = (u8)(Value * 255.0f + 0.5f);
         }
     }
 
-    return (Result);
+    free(DistanceOutside);
+    free(DistanceInside);
+
+    Character->Size = glm::ivec2(Width, Height);
+    Character->Bearing = glm::ivec2((Left - PadLeft) / Supersample, (Top + PadTop) / Supersample);
+
+    return Result;
 }
 
-font *R_CreateFont(renderer *Renderer, char *Filename, i32 Width, i32 Height)
+u8 *R_RasterizeFont(font *Font)
 {
-    // TODO(Jorge): Program freezes when Filename is incorrect, handle error graciously
-    Assert(Renderer);
-    Assert(Filename);
-    Assert(Width >= 0);
-    Assert(Height >= 0);
-
-    font *Result = (font*)Malloc(sizeof(font));
-    Result->Filename = Filename;
-    Result->Width = Width;
-    Result->Height = Height;
+    // Renders every glyph with freetype and packs them into one 8 bit
+    // atlas. Fills Font->Characters and the atlas size, returns the atlas
+    // pixels (malloc, the caller frees them) or NULL on failure.
+    // NOTE: Called from the asset worker threads, every call gets its own
+    // FT_Library since freetype libraries can not be shared between threads.
+    Assert(Font);
 
     FT_Library FT;
     FT_Face Face;
-    if(FT_Init_FreeType(&FT) == 0)
+    if(FT_Init_FreeType(&FT) != 0)
+    {
+        printf("FT_Init_FreeType failed miserably, could not init FreeType Library\n");
+        return NULL;
+    }
+
+    // FreeType reads packed fonts in place, the pack outlives the face
+    size_t FontFileSize = 0;
+    u8 *FontFile = PK_FindFile(Font->Filename, &FontFileSize);
+    FT_Error FaceError = FontFile ? FT_New_Memory_Face(FT, FontFile, (FT_Long)FontFileSize, 0, &Face) : FT_New_Face(FT, Font->Filename, 0, &Face);
+    if(FaceError != 0)
+    {
+        printf("FT_New_Face failed miserably while loading font %s\n", Font->Filename);
+        FT_Done_FreeType(FT);
+        return NULL;
+    }
+
+    if(Font->IsDistanceField)
+    {
+        FT_Set_Pixel_Sizes(Face, 0, FONT_SDF_SIZE * FONT_SDF_SUPERSAMPLE);
+        Font->MetricsScale = (f32)Font->Height / (f32)FONT_SDF_SIZE;
+    }
+    else
+    {
+        FT_Set_Pixel_Sizes(Face, Font->Width, Font->Height);
+        Font->MetricsScale = 1.0f;
+    }
+
+    // 1- Rasterize every glyph one after the other into a scratch buffer
+    size_t Capacity = Kilobytes(64);
+    size_t GlyphsSize = 0;
+    u8 *Glyphs = (u8*)malloc(Capacity); Assert(Glyphs);
+    size_t GlyphOffsets[256];
+    u32 GlyphsToPack[256];
+    u32 GlyphsToPackCount = 0;
+
+    for(u32 CurrentChar = 0; CurrentChar < 255; CurrentChar++)
     {
-        if(FT_New_Face(FT, Result->Filename, 0, &Face) == 0)
+        if(FT_Load_Char(Face, CurrentChar, FT_LOAD_RENDER) != 0)
         {
-            // Once we've loaded the face, we should define the font size we'd like to extract from this face
-            FT_Set_Pixel_Sizes(Face, Result->Width, Result->Height);
+            printf("FT_Load_Char: Error, Freetype Failed to load Glyph %c\n", CurrentChar);
+            continue;
+        }
 
-            // Disable byte-alignment restriction
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // NOTE: Do we need to set it back to default?
+        FT_Bitmap *Bitmap = &Face->glyph->bitmap;
+        character Character =
+        {
+            glm::vec4(0.0f),
+            glm::ivec2(Bitmap->width, Bitmap->rows),
+            glm::ivec2(Face->glyph->bitmap_left, Face->glyph->bitmap_top),
+            (u32)Face->glyph->advance.x,
+        };
 
-            for(u8 CurrentChar = 0; CurrentChar < 255; CurrentChar++)
+        // Rows of the glyph as stored in the atlas
+        u8 *Source = Bitmap->buffer;
+        i32 SourcePitch = Bitmap->pitch;
+        u8 *DistanceField = NULL;
+        if(Font->IsDistanceField)
+        {
+            Character.Advance /= FONT_SDF_SUPERSAMPLE;
+            if(Bitmap->width > 0 && Bitmap->rows > 0)
             {
-                // Load character glyph
-                if(FT_Load_Char(Face, CurrentChar, FT_LOAD_RENDER) == 0)
-                {
-                    // Generate Texture
-                    u32 Texture;
-                    glGenTextures(1, &Texture);
-                    glBindTexture(GL_TEXTURE_2D, Texture);
-                    glTexImage2D(GL_TEXTURE_2D,
-                                 0,
-                                 GL_RED,
-                                 Face->glyph->bitmap.width,
-                                 Face->glyph->bitmap.rows,
-                                 0,
-                                 GL_RED,
-                                 GL_UNSIGNED_BYTE,
-                                 Face->glyph->bitmap.buffer);
-
-                    // Set Texture Options
-                    // NOTE: What's better? clamp to edge or clamp to border?
-                    // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                    // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-                    // Now store character for later use
-                    character Character =
-                    {
-                        Texture,
-                        glm::ivec2(Face->glyph->bitmap.width, Face->glyph->bitmap.rows),
-                        glm::ivec2(Face->glyph->bitmap_left, Face->glyph->bitmap_top),
-                        (u32)Face->glyph->advance.x,
-                    };
-
-                    Result->Characters[CurrentChar] = Character;
-                }
-                else
-                {
-                    printf("FT_Load_Char: Error, Freetype Failed to load Glyph %c\n", CurrentChar);
-                }
+                DistanceField = R_BuildGlyphDistanceField(Bitmap, Face->glyph->bitmap_left, Face->glyph->bitmap_top, &Character);
+                Source = DistanceField;
+                SourcePitch = Character.Size.x;
             }
         }
-        else
+
+        size_t GlyphSize = (size_t)Character.Size.x * (size_t)Character.Size.y;
+        while(GlyphsSize + GlyphSize > Capacity)
         {
-            printf("FT_New_Face failed miserably while loading font %s\n", Result->Filename);
-            Free(Result);
-            return NULL;
+            Capacity *= 2;
+            Glyphs = (u8*)realloc(Glyphs, Capacity); Assert(Glyphs);
+        }
+
+        // Copy row by row, freetype bitmaps may be padded (pitch)
+        u8 *Destination = Glyphs + GlyphsSize;
+        for(i32 Row = 0; Row < Character.Size.y; Row++)
+        {
+            memcpy(Destination + Row * Character.Size.x, Source + Row * SourcePitch, Character.Size.x);
+        }
+        GlyphOffsets[CurrentChar] = GlyphsSize;
+        GlyphsSize += GlyphSize;
+        free(DistanceField);
+
+        Font->Characters[CurrentChar] = Character;
+
+        if(GlyphSize > 0)
+        {
+            GlyphsToPack[GlyphsToPackCount++] = CurrentChar;
         }
     }
-    else
+
+    // Destroy a given FreeType library object and all of its children, including resources, drivers, faces, sizes, etc.
+    FT_Done_FreeType(FT);
+
+    // 2- Pack the tallest glyphs first, double the atlas until all of them fit
+    for(u32 i = 1; i < GlyphsToPackCount; i++)
+    {
+        u32 Glyph = GlyphsToPack[i];
+        u32 j = i;
+        for(; j > 0 && Font->Characters[GlyphsToPack[j - 1]].Size.y < Font->Characters[Glyph].Size.y; j--)
+        {
+            GlyphsToPack[j] = GlyphsToPack[j - 1];
+        }
+        GlyphsToPack[j] = Glyph;
+    }
+
+    atlas_packer Packer;
+    i32 GlyphX[256];
+    i32 GlyphY[256];
+    i32 AtlasSize = 128;
+    b32 AllPacked = false;
+    while(!AllPacked && AtlasSize <= FONT_MAX_ATLAS_SIZE)
+    {
+        AT_InitPacker(&Packer, AtlasSize, AtlasSize);
+        AllPacked = true;
+        for(u32 i = 0; i < GlyphsToPackCount; i++)
+        {
+            u32 Glyph = GlyphsToPack[i];
+            glm::ivec2 Size = Font->Characters[Glyph].Size;
+            if(!AT_PackRectangle(&Packer, Size.x + FONT_GLYPH_PADDING * 2, Size.y + FONT_GLYPH_PADDING * 2, &GlyphX[Glyph], &GlyphY[Glyph]))
+            {
+                AllPacked = false;
+                AtlasSize *= 2;
+                break;
+            }
+        }
+    }
+
+    if(!AllPacked)
+    {
+        printf("Font %s at %dpx does not fit in a %dx%d atlas\n", Font->Filename, Font->Height, FONT_MAX_ATLAS_SIZE, FONT_MAX_ATLAS_SIZE);
+        free(Glyphs);
+        return NULL;
+    }
+
+    // 3- Copy the glyphs into the atlas, the padding stays empty
+    u8 *Result = (u8*)calloc((size_t)AtlasSize * (size_t)AtlasSize, 1); Assert(Result);
+    for(u32 i = 0; i < GlyphsToPackCount; i++)
+    {
+        u32 Glyph = GlyphsToPack[i];
+        character *Character = &Font->Characters[Glyph];
+        i32 X = GlyphX[Glyph] + FONT_GLYPH_PADDING;
+        i32 Y = GlyphY[Glyph] + FONT_GLYPH_PADDING;
+        for(i32 Row = 0; Row < Character->Size.y; Row++)
+        {
+            memcpy(Result + (size_t)(Y + Row) * AtlasSize + X, Glyphs + GlyphOffsets[Glyph] + (size_t)Row * Character->Size.x, Character->Size.x);
+        }
+
+        Character->UVRect = glm::vec4((f32)X / (f32)AtlasSize,
+                                      (f32)Y / (f32)AtlasSize,
+                                      (f32)Character->Size.x / (f32)AtlasSize,
+                                      (f32)Character->Size.y / (f32)AtlasSize);
+    }
+    free(Glyphs);
+
+    Font->AtlasWidth = AtlasSize;
+    Font->AtlasHeight = AtlasSize;
+
+    return Result;
+}
+
+void R_UploadFontAtlas(font *Font, void *Data)
+{
+    // NOTE: Data is either a pointer to the atlas or, when a
+    // GL_PIXEL_UNPACK_BUFFER is bound, an offset inside that buffer.
+    Assert(Font);
+
+    glGenTextures(1, &Font->Texture);
+    R_BindTextureForUpload(Font->Texture);
+    // Disable byte-alignment restriction
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, Font->AtlasWidth, Font->AtlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, Data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    Font->IsReady = true;
+}
+
+font *R_CreateFont(renderer *Renderer, char *Filename, i32 Width, i32 Height, b32 DistanceField = false)
+{
+    // NOTE: Synchronous version of A_LoadFont
+    Assert(Renderer);
+    Assert(Filename);
+    Assert(Width >= 0);
+    Assert(Height >= 0);
+
+    font *Result = (font*)Malloc(sizeof(font));
+    Result->Filename = Filename;
+    Result->Width = Width;
+    Result->Height = Height;
+    Result->IsDistanceField = DistanceField;
+
+    u8 *Pixels = R_RasterizeFont(Result);
+    if(!Pixels)
     {
-        printf("FT_Init_FreeType failed miserably, could not init FreeType Library\n");
         Free(Result);
         return NULL;
     }
-    // Destroy a given FreeType library object and all of its children, including resources, drivers, faces, sizes, etc.
-    FT_Done_FreeType(FT);
-    // glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // NOTE: Do we need to reset it?
+
+    R_UploadFontAtlas(Result, Pixels);
+    free(Pixels);
 
     return Result;
 }
@@ -665,6 +3270,10 @@ u32 R_CreateShader(char *VertexFile, char *FragmentFile)
             printf("SHADER PROGRAM FAILED TO COMPILE\\LINK\n");
             printf("%s\n", InfoLog);
         }
+        else
+        {
+            R_ReflectShader(Result);
+        }
 
     }
 
@@ -679,83 +3288,55 @@ u32 R_CreateShader(char *VertexFile, char *FragmentFile)
 
 void R_SetActiveShader(u32 Shader)
 {
-    glUseProgram(Shader);
+    R_UseProgram(Shader);
 }
 
-texture *R_CreateTexture(char *Filename)
+void R_DrawTexture(renderer *Renderer, texture *Texture, glm::vec3 Position, glm::vec3 Size, f32 RotationAngle)
 {
-    Assert(Filename);
-
-    texture *Result = (texture*)Malloc(sizeof(texture));
-
-    i32 RequestedChannelCount = 0;
-    i32 FlipVertically = 1;
-    stbi_set_flip_vertically_on_load(FlipVertically);
-    u8 *Data = stbi_load(Filename, &Result->Width, &Result->Height, &Result->ChannelCount, RequestedChannelCount);
-    if(Data)
+    // Sprites rotate around Z, RotationAngle in degrees
+    if(!Texture || !Texture->IsReady)
     {
-        glGenTextures(1, &Result->Handle);
-        glBindTexture(GL_TEXTURE_2D, Result->Handle);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        if(Result->ChannelCount == 3)
-        {
-            Result->Format = GL_RGB;
-            Result->InternalFormat = GL_SRGB;
-        }
-        else if(Result->ChannelCount == 4)
-        {
-            Result->Format = GL_RGBA;
-            // NOTE: If anything looks weird when drawing textures,
-            // maybe toggle between GL_SRGB and GL_SRGB_ALPHA. I'm to
-            // lazy to check opengl docs right now.
-            // Result->InternalFormat = GL_SRGB;
-            Result->InternalFormat = GL_SRGB_ALPHA;
-        }
-        else
-        {
-            fprintf(stderr, "%s Texture format is not GL_RGB or GL_RGBA\n", Filename);
-            stbi_image_free(Data);
-            return 0;
-        }
+        // Still loading, see asset.cpp
+        return;
+    }
 
-        i32 MipMapDetailLevel = 0;
-        // REMINDER: Textures to be used for data should not be uploaded as GL_SRGB!
-        // NOTE: InternalFormat is the format we want to store the data, Format is the input format
-        glTexImage2D(GL_TEXTURE_2D, MipMapDetailLevel, Result->InternalFormat, Result->Width, Result->Height, 0, Result->Format, GL_UNSIGNED_BYTE, Data);
-        // NOTE(Jorge): Set custom MipMaps filtering values here!
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // NOTE: Nothing is drawn until R_EndFrame executes the command buffer
+    // Anything with an alpha channel (atlas pages included) is blended
+    b32 IsTranslucent = Texture->ChannelCount != 3;
+    u64 Key = R_MakeSortKey(RenderLayer_World, IsTranslucent, Renderer->Shaders.Sprite, Texture->Handle, R_GetViewDepth(Renderer, Position));
 
-        stbi_image_free(Data);
-    }
-    else
+    render_command_sprite *Sprite = (render_command_sprite*)R_PushCommand(Renderer, RenderCommand_Sprite, Key, sizeof(render_command_sprite));
+    if(Sprite)
     {
-        printf("Could not load image file: %s\n", Filename);
+        Sprite->Shader = Renderer->Shaders.Sprite;
+        Sprite->Texture = Texture;
+        Sprite->Position = Position;
+        Sprite->Size = Size;
+        Sprite->RotationAngle = RotationAngle;
+        Sprite->Tint = glm::vec4(1.0f);
+        Sprite->Threshold = BrightnessThreshold;
     }
-
-    return Result;
 }
 
-void R_DrawTexture(renderer *Renderer, texture *Texture, glm::vec3 Position, glm::vec3 Size, glm::vec3 RotationAxis, f32 RotationAngle)
+void R_DrawRect2D(renderer *Renderer, glm::vec2 Position, glm::vec2 Size, glm::vec4 Color, f32 Layer = 0.0f)
 {
-    // glUseProgram(Renderer->Shaders.Texture);
-    glm::mat4 Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, Position);
-    Model = glm::rotate(Model, glm::radians(RotationAngle), glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f)));
-    Model = glm::scale(Model, Size);
-    R_SetUniform(Renderer->Shaders.Texture, "Model", Model);
-
-    R_SetUniform(Renderer->Shaders.Texture, "BrightnessThreshold", BrightnessThreshold);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Texture->Handle);
-    glBindVertexArray(Renderer->QuadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    Renderer->CurrentDrawCallsPerFrame++;
-    glBindVertexArray(0);
+    // Solid rectangle in screen pixels, Position is the bottom left
+    // corner. Drawn after the world, the depth test keeps rectangles
+    // with a higher Layer (0 to 1) on top of the ones below.
+    b32 IsTranslucent = Color.a < 1.0f;
+    u64 Key = R_MakeSortKey(RenderLayer_UI, IsTranslucent, Renderer->Shaders.SpriteUI, Renderer->WhiteTexture->Handle, 0.0f);
+
+    render_command_sprite *Sprite = (render_command_sprite*)R_PushCommand(Renderer, RenderCommand_Sprite, Key, sizeof(render_command_sprite));
+    if(Sprite)
+    {
+        Sprite->Shader = Renderer->Shaders.SpriteUI;
+        Sprite->Texture = Renderer->WhiteTexture;
+        Sprite->Position = glm::vec3(Position + Size * 0.5f, Layer);
+        Sprite->Size = glm::vec3(Size, 0.0f);
+        Sprite->RotationAngle = 0.0f;
+        Sprite->Tint = Color;
+        Sprite->Threshold = 2.0f; // Never blooms
+    }
 }
 
 void
@@ -765,55 +3346,99 @@ R_DrawText2D(renderer *Renderer, char *Text, font *Font, glm::vec2 Position, glm
     Assert(Text);
     Assert(Font);
 
-    glUseProgram(Renderer->Shaders.Text);
-    glm::mat4 Identity = glm::mat4(1.0f);
-    R_SetUniform(Renderer->Shaders.Text, "Model", Identity);
-    R_SetUniform(Renderer->Shaders.Text, "TextColor", Color);
-    f32 TextBrightnessThreshold = 1.0f;
-    R_SetUniform(Renderer->Shaders.Text, "BrightnessThreshold", TextBrightnessThreshold);
+    if(!Font->IsReady)
+    {
+        // Still loading, see asset.cpp
+        return;
+    }
 
-    glActiveTexture(GL_TEXTURE0); // TODO: Read why do we need to activate textures! NOTE: read this https://community.khronos.org/t/when-to-use-glactivetexture/64913
-    glBindVertexArray(Renderer->TextVAO);
+    // Strings are grouped by font, each font is a single draw call
+    u64 Key = R_MakeSortKey(RenderLayer_UI, true, Renderer->Shaders.Text, Font->Texture, 0.0f);
 
-    // Iterate through all the characters in string
-    for(char *Ptr = Text; *Ptr != '\0'; Ptr++)
+    size_t TextSize = strlen(Text) + 1;
+    render_command_text *Command = (render_command_text*)R_PushCommand(Renderer, RenderCommand_Text, Key, sizeof(render_command_text) + TextSize);
+    if(Command)
     {
-        character Ch = Font->Characters[*Ptr];
+        Command->Text = (char*)(Command + 1);
+        memcpy(Command->Text, Text, TextSize);
+        Command->Font = Font;
+        Command->Position = Position;
+        Command->Scale = Scale;
+        Command->Color = Color;
+    }
+}
 
-        f32 XPos = Position.x + Ch.Bearing.x * Scale.x;
-        f32 YPos = Position.y - (Ch.Size.y - Ch.Bearing.y) * Scale.y;
+text_object *R_CreateText(renderer *Renderer, font *Font, glm::vec2 Scale = glm::vec2(1.0f), glm::vec3 Color = glm::vec3(1.0f))
+{
+    // Text objects are never freed, there is room for TEXT_MAX_OBJECTS
+    Assert(Renderer);
+    Assert(Font);
+    Assert(Renderer->TextObjectCount < TEXT_MAX_OBJECTS);
+
+    u32 Index = Renderer->TextObjectCount++;
+    text_object *Result = &Renderer->TextObjects[Index];
+    Result->Font = Font;
+    Result->Text[0] = '\0';
+    Result->Position = glm::vec2(0.0f);
+    Result->Scale = Scale;
+    Result->Color = Color;
+    Result->FirstVertex = Index * TEXT_OBJECT_MAX_LENGTH * 6;
+    Result->VertexCount = 0;
+    Result->IsDirty = true;
 
-        f32 W = Ch.Size.x * Scale.x;
-        f32 H = Ch.Size.y * Scale.y;
+    return Result;
+}
 
-        // printf("W: %2.2f\tH: %2.2f\n", W, H);
+void R_SetText(text_object *Object, char *Text, glm::vec2 Position)
+{
+    // Cheap when nothing changed, the object is laid out again on the next draw otherwise
+    Assert(Object);
+    Assert(Text);
 
-        // Update VBO for each character
-        // TODO: Move QuadVertices to the bottom of renderer.h
-        f32 QuadVertices[6][3] =
-        {
-            { XPos,     YPos + H, 0.0f},
-            { XPos,     YPos,     0.0f},
-            { XPos + W, YPos,     0.0f},
-            { XPos,     YPos + H, 0.0f},
-            { XPos + W, YPos,     0.0f},
-            { XPos + W, YPos + H, 0.0f}
-        };
+    if(Object->Position != Position || strncmp(Object->Text, Text, TEXT_OBJECT_MAX_LENGTH - 1) != 0)
+    {
+        SDL_strlcpy(Object->Text, Text, TEXT_OBJECT_MAX_LENGTH);
+        Object->Position = Position;
+        Object->IsDirty = true;
+    }
+}
 
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, Ch.TextureID);
-        glBindBuffer(GL_ARRAY_BUFFER, Renderer->TextVertexBuffer); // Update content of Vertex buffer
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(QuadVertices), QuadVertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+void R_SetTextStyle(text_object *Object, glm::vec2 Scale, glm::vec3 Color)
+{
+    Assert(Object);
 
-        // Render  Quad
-        glDrawArrays(GL_TRIANGLES, 0, 6); Renderer->CurrentDrawCallsPerFrame++;
-        // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        Position.x += (Ch.Advance >> 6) * Scale.x; // Bitshift by 6 to get value in pixels (2^6 = 64)
+    if(Object->Scale != Scale || Object->Color != Color)
+    {
+        Object->Scale = Scale;
+        Object->Color = Color;
+        Object->IsDirty = true;
+    }
+}
+
+void R_DrawText(renderer *Renderer, text_object *Object)
+{
+    Assert(Renderer);
+    Assert(Object);
+
+    if(!Object->Font->IsReady)
+    {
+        // Still loading, see asset.cpp
+        return;
     }
 
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Same key as R_DrawText2D, retained and immediate text of a font stay together
+    u64 Key = R_MakeSortKey(RenderLayer_UI, true, Renderer->Shaders.Text, Object->Font->Texture, 0.0f);
+    render_command_text_object *Command = (render_command_text_object*)R_PushCommand(Renderer, RenderCommand_TextObject, Key, sizeof(render_command_text_object));
+    if(Command)
+    {
+        Command->Object = Object;
+    }
+}
+
+void R_DrawText(renderer *Renderer, text_object *Object, char *Text, glm::vec2 Position)
+{
+    R_SetText(Object, Text, Position);
+    R_DrawText(Renderer, Object);
 }
 
 void R_CalculateFPS(renderer *Renderer, clock *Clock)
@@ -872,16 +3497,87 @@ void R_ResetCamera(camera *Camera, i32 WindowWidth, i32 WindowHeight, glm::vec3
 
 void R_DrawEntity(renderer *Renderer, entity *Entity)
 {
-    R_DrawTexture(Renderer, Entity->Texture, Entity->Position, Entity->Size, glm::vec3(0.0f, 0.0f, 1.0f), Entity->Angle);
+    R_DrawTexture(Renderer, Entity->Texture, Entity->Position, Entity->Size, Entity->Angle);
 }
 
-void R_DrawEntityList(renderer *Renderer, entity_list *List)
+u32 R_CullBounds(frustum *Frustum, cull_bounds *Bounds)
 {
-    for(entity_node *Node = List->Head;
-        Node != NULL;
-        Node = Node->Next)
+    // Writes the indices of the boxes that touch the frustum to Bounds->Visible
+    // and returns how many there are. A box is outside when it is completely
+    // behind one plane: Distance(Center) + dot(Extent, abs(Normal)) < 0.
+    u32 VisibleCount = 0;
+    __m128 Zero = _mm_setzero_ps();
+    for(u32 i = 0; i < Bounds->Count; i += 4)
     {
-        R_DrawEntity(Renderer, Node->Entity);
+        // Lanes past Count read stale entries, they are masked out below
+        __m128 CenterX = _mm_loadu_ps(&Bounds->CenterX[i]);
+        __m128 CenterY = _mm_loadu_ps(&Bounds->CenterY[i]);
+        __m128 CenterZ = _mm_loadu_ps(&Bounds->CenterZ[i]);
+        __m128 ExtentX = _mm_loadu_ps(&Bounds->ExtentX[i]);
+        __m128 ExtentY = _mm_loadu_ps(&Bounds->ExtentY[i]);
+        __m128 ExtentZ = _mm_loadu_ps(&Bounds->ExtentZ[i]);
+
+        __m128 Inside = _mm_cmpeq_ps(Zero, Zero);
+        for(u32 Plane = 0; Plane < 6; Plane++)
+        {
+            glm::vec4 P = Frustum->Planes[Plane];
+            __m128 Distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(CenterX, _mm_set1_ps(P.x)),
+                                                    _mm_mul_ps(CenterY, _mm_set1_ps(P.y))),
+                                         _mm_add_ps(_mm_mul_ps(CenterZ, _mm_set1_ps(P.z)), _mm_set1_ps(P.w)));
+            __m128 Radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ExtentX, _mm_set1_ps(fabsf(P.x))),
+                                                  _mm_mul_ps(ExtentY, _mm_set1_ps(fabsf(P.y)))),
+                                       _mm_mul_ps(ExtentZ, _mm_set1_ps(fabsf(P.z))));
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(_mm_add_ps(Distance, Radius), Zero));
+        }
+
+        i32 Mask = _mm_movemask_ps(Inside);
+        for(u32 Lane = 0; Lane < 4 && i + Lane < Bounds->Count; Lane++)
+        {
+            if(Mask & (1 << Lane))
+            {
+                Bounds->Visible[VisibleCount++] = i + Lane;
+            }
+        }
     }
 
+    return VisibleCount;
+}
+
+void R_DrawEntityList(renderer *Renderer, entity_list *List)
+{
+    PF_SCOPE("R_DrawEntityList");
+    cull_bounds *Bounds = Renderer->CullBounds;
+    entity_node *Node = List->Head;
+    while(Node != NULL)
+    {
+        // Gather the bounds of up to CULL_BATCH_SIZE entities
+        Bounds->Count = 0;
+        for(; Node != NULL && Bounds->Count < CULL_BATCH_SIZE; Node = Node->Next)
+        {
+            // The sprite quad is centered on Position and rotated around Z, see sprite.glsl
+            entity *Entity = Node->Entity;
+            f32 Angle = glm::radians(Entity->Angle);
+            f32 C = fabsf(cosf(Angle));
+            f32 S = fabsf(sinf(Angle));
+            f32 HalfWidth = fabsf(Entity->Size.x) * 0.5f;
+            f32 HalfHeight = fabsf(Entity->Size.y) * 0.5f;
+
+            u32 i = Bounds->Count++;
+            Bounds->Entities[i] = Entity;
+            Bounds->CenterX[i] = Entity->Position.x;
+            Bounds->CenterY[i] = Entity->Position.y;
+            Bounds->CenterZ[i] = Entity->Position.z;
+            Bounds->ExtentX[i] = C * HalfWidth + S * HalfHeight;
+            Bounds->ExtentY[i] = S * HalfWidth + C * HalfHeight;
+            Bounds->ExtentZ[i] = fabsf(Entity->Size.z) * 0.5f;
+        }
+
+        u32 VisibleCount = R_CullBounds(&Renderer->Frustum, Bounds);
+        for(u32 i = 0; i < VisibleCount; i++)
+        {
+            R_DrawEntity(Renderer, Bounds->Entities[Bounds->Visible[i]]);
+        }
+        Renderer->CurrentEntitiesDrawn += VisibleCount;
+        Renderer->CurrentEntitiesCulled += Bounds->Count - VisibleCount;
+    }
 }
@@ -3,12 +3,571 @@
 #include "shared.h"
 #include "platform.h"
 
+struct texture
+{
+    u32 Handle;
+    i32 Width;
+    i32 Height;
+    i32 ChannelCount;
+    GLenum InternalFormat;
+    GLenum Format;
+    b32 IsReady; // Set once the pixels are on the GPU, async loaded textures start as not ready
+    b32 IsPremultiplied; // Colors are multiplied by alpha, see cooker.h
+
+    // Part of Handle used by this texture, xy = Offset, zw = Scale.
+    // (0, 0, 1, 1) unless the texture is a sprite inside an atlas page.
+    glm::vec4 UVRect;
+};
+
+#define SHADER_MAX_PROGRAMS 32
+#define SHADER_MAX_UNIFORMS 32
+
+// Filled once when a program is linked (see R_ReflectShader), setting a
+// uniform never asks GL for its location.
+struct shader_uniform
+{
+    u32 NameHash; // HashString of the name, without the "[0]" of arrays
+    i32 Location;
+    GLenum Type;
+    i32 ArraySize;
+
+    // Last value uploaded, uploading the same value again is skipped
+    b32 HasValue;
+    u8 Value[sizeof(glm::mat4)];
+};
+
+struct shader_program
+{
+    u32 Handle;
+    u32 UniformCount;
+    shader_uniform Uniforms[SHADER_MAX_UNIFORMS];
+};
+
+/*
+  Program binary cache
+
+  With GL_ARB_get_program_binary the linked program of every shader is
+  saved next to its source (shaders/name.glsl.bin) and loaded with
+  glProgramBinary on the next launch instead of compiling. The key
+  hashes the driver's vendor/renderer/version strings, the #define
+  prefixes and the source, any change compiles again. A binary the
+  driver rejects (driver update, other GPU) is compiled and replaced.
+*/
+
+#define SHADER_CACHE_MAGIC 0x48435347 // "GSCH"
+#define SHADER_CACHE_VERSION 1
+
+// Not in our OpenGL 3.3 glad, GL_ARB_get_program_binary / OpenGL 4.1
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+struct shader_cache_header
+{
+    u32 Magic;
+    u32 Version;
+    u64 Key;
+    u32 Format; // binaryFormat of glGetProgramBinary
+    u32 Size; // Bytes of binary after the header
+};
+
+struct shader_cache
+{
+    b32 IsSupported;
+    u64 DriverHash;
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinary;
+    PFNGLPROGRAMBINARYPROC ProgramBinary;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteri;
+
+    // Startup counters, printed once the renderer is created
+    u32 Hits;
+    u32 Misses; // No binary or an old key
+    u32 Rejected; // The driver did not take the binary
+    f64 Ms; // Spent in R_CreateShader, reading included
+};
+
+#define GL_STATE_MAX_TEXTURE_UNITS 16
+
+// Shadow copy of the OpenGL state we change every frame. All binds go
+// through R_UseProgram, R_BindVertexArray, R_BindBuffer, R_BindTexture,
+// R_BindFramebuffer, R_SetBlend and R_SetDepthTest, which skip the GL
+// call when the value is already set.
+struct gl_state
+{
+    u32 Program;
+    u32 VertexArray;
+    u32 ArrayBuffer;
+    u32 UniformBuffer;
+    u32 PixelUnpackBuffer;
+    u32 PixelPackBuffer;
+    u32 Framebuffer;
+    u32 ActiveTextureUnit; // 0 = GL_TEXTURE0
+    u32 Textures[GL_STATE_MAX_TEXTURE_UNITS]; // GL_TEXTURE_2D bound to each unit
+
+    b32 BlendEnabled;
+    GLenum BlendSource;
+    GLenum BlendDestination;
+    b32 DepthTestEnabled;
+    b32 DepthWriteDisabled; // glDepthMask, written by default
+
+    // Per frame counters, R_EndFrame moves them into the renderer
+    u32 Changes;
+    u32 ChangesSkipped;
+};
+
+// Per instance data of the sprite batch, matches the attributes of sprite.glsl
+struct sprite_instance
+{
+    glm::vec4 PositionAngle; // xyz = Position, w = Rotation angle in degrees
+    glm::vec4 SizeThreshold; // xy = Size, z = BrightnessThreshold
+    glm::vec4 Tint;
+    glm::vec4 UVRect; // texture::UVRect
+};
+
+#define SPRITE_BATCH_MAX_INSTANCES 4096 // Sprites per glDrawArraysInstanced
+
+// Vertex of the text batch, matches the attributes of text.glsl
+struct text_vertex
+{
+    glm::vec2 Position;
+    glm::vec2 UV;
+    glm::vec3 Color;
+};
+
+#define TEXT_BATCH_MAX_GLYPHS 4096 // Glyphs per glDrawArrays, 6 vertices each
+#define TEXT_OBJECT_MAX_LENGTH 128 // Characters, every text object owns room for this many glyphs on the GPU
+#define TEXT_MAX_OBJECTS 64
+#define FONT_GLYPH_PADDING 1 // Empty texels around every glyph in the font atlas
+#define FONT_MAX_ATLAS_SIZE 4096
+#define FONT_SDF_SIZE 42 // Pixel size of distance field glyphs, whatever size the font is drawn at
+#define FONT_SDF_SPREAD 6 // Pixels of distance stored around every distance field glyph
+#define FONT_SDF_SUPERSAMPLE 4 // Glyphs are rasterized this many times bigger before computing the distance field
+
+/*
+  Render commands
+
+  R_DrawTexture and R_DrawText2D do not draw, they append a command to
+  the frame's command buffer (safe to call from any thread). R_EndFrame
+  radix sorts the commands by their 64 bit key and executes them, so
+  draws that share state end up next to each other.
+
+  Key, most significant bits first:
+  Opaque:      Layer(4) | 0 | Shader(8) | Texture(16) | Depth(24), front to back
+  Translucent: Layer(4) | 1 | Depth(24) inverted | Shader(8) | Texture(16), back to front
+*/
+
+#define RENDER_MAX_COMMANDS 32768
+#define RENDER_FRAME_ARENA_SIZE Megabytes(8)
+
+/*
+  Streaming buffer
+
+  Every per frame upload (sprite instances, text quads, particles) is
+  appended to one GL_ARRAY_BUFFER split in RENDER_STREAM_FRAMES regions,
+  one per frame in flight. Uploads map their range with GL_MAP_UNSYNCHRONIZED_BIT,
+  the driver does not wait for the GPU because R_EndFrame puts a fence
+  after the last draw that reads the region and R_BeginFrame checks it
+  before the region is written again.
+
+  When the fence is not signaled yet, or a frame uploads more than a
+  region, the whole buffer is orphaned (glBufferData NULL) instead of
+  waiting. Drivers where mapping is slow switch to orphaning every frame
+  and glBufferSubData.
+*/
+
+#define RENDER_STREAM_FRAMES 3
+#define RENDER_STREAM_REGION_SIZE Megabytes(8) // A full particle pool is 4 MB, see particle.h
+#define RENDER_STREAM_SLOW_MAP_MS 0.5f // Map time per frame considered slow
+#define RENDER_STREAM_SLOW_FRAMES 60 // Consecutive slow frames before switching to orphaning
+
+enum stream_buffer_mode
+{
+    StreamBuffer_Unsynchronized, // Mapped ranges guarded by fences
+    StreamBuffer_Orphaning, // glBufferData NULL every frame, glBufferSubData appends
+};
+
+struct stream_buffer
+{
+    stream_buffer_mode Mode;
+    u32 Handle;
+    size_t RegionSize;
+    u32 Region; // Written this frame
+    size_t Offset; // Next free byte of the region
+    GLsync Fences[RENDER_STREAM_FRAMES];
+
+    u64 MapTicks; // This frame, SDL_GetPerformanceCounter ticks spent mapping and copying
+    u32 SlowFrames;
+
+    // Per frame counters, R_EndFrame moves them into the previous frame
+    size_t Bytes;
+    u32 Orphans;
+    size_t PreviousBytes;
+    u32 PreviousOrphans;
+};
+
+/*
+  Frustum culling
+
+  R_DrawEntityList does not submit entities that are off screen. The six
+  planes of the frustum are taken from Projection * View in R_UpdateCamera,
+  the entities of a list are gathered into SoA arrays of world space AABB
+  centers and half extents (cull_bounds) and tested four at a time with
+  SSE. Only the visible ones reach R_DrawTexture.
+*/
+
+#define CULL_BATCH_SIZE 1024 // Entities gathered per SIMD pass, multiple of 4
+
+struct entity;
+
+struct frustum
+{
+    glm::vec4 Planes[6]; // xyz = Normal pointing inside, w = Distance, normalized
+};
+
+struct cull_bounds
+{
+    u32 Count;
+    f32 CenterX[CULL_BATCH_SIZE];
+    f32 CenterY[CULL_BATCH_SIZE];
+    f32 CenterZ[CULL_BATCH_SIZE];
+    f32 ExtentX[CULL_BATCH_SIZE];
+    f32 ExtentY[CULL_BATCH_SIZE];
+    f32 ExtentZ[CULL_BATCH_SIZE];
+    entity *Entities[CULL_BATCH_SIZE];
+    u32 Visible[CULL_BATCH_SIZE]; // Indices of the visible entries, written by R_CullBounds
+};
+
+/*
+  Bloom
+
+  The brightness buffer is reduced into a chain of R11F_G11F_B10F
+  textures, the first one is half the screen size and every next one is
+  half of the previous one. Each level is downsampled from the level
+  above and then upsampled back up the chain with bilinear taps (dual
+  filter), the composite reads the half size level. When bloom is
+  disabled the render graph culls every pass of the chain.
+*/
+
+#define BLOOM_MAX_MIPS 5
+
+/*
+  Anti-aliasing
+
+  None: the scene is drawn straight into the HDR framebuffer.
+  FXAA: the bloom composite filters edges of the HDR color buffer, costs
+        up to 9 extra texture reads per pixel and no memory.
+  MSAA: the scene is drawn into multisampled renderbuffers that are
+        resolved into the HDR framebuffer before the bloom chain.
+*/
+
+#define MSAA_MAX_SAMPLES 8
+
+/*
+  Dynamic resolution
+
+  The render targets are allocated once at TargetWidth x TargetHeight,
+  the desktop size. Every frame the scene is drawn into the bottom left
+  RenderWidth x RenderHeight of them, RenderScale times the window size,
+  and the composite upscales that rectangle to the window. The scale
+  follows the GPU frame time measured with timestamp queries toward
+  GPUFrameBudgetMs.
+*/
+
+#define RENDER_MIN_SCALE 0.5f
+#define RENDER_SCALE_PIXEL_STEP 8
+
+/*
+  GPU profiler
+
+  Every pass is wrapped in GL_TIME_ELAPSED queries, a pass can be timed
+  many times per frame (every sprite batch is part of GPUPass_Scene) and
+  its queries are added up. The whole frame is measured with two
+  GL_TIMESTAMP queries. Queries are read RENDER_GPU_FRAMES_IN_FLIGHT
+  frames later, when the results are normally ready, a frame whose
+  results are not ready is dropped instead of waiting for the GPU.
+
+  The present latency is the time from R_BeginFrame to the GPU finishing
+  the frame: the GPU clock is read on the CPU (glGetInteger64v GL_TIMESTAMP)
+  when the frame begins and compared with the end timestamp. The wait
+  for the display after that is not part of it.
+*/
+
+#define RENDER_GPU_FRAMES_IN_FLIGHT 3
+#define GPU_TIMER_MAX_QUERIES 64 // Timed sections per frame, the rest are not timed
+#define GPU_TIMER_HISTORY 64 // Frames of the rolling min/avg/max
+
+enum gpu_pass
+{
+    GPUPass_Scene,
+    GPUPass_Text,
+    GPUPass_Resolve,
+    GPUPass_BloomDownsample,
+    GPUPass_BloomUpsample,
+    GPUPass_Composite,
+
+    GPUPass_Count,
+};
+
+struct gpu_timer_frame
+{
+    u32 Queries[GPU_TIMER_MAX_QUERIES];
+    gpu_pass Passes[GPU_TIMER_MAX_QUERIES];
+    u32 QueryCount;
+    u32 Timestamps[2]; // Begin and end of the frame
+    GLint64 SubmitTime; // GPU clock when R_BeginFrame ran, nanoseconds
+    b32 IsPending;
+};
+
+struct gpu_timer_stats
+{
+    f32 Ms; // Last frame read back
+    f32 MinMs;
+    f32 AvgMs;
+    f32 MaxMs;
+    f32 History[GPU_TIMER_HISTORY];
+};
+
+struct gpu_profiler
+{
+    gpu_timer_frame Frames[RENDER_GPU_FRAMES_IN_FLIGHT];
+    u32 FrameIndex;
+    b32 IsTiming; // GL_TIME_ELAPSED queries can not be nested
+
+    gpu_timer_stats Passes[GPUPass_Count];
+    gpu_timer_stats Frame;
+    gpu_timer_stats Latency;
+    u32 HistoryIndex;
+    u32 HistoryCount;
+    u32 DroppedFrames;
+};
+
+/*
+  Render graph
+
+  The passes after the command buffer (scene, MSAA resolve, bloom chain,
+  composite) and the render targets they use are declared in
+  R_BuildRenderGraph: every pass lists the resources it reads and writes.
+  Compiling the graph:
+
+  1- Culls, walking back from the passes that write the default
+     framebuffer, the passes whose writes nobody reads (the whole bloom
+     chain and the brightness resolve when bloom is off). Writes nobody
+     reads are not attached, depth is always kept for its own pass.
+  2- Finds the first and last pass of every resource. Passes run in the
+     order they are declared, every read must follow a write.
+  3- Gives every resource a target of the same format and sample count,
+     reusing (aliasing) the target of a resource whose last pass is
+     already done when it is big enough, the pass draws into its bottom
+     left corner like with dynamic resolution.
+
+  The GL textures and renderbuffers of the previous compile are kept in
+  a pool and reused when a target has the same format and size. The
+  graph is built again only when a setting it depends on changes (see
+  R_GetRenderGraphKey), never per frame.
+*/
+
+#define RENDER_GRAPH_MAX_PASSES 16
+#define RENDER_GRAPH_MAX_RESOURCES 16
+#define RENDER_GRAPH_MAX_TARGETS RENDER_GRAPH_MAX_RESOURCES
+#define RENDER_GRAPH_MAX_READS 2
+#define RENDER_GRAPH_MAX_WRITES 3 // Color, brightness and depth of the scene
+
+enum render_pass_type
+{
+    RenderPass_Scene, // Executes the command buffer
+    RenderPass_Resolve, // Blits a multisampled resource into a single sampled one
+    RenderPass_BloomDownsample,
+    RenderPass_BloomUpsample,
+    RenderPass_Composite,
+};
+
+struct render_resource
+{
+    char *Name;
+    GLenum Format;
+    i32 Width; // Size the passes draw at, the target can be bigger when aliased
+    i32 Height;
+    i32 Samples; // 0 = texture, multisampled resources are renderbuffers
+    b32 IsImported; // The default framebuffer, not allocated by the graph
+
+    // Set by R_CompileRenderGraph
+    b32 IsUsed;
+    i32 FirstPass;
+    i32 LastPass;
+    u32 Target;
+};
+
+struct render_pass
+{
+    char *Name;
+    render_pass_type Type;
+    gpu_pass Timer;
+    u32 Reads[RENDER_GRAPH_MAX_READS];
+    u32 ReadCount;
+    u32 Writes[RENDER_GRAPH_MAX_WRITES]; // Color attachments in order, depth formats are the depth attachment
+    u32 WriteCount;
+
+    // Set by R_CompileRenderGraph
+    b32 IsCulled;
+    u32 Framebuffer; // Targets of the used writes, 0 when writing the default framebuffer
+    u32 ReadFramebuffer; // RenderPass_Resolve, the multisampled source
+};
+
+struct render_target
+{
+    GLenum Format;
+    i32 Width;
+    i32 Height;
+    i32 Samples;
+    b32 IsRenderbuffer; // Multisampled and depth targets are never sampled
+    u32 Handle;
+    i32 FreeAfter; // Last pass of the resource using it, while compiling
+};
+
+struct render_graph
+{
+    render_pass Passes[RENDER_GRAPH_MAX_PASSES];
+    u32 PassCount;
+    render_resource Resources[RENDER_GRAPH_MAX_RESOURCES];
+    u32 ResourceCount;
+    render_target Targets[RENDER_GRAPH_MAX_TARGETS];
+    u32 TargetCount;
+
+    u64 Key; // Settings the graph was built for
+    b32 IsComplete; // Every framebuffer of the used passes is complete
+
+    // Cost, shown in the debug overlay
+    size_t DeclaredBytes; // Every declared resource in its own target, nothing culled
+    size_t AllocatedBytes;
+    u32 CulledPassCount;
+    u32 AliasedResourceCount;
+};
+
+/*
+  Frame readback
+
+  While enabled (R_EnableReadback), R_EndFrame copies the composited frame
+  into the next of RENDER_READBACK_FRAMES pixel buffer objects before
+  the swap: glReadPixels into a GL_PIXEL_PACK_BUFFER returns as soon as
+  the copy is queued. A fence after the copy tells when the GPU is done,
+  R_MapReadback hands out the oldest frame once its fence is signaled,
+  normally a frame or two later, and only waits for it when the ring is
+  full. The capture (see capture.h) copies it out and unmaps it.
+*/
+
+#define RENDER_READBACK_FRAMES 3
+
+struct frame_readback
+{
+    b32 IsEnabled;
+    u32 Buffers[RENDER_READBACK_FRAMES];
+    size_t BufferSizes[RENDER_READBACK_FRAMES]; // Grow with the drawable, never shrink
+    GLsync Fences[RENDER_READBACK_FRAMES];
+    u32 Widths[RENDER_READBACK_FRAMES];
+    u32 Heights[RENDER_READBACK_FRAMES];
+    u32 First; // Oldest frame not mapped yet
+    u32 PendingCount;
+    b32 IsMapped;
+
+    u32 StalledFrames; // R_MapReadback had to wait for the GPU
+};
+
+enum anti_aliasing_mode
+{
+    AntiAliasing_None,
+    AntiAliasing_FXAA,
+    AntiAliasing_MSAA,
+
+    AntiAliasing_Count,
+};
+
+enum render_layer
+{
+    RenderLayer_World,
+    RenderLayer_UI, // Drawn after the whole world
+};
+
+enum render_command_type
+{
+    RenderCommand_Sprite,
+    RenderCommand_Text,
+    RenderCommand_TextObject,
+    RenderCommand_Particles,
+};
+
+struct render_command
+{
+    u64 Key;
+    render_command_type Type;
+    void *Data; // render_command_sprite, _text or _particles, allocated from the frame arena
+};
+
+struct render_command_sprite
+{
+    u32 Shader;
+    texture *Texture;
+    glm::vec3 Position;
+    glm::vec3 Size;
+    f32 RotationAngle;
+    glm::vec4 Tint;
+    f32 Threshold;
+};
+
+// One pool of the particle system (see particle.h), the arrays stay valid until R_EndFrame
+struct render_command_particles
+{
+    u32 Shader;
+    texture *Texture;
+    f32 Intensity;
+    u32 Count;
+    f32 *PositionX;
+    f32 *PositionY;
+    f32 *Size;
+    u32 *Color; // RGBA8
+};
+
+struct font;
+struct render_command_text
+{
+    char *Text; // Copied into the frame arena
+    font *Font;
+    glm::vec2 Position;
+    glm::vec2 Scale;
+    glm::vec3 Color;
+};
+
+// Retained text, laid out and uploaded only when the string or the
+// style changes (see R_SetText). The glyph vertices stay on the GPU in
+// the renderer's RetainedTextBuffer.
+struct text_object
+{
+    font *Font;
+    char Text[TEXT_OBJECT_MAX_LENGTH];
+    glm::vec2 Position;
+    glm::vec2 Scale;
+    glm::vec3 Color;
+
+    u32 FirstVertex; // Range owned inside RetainedTextBuffer, TEXT_OBJECT_MAX_LENGTH * 6 vertices
+    u32 VertexCount;
+    b32 IsDirty;
+};
+
+struct render_command_text_object
+{
+    text_object *Object;
+};
+
 struct renderer
 {
     window *Window;
 
     // Settings
     f32 Exposure;
+    anti_aliasing_mode AntiAliasing;
+    i32 MultisampleCount; // Samples per pixel of the MSAA targets, clamped to GL_MAX_SAMPLES
 
     // OpenGL
     const u8 *HardwareVendor = NULL;
@@ -21,32 +580,105 @@ struct renderer
     u32 DrawableWidth;
     u32 DrawableHeight;
 
+    // Dynamic resolution
+    u32 TargetWidth; // Size the render targets are allocated at
+    u32 TargetHeight;
+    u32 RenderWidth; // Part of the render targets the scene is drawn into this frame
+    u32 RenderHeight;
+    f32 RenderScale;
+    f32 GPUFrameMs; // RENDER_GPU_FRAMES_IN_FLIGHT frames old, see gpu_profiler
+
+    gpu_profiler GPUProfiler;
+    f32 SwapMs; // CPU time blocked in SDL_GL_SwapWindow last frame
+
     u32 QuadVAO;
     u32 QuadVBO;
-    u32 TextVAO;
-    u32 TextVertexBuffer;
-    u32 TextTexCoordsBuffer;
+    u32 TextVAO; // Reads from StreamBuffer
     u32 UnitQuadVAO;
     u32 UnitQuadVBO;
 
+    // 1x1 white texture, always available, used to draw the loading screen
+    texture *WhiteTexture;
+
+    // Sprite batch, sprites with the same shader and texture are drawn with a single instanced draw call
+    u32 SpriteVAO; // Instances are read from StreamBuffer
+    u32 ParticleVAO; // Same quad, the particle arrays are read from StreamBuffer
+    sprite_instance *SpriteInstances;
+    u32 SpriteInstanceCount;
+    u32 SpriteBatchShader;
+    u32 SpriteBatchTexture;
+
+    // Text batch, glyphs of every string that uses the same font are drawn with a single draw call
+    text_vertex *TextVertices;
+    u32 TextVertexCount;
+    font *TextBatchFont;
+
+    // Retained text objects, consecutive objects of the same font are drawn with one glMultiDrawArrays
+    u32 RetainedTextVAO;
+    u32 RetainedTextBuffer;
+    text_object *TextObjects;
+    u32 TextObjectCount;
+    i32 RetainedTextFirst[TEXT_MAX_OBJECTS];
+    i32 RetainedTextCounts[TEXT_MAX_OBJECTS];
+    u32 RetainedTextBatchCount;
+    font *RetainedTextBatchFont;
+
+    // Sprite instances and text quads of the frame
+    stream_buffer StreamBuffer;
+
+    // Command buffer, reset every frame
+    memory_arena FrameArena;
+    render_command *Commands;
+    SDL_atomic_t CommandCount;
+    glm::mat4 View; // Copy of the camera view, sort keys use the view space depth
+    frustum Frustum; // Of the camera, updated with View
+    cull_bounds *CullBounds;
+
     struct Shaders
     {
-        u32 Blur; // Does not use Uniform Buffer object for Camera
+        u32 BloomDownsample; // Does not use Uniform Buffer object for Camera
+        u32 BloomUpsample; // Does not use Uniform Buffer object for Camera
         u32 Bloom; // Does not use Uniform Buffer object for Camera
         u32 Hdr; // Does not use Uniform Buffer object for Camera
         u32 Texture;
         u32 Text;
         u32 Ball;
+        u32 Sprite;
+        u32 SpriteUI; // Same as Sprite in screen space
+        u32 Particle;
     } Shaders;
 
-    u32 Framebuffer;
-    u32 ColorBuffer;
-    u32 BrightnessBuffer;
-    u32 DepthStencilRenderbuffer;
+    // Uniforms set every frame, looked up once after the shaders are compiled
+    struct Uniforms
+    {
+        shader_uniform *BloomEnabled;
+        shader_uniform *BloomExposure;
+        shader_uniform *BloomFXAA;
+        shader_uniform *BloomSceneScale;
+        shader_uniform *BloomBlurScale;
+        shader_uniform *BloomDownsampleSourceScale;
+        shader_uniform *BloomUpsampleSourceScale;
+        shader_uniform *TextBrightnessThreshold;
+        shader_uniform *TextDistanceField;
+        shader_uniform *ParticleUVRect;
+        shader_uniform *ParticleIntensity;
+    } Uniforms;
+
     u32 UniformCameraBuffer;
-    u32 Attachments[2];
-    u32 PingPongFBO[2];
-    u32 PingPongBuffer[2];
+
+    // HDR scene, MSAA and bloom targets, see R_BuildRenderGraph
+    render_graph RenderGraph;
+
+    // What the composite draws into, 0 (the window) unless headless
+    u32 OutputFramebuffer;
+    u32 OutputRenderbuffer;
+
+    // Asynchronous copies of the output for the capture
+    frame_readback Readback;
+
+    // Cost of the current anti-aliasing mode, shown in the debug overlay
+    size_t AntiAliasingBytes; // Render target memory on top of the HDR framebuffer
+    u32 AntiAliasingReadsPerPixel; // Extra texture or sample reads per screen pixel, worst case
 
     // These variables correspond to the FPS counter
     f32 FPS; // AverageFPS
@@ -56,6 +688,14 @@ struct renderer
 
     u32 PreviousDrawCallsPerFrame;
     u32 CurrentDrawCallsPerFrame;
+    u32 PreviousUniformUploadsPerFrame;
+    u32 PreviousUniformUploadsSkippedPerFrame; // Same value as the last upload, no GL call
+    u32 PreviousStateChangesPerFrame; // Binds and enables that reached the driver, see gl_state
+    u32 PreviousStateChangesSkippedPerFrame;
+    u32 PreviousEntitiesDrawn; // Entities of R_DrawEntityList inside the frustum
+    u32 PreviousEntitiesCulled;
+    u32 CurrentEntitiesDrawn;
+    u32 CurrentEntitiesCulled;
 };
 
 struct camera
@@ -78,19 +718,9 @@ struct camera
     glm::mat4 Ortho;
 };
 
-struct texture
-{
-    u32 Handle;
-    i32 Width;
-    i32 Height;
-    i32 ChannelCount;
-    GLenum InternalFormat;
-    GLenum Format;
-};
-
 struct character
 {
-    u32 TextureID;
+    glm::vec4 UVRect; // Rectangle inside the font atlas, xy = Offset, zw = Scale
     glm::ivec2 Size; // Size of glyph
     glm::ivec2 Bearing; // Offset from baseline to left/top of glyph
     u32 Advance; // Offset to advance to next glyph
@@ -102,6 +732,18 @@ struct font
     i32 Width;
     i32 Height;
     character Characters[256];
+
+    // Every glyph lives in a single GL_R8 atlas texture
+    u32 Texture;
+    i32 AtlasWidth;
+    i32 AtlasHeight;
+
+    // Distance field fonts store every glyph at FONT_SDF_SIZE and stay
+    // sharp at any scale. Characters are in atlas pixels, MetricsScale
+    // turns them into pixels of the requested size (1 for bitmap fonts).
+    b32 IsDistanceField;
+    f32 MetricsScale;
+    b32 IsReady; // Set once the glyphs are on the GPU, async loaded fonts start as not ready
 };
 
 f32 UnitQuadVertices__[] =
@@ -121,13 +763,3 @@ f32 QuadVertices__[] =
     0.5f,  0.5f, 0.0f, 1.0f, 1.0f,
     0.5f, -0.5f, 0.0f, 1.0f, 0.0f,
 };
-
-f32 TextTexCoords__[6][2] =
-{
-    {0.0, 0.0f},
-    {0.0f, 1.0f},
-    {1.0, 1.0},
-    {0.0, 0.0},
-    {1.0, 1.0},
-    {1.0, 0.0},
-};
@@ -48,6 +48,7 @@ typedef i32      b32;
 #define Kilobytes(Expr) ((Expr) * 1024)
 #define Megabytes(Expr) (Kilobytes(Expr) * 1024)
 #define Gigabytes(Expr) (Megabytes(Expr) * 1024)
+#define ArrayCount(Array) (sizeof(Array) / sizeof((Array)[0]))
 
 #define Pi32 3.14159265358979323846
 #define Cosf cosf
@@ -71,6 +72,43 @@ void Free(void *Ptr)
     free(Ptr);
 }
 
+// Linear allocator, allocations are never freed one by one, the whole
+// arena is reset at once (e.g. every frame). PushSize is thread safe.
+struct memory_arena
+{
+    u8 *Base;
+    size_t Size;
+    SDL_atomic_t Used;
+};
+
+void InitializeArena(memory_arena *Arena, size_t Size)
+{
+    Assert(Arena);
+    Arena->Base = (u8*)Malloc(Size);
+    Arena->Size = Size;
+    SDL_AtomicSet(&Arena->Used, 0);
+}
+
+void *PushSize(memory_arena *Arena, size_t Size)
+{
+    // Returns NULL when the arena is full
+    Assert(Arena);
+    size_t AlignedSize = (Size + 15) & ~(size_t)15;
+    size_t Offset = (size_t)SDL_AtomicAdd(&Arena->Used, (int)AlignedSize);
+    if(Offset + AlignedSize > Arena->Size)
+    {
+        return NULL;
+    }
+
+    return Arena->Base + Offset;
+}
+#define PushArray(Arena, Count, Type) (Type*)PushSize(Arena, sizeof(Type) * (Count))
+
+void ResetArena(memory_arena *Arena)
+{
+    SDL_AtomicSet(&Arena->Used, 0);
+}
+
 char *ReadTextFile(char *Filename)
 {
     // IMPORTANT(Jorge): The caller of this function needs to free the allocated pointer!
@@ -106,6 +144,19 @@ char *ReadTextFile(char *Filename)
     return Result;
 }
 
+u32 HashString(const char *String)
+{
+    // FNV-1a
+    u32 Result = 2166136261u;
+    for(const char *At = String; *At; At++)
+    {
+        Result ^= (u8)*At;
+        Result *= 16777619u;
+    }
+
+    return Result;
+}
+
 f32 Normalize(f32 Input, f32 Minimum, f32 Maximum)
 {
     return (Input - Minimum) / (Maximum - Minimum);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "sound.h"
+#include "pack.cpp"
 
 void S_SetMusicVolume(sound_system *System, i32 Input)
 {
@@ -72,7 +73,7 @@ sound_effect *S_CreateEffect(char *Filename)
 {
     Assert(Filename);
 
-    sound_effect *Result = Mix_LoadWAV(Filename);
+    sound_effect *Result = Mix_LoadWAV_RW(PK_OpenFile(Filename), 1);
     if(Result == NULL)
     {
         printf("Sound Effect %s failed to load\n", Filename);
@@ -87,7 +88,8 @@ sound_music *S_CreateMusic(char *Filename)
 {
     Assert(Filename);
 
-    sound_music *Result = Mix_LoadMUS(Filename);
+    // NOTE: Music is streamed while it plays, from the asset pack when it is in it
+    sound_music *Result = Mix_LoadMUS_RW(PK_OpenFile(Filename), 1);
     if(Result == NULL)
     {
         printf("S_CreateMusic failed to load %s\n", Filename);
@@ -0,0 +1,160 @@
+/*
+  Offline asset packer, see pack.h
+
+  Usage (from the build directory):
+      asset_packer assets.pack textures/Player.png fonts/NovaSquare-Regular.ttf shaders/sprite.glsl ...
+
+  Wildcards are expanded (setargv.obj), "asset_packer assets.pack textures\*.png fonts\*.ttf" works.
+
+  The names stored in the pack are the input paths, the game looks its
+  files up with the same paths it passes to the loaders. Run it again
+  after changing, cooking or adding any asset, files that are not in the
+  pack are still read from disk.
+*/
+
+#include <stdio.h>
+#include <SDL.h>
+
+#include "../shared.h"
+#include "../pack.cpp"
+
+struct packer_file
+{
+    u8 *Data;
+    size_t Size;
+};
+
+u64 AlignPackOffset(u64 Offset)
+{
+    return (Offset + PACK_ALIGNMENT - 1) & ~(u64)(PACK_ALIGNMENT - 1);
+}
+
+i32 main(i32 Argc, char **Argv)
+{
+    if(Argc < 3)
+    {
+        printf("Usage: asset_packer output.pack file [file ...]\n");
+        return -1;
+    }
+
+    u32 EntryCount = (u32)(Argc - 2);
+    if(EntryCount > PACK_MAX_ENTRIES)
+    {
+        printf("Too many files, a pack holds up to %d\n", PACK_MAX_ENTRIES);
+        return -1;
+    }
+
+    u32 SlotCount = 1;
+    while(SlotCount < EntryCount * 2)
+    {
+        SlotCount <<= 1;
+    }
+
+    pack_header Header = {};
+    Header.Magic = PACK_MAGIC;
+    Header.Version = PACK_VERSION;
+    Header.EntryCount = EntryCount;
+    Header.SlotCount = SlotCount;
+    Header.EntriesOffset = sizeof(pack_header);
+    Header.SlotsOffset = Header.EntriesOffset + sizeof(pack_entry) * EntryCount;
+
+    pack_entry *Entries = (pack_entry*)calloc(EntryCount, sizeof(pack_entry)); Assert(Entries);
+    u32 *Slots = (u32*)calloc(SlotCount, sizeof(u32)); Assert(Slots);
+    packer_file *Files = (packer_file*)calloc(EntryCount, sizeof(packer_file)); Assert(Files);
+
+    u64 Offset = AlignPackOffset(Header.SlotsOffset + sizeof(u32) * SlotCount);
+    for(u32 i = 0; i < EntryCount; i++)
+    {
+        char *Filename = Argv[i + 2];
+        pack_entry *Entry = &Entries[i];
+        if(strlen(Filename) >= PACK_NAME_LENGTH)
+        {
+            printf("File name is too long, up to %d characters: %s\n", PACK_NAME_LENGTH - 1, Filename);
+            return -1;
+        }
+
+        // The game always uses forward slashes
+        SDL_strlcpy(Entry->Name, Filename, PACK_NAME_LENGTH);
+        for(char *At = Entry->Name; *At; At++)
+        {
+            if(*At == '\\')
+            {
+                *At = '/';
+            }
+        }
+        Entry->NameHash = HashString(Entry->Name);
+
+        SDL_RWops *RWops = SDL_RWFromFile(Filename, "rb");
+        if(RWops == NULL)
+        {
+            printf("Could not open %s\n", Filename);
+            return -1;
+        }
+        packer_file *File = &Files[i];
+        File->Size = (size_t)SDL_RWsize(RWops);
+        File->Data = (u8*)malloc(File->Size + 1); Assert(File->Data);
+        if(File->Size > 0 && SDL_RWread(RWops, File->Data, File->Size, 1) != 1)
+        {
+            printf("Could not read %s\n", Filename);
+            SDL_RWclose(RWops);
+            return -1;
+        }
+        SDL_RWclose(RWops);
+        File->Data[File->Size] = 0;
+
+        Entry->Offset = Offset;
+        Entry->Size = File->Size;
+        Offset = AlignPackOffset(Offset + File->Size + 1);
+
+        u32 Mask = SlotCount - 1;
+        u32 Slot = Entry->NameHash & Mask;
+        while(Slots[Slot] != 0)
+        {
+            if(strcmp(Entries[Slots[Slot] - 1].Name, Entry->Name) == 0)
+            {
+                printf("%s is packed twice\n", Entry->Name);
+                return -1;
+            }
+            Slot = (Slot + 1) & Mask;
+        }
+        Slots[Slot] = i + 1;
+    }
+
+    SDL_RWops *RWops = SDL_RWFromFile(Argv[1], "wb");
+    if(RWops == NULL)
+    {
+        printf("Could not open %s\n", Argv[1]);
+        return -1;
+    }
+
+    b32 IsWritten = SDL_RWwrite(RWops, &Header, sizeof(Header), 1) == 1;
+    IsWritten = IsWritten && SDL_RWwrite(RWops, Entries, sizeof(pack_entry), EntryCount) == EntryCount;
+    IsWritten = IsWritten && SDL_RWwrite(RWops, Slots, sizeof(u32), SlotCount) == SlotCount;
+    u8 Zeros[PACK_ALIGNMENT] = {};
+    u64 Written = Header.SlotsOffset + sizeof(u32) * SlotCount;
+    for(u32 i = 0; IsWritten && i < EntryCount; i++)
+    {
+        size_t PaddingSize = (size_t)(Entries[i].Offset - Written);
+        IsWritten = PaddingSize == 0 || SDL_RWwrite(RWops, Zeros, PaddingSize, 1) == 1;
+        IsWritten = IsWritten && SDL_RWwrite(RWops, Files[i].Data, Files[i].Size + 1, 1) == 1;
+        Written = Entries[i].Offset + Files[i].Size + 1;
+    }
+    SDL_RWclose(RWops);
+
+    if(!IsWritten)
+    {
+        printf("Could not write %s\n", Argv[1]);
+        return -1;
+    }
+
+    printf("%s: %u files, %u slots, %llu bytes\n", Argv[1], EntryCount, SlotCount, (unsigned long long)Written);
+    for(u32 i = 0; i < EntryCount; i++)
+    {
+        free(Files[i].Data);
+    }
+    free(Files);
+    free(Slots);
+    free(Entries);
+
+    return 0;
+}
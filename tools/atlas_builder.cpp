@@ -0,0 +1,78 @@
+/*
+  Offline texture atlas builder, see atlas.h
+
+  Usage (from the build directory):
+      atlas_builder textures/sprites.atlas textures/Player.png textures/DeepBlue.png ...
+
+  The sprite names stored in the atlas are the input paths, the game
+  looks its textures up with the same paths it passes to A_LoadTexture.
+*/
+
+#include <stdio.h>
+#include <SDL.h>
+
+#include "../shared.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../external/stb_image.h"
+
+#include "../atlas.cpp"
+
+i32 main(i32 Argc, char **Argv)
+{
+    if(Argc < 3)
+    {
+        printf("Usage: atlas_builder output.atlas image.png [image.png ...]\n");
+        return -1;
+    }
+
+    u32 ImageCount = (u32)(Argc - 2);
+    if(ImageCount > ATLAS_MAX_SPRITES)
+    {
+        printf("Too many images, an atlas holds up to %d\n", ATLAS_MAX_SPRITES);
+        return -1;
+    }
+
+    // Same orientation as the textures loaded by the game
+    stbi_set_flip_vertically_on_load(1);
+
+    atlas_image Images[ATLAS_MAX_SPRITES] = {};
+    for(u32 i = 0; i < ImageCount; i++)
+    {
+        atlas_image *Image = &Images[i];
+        Image->Name = Argv[i + 2];
+        Image->Pixels = stbi_load(Image->Name, &Image->Width, &Image->Height, &Image->ChannelCount, 0);
+        if(Image->Pixels == NULL || (Image->ChannelCount != 3 && Image->ChannelCount != 4))
+        {
+            printf("Could not load image file: %s\n", Image->Name);
+            return -1;
+        }
+    }
+
+    atlas *Atlas = AT_BuildAtlas(Images, ImageCount, ATLAS_DEFAULT_PAGE_SIZE, ATLAS_DEFAULT_PADDING);
+    if(Atlas == NULL)
+    {
+        return -1;
+    }
+
+    if(!AT_WriteAtlas(Atlas, Argv[1]))
+    {
+        printf("Could not write %s\n", Argv[1]);
+        return -1;
+    }
+
+    printf("%s: %d sprites in %d page(s) of %dx%d, mip levels 0-%d\n", Argv[1], Atlas->SpriteCount, Atlas->PageCount, Atlas->PageWidth, Atlas->PageHeight, Atlas->MaxMipLevel);
+    for(u32 i = 0; i < Atlas->SpriteCount; i++)
+    {
+        atlas_sprite *Sprite = &Atlas->Sprites[i];
+        printf("    %-32s page %d (%4d, %4d) %dx%d\n", Sprite->Name, Sprite->Page, Sprite->X, Sprite->Y, Sprite->Width, Sprite->Height);
+    }
+
+    for(u32 i = 0; i < ImageCount; i++)
+    {
+        stbi_image_free(Images[i].Pixels);
+    }
+    AT_FreeAtlas(Atlas);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+  Offline texture cooker, see cooker.h
+
+  Usage (from the build directory):
+      texture_cooker [--premultiply] textures/Glow.png textures/Laser.png ...
+
+  Writes textures/Glow.tex next to every image, A_LoadTexture loads the
+  .tex instead of decoding the .png. Run it again after changing an image.
+*/
+
+#include <stdio.h>
+#include <SDL.h>
+
+#include "../shared.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../external/stb_image.h"
+
+#include "../cooker.cpp"
+
+i32 main(i32 Argc, char **Argv)
+{
+    i32 FirstImage = 1;
+    b32 Premultiply = false;
+    if(Argc > 1 && strcmp(Argv[1], "--premultiply") == 0)
+    {
+        Premultiply = true;
+        FirstImage++;
+    }
+
+    if(FirstImage >= Argc)
+    {
+        printf("Usage: texture_cooker [--premultiply] image.png [image.png ...]\n");
+        return -1;
+    }
+
+    // Same orientation as the textures loaded by the game
+    stbi_set_flip_vertically_on_load(1);
+
+    for(i32 i = FirstImage; i < Argc; i++)
+    {
+        char *Filename = Argv[i];
+        i32 Width, Height, ChannelCount;
+        u8 *Pixels = stbi_load(Filename, &Width, &Height, &ChannelCount, 0);
+        if(Pixels == NULL || (ChannelCount != 3 && ChannelCount != 4))
+        {
+            printf("Could not load image file: %s\n", Filename);
+            return -1;
+        }
+
+        cooked_texture *Texture = CK_CookTexture(Pixels, Width, Height, ChannelCount, Premultiply);
+        stbi_image_free(Pixels);
+
+        char CookedFilename[256];
+        CK_GetCookedFilename(CookedFilename, sizeof(CookedFilename), Filename);
+        if(!CK_WriteCookedTexture(Texture, CookedFilename))
+        {
+            printf("Could not write %s\n", CookedFilename);
+            return -1;
+        }
+
+        printf("%s: %dx%d, %d channels, %d mip levels, %zu bytes%s\n", CookedFilename, Width, Height, ChannelCount, Texture->LevelCount,
+               sizeof(cooked_texture_header) + Texture->PixelsSize, (Texture->Flags & COOKED_TEXTURE_PREMULTIPLIED) ? ", premultiplied" : "");
+        CK_FreeCookedTexture(Texture);
+    }
+
+    return 0;
+}